@@ -0,0 +1,37 @@
+#!/usr/bin/bash
+
+# runs every example with fvm and as the executable fvm-aot makes of it and
+# diffs what the two print. examples with instructions fvm-aot cannot compile
+# are skipped. build first with ./build.sh.
+
+set -e
+
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+failed=0
+
+for program in example/*.asm; do
+  name=$(basename "$program" .asm)
+
+  if ! ./fvm-aot -o "$dir/$name" "$program" 2> "$dir/$name.err"; then
+    echo "skip $program: $(head -n 1 "$dir/$name.err")"
+    continue
+  fi
+
+  status=0
+  ./fvm "$program" < /dev/null > "$dir/$name.fvm" 2>&1 || status=$?
+  echo "exit $status" >> "$dir/$name.fvm"
+
+  status=0
+  "$dir/$name" < /dev/null > "$dir/$name.aot" 2>&1 || status=$?
+  echo "exit $status" >> "$dir/$name.aot"
+
+  if diff -u "$dir/$name.fvm" "$dir/$name.aot"; then
+    echo "ok   $program"
+  else
+    failed=1
+  fi
+done
+
+exit $failed
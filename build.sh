@@ -2,4 +2,8 @@
 
 set -xe
 
-clang -Ivendor/c-vector main.c fvm.c fvm_scanner.c fvm_parser.c -o fvm
+clang -O2 -march=native -Ivendor/c-vector main.c fvm.c fvm_cpu.c fvm_stack.c fvm_snapshot.c fvm_io.c fvm_native.c fvm_verify.c fvm_opt.c fvm_trap.c fvm_serve.c fvm_pool.c fvm_sched.c fvm_channel.c fvm_shared.c fvm_heap.c fvm_profile.c fvm_perf.c fvm_debug.c fvm_scanner.c fvm_parser.c fvm_object.c -pthread -o fvm
+clang -Ivendor/c-vector fvm_aot.c fvm_cpu.c fvm_trap.c fvm_scanner.c fvm_parser.c fvm_object.c fvm_native.c -pthread -o fvm-aot
+clang -Ivendor/c-vector fvm_ld.c fvm_cpu.c fvm_trap.c fvm_scanner.c fvm_parser.c fvm_object.c fvm_native.c -pthread -o fvm-ld
+clang -O2 fvm_client.c -pthread -o fvm-client
+clang -O2 -march=native -Ivendor/c-vector fvm_bench.c fvm.c fvm_cpu.c fvm_stack.c fvm_io.c fvm_native.c fvm_verify.c fvm_trap.c fvm_sched.c fvm_channel.c fvm_shared.c fvm_heap.c fvm_profile.c fvm_perf.c fvm_scanner.c fvm_parser.c fvm_object.c -pthread -o fvm-bench
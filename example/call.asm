@@ -0,0 +1,21 @@
+main: ; this program calculates the sum of squares of 3 and 4
+  push 3
+  push 4
+  call sum_squares
+  pop B
+  pop B
+
+  halt
+
+; arguments are pushed by the caller: FP - 1 is the first, FP is the second
+sum_squares:
+  enter 1
+  load A, -1
+  mul A, A
+  store 1, A
+  load A, 0
+  mul A, A
+  load B, 1
+  add A, B
+  leave
+  ret
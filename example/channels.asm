@@ -0,0 +1,59 @@
+channels: ; this program squares 1 to 1000 in 4 fibers fed over a channel and adds up the squares
+  chan B, 16 ; the work
+  chan C, 16 ; the results
+  mov D, 4
+
+spawn_loop:
+  spawn squarer ; every squarer gets the two channel ids in B and C
+  sub D, 1
+  cmp D, 0
+  jg spawn_loop
+
+  spawn feeder
+
+  mov D, 0
+  mov E, 1000
+
+sum_loop:
+  recv A, C
+  add D, A
+  sub E, 1
+  cmp E, 0
+  jg sum_loop
+
+  puti D
+  putc 10
+
+  ; a 0 tells each squarer to stop
+  mov A, 0
+  mov D, 4
+
+stop_loop:
+  send B, A
+  sub D, 1
+  cmp D, 0
+  jg stop_loop
+
+  halt
+
+feeder:
+  mov A, 1
+
+feed_loop:
+  send B, A
+  add A, 1
+  cmp A, 1000
+  jle feed_loop
+
+  halt
+
+squarer:
+  recv A, B
+  cmp A, 0
+  je squarer_done
+  mul A, A
+  send C, A
+  jmp squarer
+
+squarer_done:
+  halt
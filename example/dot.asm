@@ -0,0 +1,36 @@
+dot: ; this program calculates the dot product of two 8 element vectors
+  push 1
+  push 2
+  push 3
+  push 4
+  push 5
+  push 6
+  push 7
+  push 8
+
+  push 8
+  push 7
+  push 6
+  push 5
+  push 4
+  push 3
+  push 2
+  push 1
+
+  mov A, 0
+  mov B, 8
+
+loop:
+  vload V0, A
+  vload V1, B
+  vmul V0, V1
+  vadd V2, V0
+  add A, 4
+  add B, 4
+  cmp A, 8
+  jl loop
+
+  vsum A, V2
+  puti A
+  putc '\n'
+  halt
@@ -0,0 +1,38 @@
+fibers: ; this program sums 0 to 7, a million times over, in 8 fibers
+  mov B, 0
+  mov C, 8
+
+spawn_loop:
+  mov A, B
+  spawn worker ; the worker starts with A = B, its id comes back in A
+  push A
+  add B, 1
+  cmp B, C
+  jl spawn_loop
+
+  mov D, 0
+
+join_loop:
+  pop A
+  join A ; waits for the worker and takes its A
+  add D, A
+  sub B, 1
+  cmp B, 0
+  jg join_loop
+
+  puti D
+  putc 10
+  halt
+
+worker:
+  mov E, 0
+  mov F, 1000000
+
+work_loop:
+  add E, A
+  sub F, 1
+  cmp F, 0
+  jg work_loop
+
+  mov A, E
+  halt
@@ -0,0 +1,16 @@
+hello: ; prints a greeting and the numbers from 1 to 5
+  putc 'h'
+  putc 'i'
+  putc '\n'
+
+  mov A, 1
+
+loop:
+  puti A
+  putc ' '
+  add A, 1
+  cmp A, 5
+  jle loop
+
+  putc '\n'
+  halt
@@ -0,0 +1,66 @@
+histogram: ; counts the squares of 0 to 799999 by their remainder mod 16 in 8 fibers, run it with -m 16
+  mov B, 0
+  mov C, 8
+
+spawn_loop:
+  mov A, B
+  spawn worker ; worker A takes the numbers A * 100000 up to (A + 1) * 100000
+  push A
+  add B, 1
+  cmp B, C
+  jl spawn_loop
+
+join_loop:
+  pop A
+  join A
+  sub B, 1
+  cmp B, 0
+  jg join_loop
+
+  mov B, 0
+
+print_loop:
+  sload A, B
+  puti A
+  putc 32
+  add B, 1
+  cmp B, 16
+  jl print_loop
+
+  putc 10
+  halt
+
+worker:
+  mov B, A
+  mul B, 100000
+  mov C, B
+  add C, 100000
+  alloc A, 16 ; this worker's own counts, no other fiber touches them
+
+work_loop:
+  mov D, B
+  mul D, D
+  mov E, D
+  div E, 16
+  mul E, 16
+  sub D, E ; D is the square mod 16
+  add D, A
+  hload F, D
+  add F, 1
+  hstore D, F
+  add B, 1
+  cmp B, C
+  jl work_loop
+
+  mov D, 0
+
+merge_loop:
+  mov E, D
+  add E, A
+  hload F, E
+  xadd D, F ; one shared add per bucket once the worker is done
+  add D, 1
+  cmp D, 16
+  jl merge_loop
+
+  halt
@@ -0,0 +1,38 @@
+list: ; builds a linked list of 1 to 100 on the heap and adds it up, 10 times over (-a shows the heap statistics)
+  mov F, 0
+  mov E, 10
+
+round:
+  mov B, 0 ; the list so far, 0 is never the address of a block
+  mov C, 1
+
+build:
+  alloc A, 2 ; a node holds its value and the address of the next node
+  hstore A, C
+  add A, 1
+  hstore A, B
+  sub A, 1
+  mov B, A
+  add C, 1
+  cmp C, 100
+  jle build
+
+walk:
+  hload D, B
+  add F, D
+  mov A, B
+  add A, 1
+  hload C, A
+  free B ; the next round gets this node back from the free list
+  mov B, C
+  cmp B, 0
+  jne walk
+
+  sub E, 1
+  cmp E, 0
+  jg round
+
+  hreset ; not needed here, everything is freed already
+  puti F
+  putc 10
+  halt
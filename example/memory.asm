@@ -0,0 +1,36 @@
+memory: ; this program copies, fills and compares blocks of stack cells
+  push 'h'
+  push 'e'
+  push 'l'
+  push 'l'
+  push 'o'
+  push '\n'
+
+  ; copy the 6 cells at 0 to 6 and print them
+  mov A, 6
+  mov B, 0
+  mov C, 6
+  mcopy A, B, C
+  write A, C
+
+  ; the copies are equal
+  mcmp A, B, C
+  jne fail
+
+  ; overwrite the copy with 'x' and print it
+  mov D, 'x'
+  mov E, 5
+  mfill A, D, E
+  write A, C
+
+  ; now the copy comes after the original
+  mcmp A, B, C
+  jle fail
+
+  puti C
+  putc '\n'
+  halt
+
+fail:
+  putc '!'
+  halt
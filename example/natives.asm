@@ -0,0 +1,35 @@
+natives: ; calls the natives fvm registers for every program, arguments go in A to F and the result comes back in A
+  mov A, -42
+  native abs ; 42
+  puti A
+  putc 10
+
+  mov A, 7
+  mov B, 3
+  native min ; 3
+  puti A
+  putc 10
+
+  mov A, 7
+  mov B, 3
+  native max ; 7
+  puti A
+  putc 10
+
+  mov C, 0
+  mov D, 0 ; counts the perfect squares below 1000
+
+loop:
+  mov A, C
+  native isqrt
+  mul A, A
+  jne A, C, next
+  add D, 1
+next:
+  add C, 1
+  jl C, 1000, loop
+
+  puti D ; 32
+  putc 10
+
+  halt
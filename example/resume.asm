@@ -0,0 +1,24 @@
+resume: ; prints the squares of 1 to 20 and their sum, stop it early with -b and -S and go on with -R
+  mov A, 1
+
+squares:
+  mov B, A
+  mul B, A
+  push B ; the squares wait on the stack, which a snapshot keeps
+  puti B
+  putc ' '
+  add A, 1
+  jle A, 20, squares
+
+  putc '\n'
+  mov C, 0
+
+sum:
+  pop B
+  add C, B
+  sub A, 1
+  jg A, 1, sum
+
+  puti C
+  putc '\n'
+  halt
@@ -0,0 +1,63 @@
+switch: ; sums 0 to 15 over and over, dispatching on each value with one jtab (compare example/switch_chain.asm)
+  mov C, 0
+  mov D, 0
+loop:
+  div B, C, 16 ; B = C mod 16
+  mul B, 16
+  sub B, C, B
+  jtab B, c0, c1, c2, c3, c4, c5, c6, c7, c8, c9, c10, c11, c12, c13, c14, c15
+  jmp next
+c0:
+  add D, 0
+  jmp next
+c1:
+  add D, 1
+  jmp next
+c2:
+  add D, 2
+  jmp next
+c3:
+  add D, 3
+  jmp next
+c4:
+  add D, 4
+  jmp next
+c5:
+  add D, 5
+  jmp next
+c6:
+  add D, 6
+  jmp next
+c7:
+  add D, 7
+  jmp next
+c8:
+  add D, 8
+  jmp next
+c9:
+  add D, 9
+  jmp next
+c10:
+  add D, 10
+  jmp next
+c11:
+  add D, 11
+  jmp next
+c12:
+  add D, 12
+  jmp next
+c13:
+  add D, 13
+  jmp next
+c14:
+  add D, 14
+  jmp next
+c15:
+  add D, 15
+  jmp next
+next:
+  add C, 1
+  jl C, 5000000, loop
+  puti D
+  putc 10
+  halt
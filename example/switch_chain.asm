@@ -0,0 +1,78 @@
+switch_chain: ; example/switch.asm with a chain of compares in place of the jtab
+  mov C, 0
+  mov D, 0
+loop:
+  div B, C, 16 ; B = C mod 16
+  mul B, 16
+  sub B, C, B
+  je B, 0, c0
+  je B, 1, c1
+  je B, 2, c2
+  je B, 3, c3
+  je B, 4, c4
+  je B, 5, c5
+  je B, 6, c6
+  je B, 7, c7
+  je B, 8, c8
+  je B, 9, c9
+  je B, 10, c10
+  je B, 11, c11
+  je B, 12, c12
+  je B, 13, c13
+  je B, 14, c14
+  je B, 15, c15
+  jmp next
+c0:
+  add D, 0
+  jmp next
+c1:
+  add D, 1
+  jmp next
+c2:
+  add D, 2
+  jmp next
+c3:
+  add D, 3
+  jmp next
+c4:
+  add D, 4
+  jmp next
+c5:
+  add D, 5
+  jmp next
+c6:
+  add D, 6
+  jmp next
+c7:
+  add D, 7
+  jmp next
+c8:
+  add D, 8
+  jmp next
+c9:
+  add D, 9
+  jmp next
+c10:
+  add D, 10
+  jmp next
+c11:
+  add D, 11
+  jmp next
+c12:
+  add D, 12
+  jmp next
+c13:
+  add D, 13
+  jmp next
+c14:
+  add D, 14
+  jmp next
+c15:
+  add D, 15
+  jmp next
+next:
+  add C, 1
+  jl C, 5000000, loop
+  puti D
+  putc 10
+  halt
@@ -1,8 +1,17 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include "fvm.h"
+#include "fvm_channel.h"
+#include "fvm_native.h"
+#include "fvm_profile.h"
+#include "fvm_sched.h"
+#include "fvm_shared.h"
+#include "fvm_trap.h"
+#include "fvm_vector.h"
+#include "fvm_verify.h"
 
 static int64_t fetch(FVM* vm, int offset) {
   return vm->instructions[vm->registers[REG_IP] - offset];
@@ -14,14 +23,285 @@ static void advance(FVM* vm) {
 
 static void push(FVM* vm, int64_t value) {
   vm->registers[REG_SP] += 1;
-  vm->stack[vm->registers[REG_SP]] = value;
+  vm->stack.base[vm->registers[REG_SP]] = value;
 }
 
 static void pop(FVM* vm) {
   vm->registers[REG_SP] -= 1;
 }
 
-static void debug(FVM* vm) {
+/* push and pop move SP a cell at a time and run into a guard page before
+ * they get anywhere else. everything that moves it further goes through
+ * here, so SP always stays between -1 and the last cell of the stack. */
+static void move_sp(FVM* vm, int64_t sp) {
+  if (sp < -1)
+    fvm_fail("stack underflow!");
+
+  if (sp >= (int64_t)(vm->stack.reserved / sizeof(int64_t)))
+    fvm_fail("stack overflow!");
+
+  vm->registers[REG_SP] = sp;
+}
+
+/* called whenever a new run of straight-line code is entered. running out of
+ * budget stops the dispatch loop, fvm_run_for tells that apart from halt. */
+static void charge(FVM* vm) {
+  uint64_t ip = (uint64_t)vm->registers[REG_IP];
+
+  /* a bad jump in an unverified program is reported by check, not here. */
+  vm->budget -= ip <= vm->program->length ? vm->program->run_costs[ip] : 1;
+
+  if (vm->budget < 0)
+    vm->running = false;
+}
+
+void fvm_reserve_calls(FVM* vm, int64_t size) {
+  if (size <= vm->call_capacity)
+    return;
+
+  if (size > CALL_STACK_SIZE)
+    fvm_fail("call stack overflow!");
+
+  int64_t capacity = vm->call_capacity ? vm->call_capacity : CALL_STACK_INITIAL_SIZE;
+
+  while (capacity < size)
+    capacity *= 2;
+
+  if (capacity > CALL_STACK_SIZE)
+    capacity = CALL_STACK_SIZE;
+
+  int64_t* call_stack = realloc(vm->call_stack, sizeof(int64_t) * capacity);
+
+  if (!call_stack) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  vm->call_stack = call_stack;
+  vm->call_capacity = capacity;
+}
+
+static void call_push(FVM* vm, int64_t value) {
+  /* growing shares the branch with the overflow check. */
+  if (vm->call_sp + 1 >= vm->call_capacity)
+    fvm_reserve_calls(vm, vm->call_sp + 2);
+
+  vm->call_sp += 1;
+  vm->call_stack[vm->call_sp] = value;
+}
+
+static int64_t call_pop(FVM* vm) {
+  if (vm->call_sp < 0)
+    fvm_fail("call stack underflow!");
+
+  vm->call_sp -= 1;
+  return vm->call_stack[vm->call_sp + 1];
+}
+
+FVMVector* fvm_vectors(FVM* vm) {
+  if (!vm->vectors) {
+    vm->vectors = calloc(VREG_SIZE, sizeof(FVMVector));
+
+    if (!vm->vectors) {
+      fprintf(stderr, "ERROR: cannot allocate memory!\n");
+      exit(1);
+    }
+  }
+
+  return vm->vectors;
+}
+
+FVMHeap* fvm_heap(FVM* vm) {
+  if (!vm->heap) {
+    vm->heap = malloc(sizeof(FVMHeap));
+
+    if (!vm->heap) {
+      fprintf(stderr, "ERROR: cannot allocate memory!\n");
+      exit(1);
+    }
+
+    fvm_heap_init(vm->heap);
+  }
+
+  return vm->heap;
+}
+
+FVMChannels* fvm_channels(FVM* vm) {
+  if (!vm->channels)
+    vm->channels = fvm_channels_new();
+
+  return vm->channels;
+}
+
+static void fault(FVM* vm, const char* message) {
+  char buffer[128];
+  snprintf(buffer, sizeof(buffer), "%s at address %ld", message, vm->registers[REG_IP]);
+  fvm_fail(buffer);
+}
+
+/* stops a fiber back cells into the instruction it is in, to run that
+ * instruction again once the scheduler wakes it up. */
+static void block(FVM* vm, int64_t back) {
+  vm->registers[REG_IP] -= back;
+  vm->blocked = true;
+  vm->running = false;
+  vm->budget = -1;
+}
+
+static FVMChannel* channel_of(FVM* vm, int64_t id) {
+  FVMChannel* channel = vm->channels ? fvm_channel_get(vm->channels, id) : NULL;
+
+  if (!channel)
+    fault(vm, "unknown channel");
+
+  return channel;
+}
+
+/* a fiber parks until the other side made progress, a vm on a thread of
+ * its own waits right in send or recv instead. neither is a branch: a fiber
+ * that parks stops mid-run, the rest of the run is charged again when it
+ * resumes. */
+static void wait_on(FVM* vm, FVMChannel* channel, bool sending) {
+  vm->channel = channel;
+  vm->sending = sending;
+  block(vm, 2);
+}
+
+static _Atomic int64_t* shared_cell(FVM* vm, int64_t index) {
+  if (!vm->shared)
+    fault(vm, "no shared memory attached");
+
+  if ((uint64_t)index >= vm->shared->size)
+    fault(vm, "shared memory access out of bounds");
+
+  return &vm->shared->cells[index];
+}
+
+static int64_t alloc_block(FVM* vm, int64_t size) {
+  int64_t address;
+
+  if (size < 0 || size > HEAP_SIZE / 2)
+    fault(vm, "invalid allocation size");
+
+  if (!fvm_heap_alloc(fvm_heap(vm), size, &address))
+    fault(vm, "out of heap memory");
+
+  return address;
+}
+
+static int64_t* heap_cell(FVM* vm, int64_t address) {
+  /* blocks that were freed stay accessible, like stack cells past SP. */
+  if (!vm->heap || address < 0 || address >= vm->heap->top)
+    fault(vm, "heap access out of bounds");
+
+  return &vm->heap->cells[address];
+}
+
+/* the slow path for programs fvm_verify did not accept: everything eval is
+ * about to trust gets checked first. returns the register the instruction
+ * writes, -1 for none. */
+static int64_t check(FVM* vm) {
+  const FVMProgram* program = vm->program;
+  int64_t ip = vm->registers[REG_IP];
+
+  if (ip < 0 || ip >= (int64_t)program->length)
+    fault(vm, "instruction pointer out of bounds");
+
+  const InstructionInfo* info = instruction_info(fetch(vm, 0));
+
+  if (!info)
+    fault(vm, "unknown instruction");
+
+  if (instruction_length(info, &program->instructions[ip], program->length - (size_t)ip) >
+      program->length - (size_t)ip)
+    fault(vm, "truncated instruction");
+
+  int64_t written = -1;
+
+  for (size_t i = 0; info->operands[i]; i++) {
+    char kind = info->operands[i];
+    int64_t operand = fetch(vm, -(int)(i + 1));
+
+    if ((kind == 'r' || kind == 'w' || kind == 'm') && (operand < 0 || operand >= REG_SIZE))
+      fault(vm, "invalid register");
+
+    if (kind == 'w' || kind == 'm')
+      written = operand;
+
+    if (kind == 'n' && (operand < 0 || operand >= fvm_native_count()))
+      fault(vm, "unknown native function");
+
+    if (kind == 'v' && (operand < 0 || operand >= VREG_SIZE))
+      fault(vm, "invalid vector register");
+  }
+
+  return written;
+}
+
+/* the one bounds check a bulk memory instruction does: all len cells from
+ * start have to fit in the stack. they are committed up front, so the copy
+ * itself never faults. */
+static int64_t* memory_range(FVM* vm, int64_t start, int64_t len) {
+  int64_t size = (int64_t)(vm->stack.reserved / sizeof(int64_t));
+
+  if (start < 0 || len < 0 || start > size || len > size - start)
+    fault(vm, "memory access out of bounds");
+
+  fvm_stack_commit(&vm->stack, (size_t)(start + len));
+
+  return vm->stack.base + start;
+}
+
+/* push and pop move one cell at a time and always hit a guard page first.
+ * load and store reach from FP and vload, vstore and write from any
+ * register, so they can land past the guard pages in memory that isn't the
+ * stack. no verifier can bound a register, so these are checked in
+ * verified programs too. */
+static int64_t* stack_cell(FVM* vm, int64_t index) {
+  if ((uint64_t)index >= vm->stack.reserved / sizeof(int64_t))
+    fault(vm, "memory access out of bounds");
+
+  return &vm->stack.base[index];
+}
+
+static int64_t frame_index(FVM* vm, int64_t offset) {
+  return (int64_t)((uint64_t)vm->registers[REG_FP] + (uint64_t)offset);
+}
+
+static void memory_fill(int64_t* dst, int64_t value, int64_t len) {
+  /* memset only repeats bytes, which covers the usual 0 and -1. */
+  if (value == 0 || value == -1) {
+    memset(dst, (int)(value & 0xff), sizeof(int64_t) * len);
+    return;
+  }
+
+  for (int64_t i = 0; i < len; i++)
+    dst[i] = value;
+}
+
+/* memcmp finds the block holding the first difference, the cells in it are
+ * compared as numbers so the flags mean the same as after cmp. */
+static void memory_compare(FVM* vm, const int64_t* a, const int64_t* b, int64_t len) {
+  int64_t i = 0;
+
+  while (i < len) {
+    int64_t block = len - i < 64 ? len - i : 64;
+
+    if (memcmp(a + i, b + i, sizeof(int64_t) * block) != 0)
+      break;
+
+    i += block;
+  }
+
+  while (i < len && a[i] == b[i])
+    i += 1;
+
+  vm->flags[FLAG_EQ] = i == len;
+  vm->flags[FLAG_GT] = i < len && a[i] > b[i];
+  vm->flags[FLAG_LT] = i < len && a[i] < b[i];
+}
+
+void fvm_print_registers(const FVM* vm) {
   printf("REGISTERS: ");
 
   for (int i = 0; i < REG_SIZE; i++)
@@ -30,10 +310,21 @@ static void debug(FVM* vm) {
   printf("\n");
 }
 
+/* the end of a fused compare and branch, IP on its jump target. */
+static void branch_if(FVM* vm, bool taken) {
+  if (taken)
+    vm->registers[REG_IP] = fetch(vm, 0);
+  else
+    advance(vm);
+
+  charge(vm);
+}
+
 static void eval(FVM* vm) {
   switch (fetch(vm, 0)) {
   case INS_HALT:
     vm->running = false;
+    fvm_output_flush(&vm->output);
     break;
   case INS_PUSH:
     advance(vm);
@@ -47,7 +338,7 @@ static void eval(FVM* vm) {
     break;
   case INS_POP:
     advance(vm);
-    vm->registers[fetch(vm, 0)] = vm->stack[vm->registers[REG_SP]];
+    vm->registers[fetch(vm, 0)] = vm->stack.base[vm->registers[REG_SP]];
     advance(vm);
     pop(vm);
     break;
@@ -130,10 +421,12 @@ static void eval(FVM* vm) {
   case INS_JMP:
     advance(vm);
     vm->registers[REG_IP] = vm->registers[fetch(vm, 0)];
+    charge(vm);
     break;
   case INS_JMPI:
     advance(vm);
     vm->registers[REG_IP] = fetch(vm, 0);
+    charge(vm);
     break;
   case INS_JE:
     advance(vm);
@@ -143,6 +436,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JEI:
     advance(vm);
@@ -152,6 +446,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JNE:
     advance(vm);
@@ -161,6 +456,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JNEI:
     advance(vm);
@@ -170,6 +466,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JG:
     advance(vm);
@@ -179,6 +476,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JGI:
     advance(vm);
@@ -188,6 +486,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JL:
     advance(vm);
@@ -197,6 +496,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JLI:
     advance(vm);
@@ -206,6 +506,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JGE:
     advance(vm);
@@ -215,6 +516,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JGEI:
     advance(vm);
@@ -224,6 +526,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JLE:
     advance(vm);
@@ -233,6 +536,7 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
   case INS_JLEI:
     advance(vm);
@@ -242,28 +546,726 @@ static void eval(FVM* vm) {
     } else {
       advance(vm);
     }
+    charge(vm);
     break;
-  default:
-    fprintf(stderr, "ERROR: unknown instruction: %ld\n", fetch(vm, 0));
-    exit(1);
+  case INS_CALL:
+    advance(vm);
+    call_push(vm, vm->registers[REG_IP] + 1);
+    vm->registers[REG_IP] = vm->registers[fetch(vm, 0)];
+    charge(vm);
+    break;
+  case INS_CALLI:
+    advance(vm);
+    call_push(vm, vm->registers[REG_IP] + 1);
+    vm->registers[REG_IP] = fetch(vm, 0);
+    charge(vm);
+    break;
+  case INS_RET:
+    vm->registers[REG_IP] = call_pop(vm);
+    charge(vm);
+    break;
+  case INS_ENTER:
+    advance(vm);
+    call_push(vm, vm->registers[REG_FP]);
+    vm->registers[REG_FP] = vm->registers[REG_SP];
+    move_sp(vm, (int64_t)((uint64_t)vm->registers[REG_SP] + (uint64_t)fetch(vm, 0)));
+    advance(vm);
+    break;
+  case INS_LEAVE:
+    move_sp(vm, vm->registers[REG_FP]);
+    vm->registers[REG_FP] = call_pop(vm);
+    advance(vm);
+    break;
+  case INS_LOAD:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 1)] = *stack_cell(vm, frame_index(vm, fetch(vm, 0)));
+    advance(vm);
+    break;
+  case INS_STORE:
+    advance(vm);
+    advance(vm);
+    *stack_cell(vm, frame_index(vm, fetch(vm, 1))) = vm->registers[fetch(vm, 0)];
+    advance(vm);
+    break;
+  case INS_PUTC:
+    advance(vm);
+    fvm_output_byte(&vm->output, (char)vm->registers[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_PUTCI:
+    advance(vm);
+    fvm_output_byte(&vm->output, (char)fetch(vm, 0));
+    advance(vm);
+    break;
+  case INS_PUTI:
+    advance(vm);
+    fvm_output_int(&vm->output, vm->registers[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_PUTII:
+    advance(vm);
+    fvm_output_int(&vm->output, fetch(vm, 0));
+    advance(vm);
+    break;
+  case INS_WRITE:
+    advance(vm);
+    advance(vm);
+
+    if (vm->registers[fetch(vm, 0)] > 0) {
+      int64_t len = vm->registers[fetch(vm, 0)];
+      const int64_t* cells = memory_range(vm, vm->registers[fetch(vm, 1)], len);
+
+      for (int64_t i = 0; i < len; i++)
+        fvm_output_byte(&vm->output, (char)cells[i]);
+    }
+
+    advance(vm);
+    break;
+  case INS_READ:
+    advance(vm);
+
+    /* whoever is on the other end may be waiting for our output first. */
+    if (vm->input.position == vm->input.length)
+      fvm_output_flush(&vm->output);
+
+    vm->registers[fetch(vm, 0)] = fvm_input_byte(&vm->input);
+    advance(vm);
+    break;
+  case INS_NATIVE:
+    advance(vm);
+    vm->registers[REG_A] = fvm_natives[fetch(vm, 0)](vm->registers[REG_A], vm->registers[REG_B],
+                                                     vm->registers[REG_C], vm->registers[REG_D],
+                                                     vm->registers[REG_E], vm->registers[REG_F]);
+    advance(vm);
+    break;
+  case INS_VLOAD:
+    advance(vm);
+    advance(vm);
+    vector_load(fvm_vectors(vm)[fetch(vm, 1)], memory_range(vm, vm->registers[fetch(vm, 0)], VECTOR_LANES));
+    advance(vm);
+    break;
+  case INS_VSTORE:
+    advance(vm);
+    advance(vm);
+    vector_load(memory_range(vm, vm->registers[fetch(vm, 1)], VECTOR_LANES), fvm_vectors(vm)[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_VADD:
+    advance(vm);
+    advance(vm);
+    vector_add(fvm_vectors(vm)[fetch(vm, 1)], fvm_vectors(vm)[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_VSUB:
+    advance(vm);
+    advance(vm);
+    vector_sub(fvm_vectors(vm)[fetch(vm, 1)], fvm_vectors(vm)[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_VMUL:
+    advance(vm);
+    advance(vm);
+    vector_mul(fvm_vectors(vm)[fetch(vm, 1)], fvm_vectors(vm)[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_VCMP:
+    advance(vm);
+    advance(vm);
+    vector_cmp(fvm_vectors(vm)[fetch(vm, 1)], fvm_vectors(vm)[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_VSUM:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 1)] = vector_sum(fvm_vectors(vm)[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_MCOPY: {
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    int64_t len = vm->registers[fetch(vm, 0)];
+    int64_t* dst = memory_range(vm, vm->registers[fetch(vm, 2)], len);
+    int64_t* src = memory_range(vm, vm->registers[fetch(vm, 1)], len);
+    memmove(dst, src, sizeof(int64_t) * len);
+    advance(vm);
+    break;
+  }
+  case INS_MFILL: {
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    int64_t len = vm->registers[fetch(vm, 0)];
+    memory_fill(memory_range(vm, vm->registers[fetch(vm, 2)], len), vm->registers[fetch(vm, 1)], len);
+    advance(vm);
+    break;
+  }
+  case INS_MCMP: {
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    int64_t len = vm->registers[fetch(vm, 0)];
+    int64_t* a = memory_range(vm, vm->registers[fetch(vm, 2)], len);
+    int64_t* b = memory_range(vm, vm->registers[fetch(vm, 1)], len);
+    memory_compare(vm, a, b, len);
+    advance(vm);
+    break;
+  }
+  case INS_SPAWN:
+    advance(vm);
+
+    if (!vm->scheduler)
+      fault(vm, "spawn outside of the scheduler");
+
+    vm->registers[REG_A] = fvm_sched_spawn(vm, fetch(vm, 0));
+    advance(vm);
+    break;
+  case INS_YIELD:
+    advance(vm);
+
+    /* hand the thread back without charging the next run. */
+    if (vm->scheduler) {
+      vm->running = false;
+      vm->budget = -1;
+    } else {
+      charge(vm);
+    }
+    break;
+  case INS_JOIN: {
+    advance(vm);
+    int64_t fiber = vm->registers[fetch(vm, 0)];
+
+    if (!vm->scheduler || !fvm_sched_joinable(vm, fiber))
+      fault(vm, "join of an unknown fiber");
+
+    int64_t result;
+
+    if (!fvm_sched_result(vm, fiber, &result)) {
+      /* runs again once the fiber halted. */
+      vm->joining = fiber;
+      vm->channel = NULL;
+      block(vm, 1);
+      break;
+    }
+
+    vm->registers[fetch(vm, 0)] = result;
+    advance(vm);
+    charge(vm);
+    break;
+  }
+  case INS_CHAN: {
+    advance(vm);
+    advance(vm);
+    int64_t channel = fvm_channel_new(fvm_channels(vm), fetch(vm, 0), FVM_CHANNEL_MPMC);
+
+    if (channel == -1)
+      fault(vm, "cannot create the channel");
+
+    vm->registers[fetch(vm, 1)] = channel;
+    advance(vm);
+    break;
+  }
+  case INS_SEND: {
+    advance(vm);
+    advance(vm);
+    FVMChannel* channel = channel_of(vm, vm->registers[fetch(vm, 1)]);
+    int64_t value = vm->registers[fetch(vm, 0)];
+
+    if (!fvm_channel_try_send(channel, value)) {
+      if (vm->scheduler) {
+        wait_on(vm, channel, true);
+        break;
+      }
+
+      if (!fvm_channels_shared(vm->channels))
+        fault(vm, "deadlock: send on a full channel no other vm can reach");
+
+      fvm_channel_send(channel, value);
+    }
+
+    advance(vm);
+    break;
+  }
+  case INS_RECV: {
+    advance(vm);
+    advance(vm);
+    FVMChannel* channel = channel_of(vm, vm->registers[fetch(vm, 0)]);
+    int64_t value;
+
+    if (!fvm_channel_try_recv(channel, &value)) {
+      if (vm->scheduler) {
+        wait_on(vm, channel, false);
+        break;
+      }
+
+      if (!fvm_channels_shared(vm->channels))
+        fault(vm, "deadlock: recv on an empty channel no other vm can reach");
+
+      value = fvm_channel_recv(channel);
+    }
+
+    vm->registers[fetch(vm, 1)] = value;
+    advance(vm);
+    break;
+  }
+  case INS_SLOAD:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 1)] =
+      atomic_load_explicit(shared_cell(vm, vm->registers[fetch(vm, 0)]), memory_order_acquire);
+    advance(vm);
+    break;
+  case INS_SSTORE:
+    advance(vm);
+    advance(vm);
+    atomic_store_explicit(shared_cell(vm, vm->registers[fetch(vm, 1)]), vm->registers[fetch(vm, 0)],
+                          memory_order_release);
+    advance(vm);
+    break;
+  case INS_XADD:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 0)] = atomic_fetch_add_explicit(shared_cell(vm, vm->registers[fetch(vm, 1)]),
+                                                            vm->registers[fetch(vm, 0)], memory_order_acq_rel);
+    advance(vm);
+    break;
+  case INS_XCHG:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 0)] = atomic_exchange_explicit(shared_cell(vm, vm->registers[fetch(vm, 1)]),
+                                                           vm->registers[fetch(vm, 0)], memory_order_acq_rel);
+    advance(vm);
+    break;
+  case INS_CAS: {
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    int64_t expected = vm->registers[fetch(vm, 1)];
+    int64_t seen = expected;
+
+    atomic_compare_exchange_strong_explicit(shared_cell(vm, vm->registers[fetch(vm, 2)]), &seen,
+                                            vm->registers[fetch(vm, 0)], memory_order_acq_rel,
+                                            memory_order_acquire);
+
+    vm->flags[FLAG_EQ] = seen == expected;
+    vm->flags[FLAG_GT] = seen > expected;
+    vm->flags[FLAG_LT] = seen < expected;
+    vm->registers[fetch(vm, 1)] = seen;
+    advance(vm);
+    break;
+  }
+  case INS_FENCE:
+    advance(vm);
+    atomic_thread_fence(memory_order_seq_cst);
+    break;
+  case INS_ALLOC:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 1)] = alloc_block(vm, vm->registers[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_ALLOCI:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 1)] = alloc_block(vm, fetch(vm, 0));
+    advance(vm);
+    break;
+  case INS_FREE:
+    advance(vm);
+
+    if (!vm->heap || !fvm_heap_free(vm->heap, vm->registers[fetch(vm, 0)]))
+      fault(vm, "free of an invalid address");
+
+    advance(vm);
+    break;
+  case INS_HLOAD:
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 1)] = *heap_cell(vm, vm->registers[fetch(vm, 0)]);
+    advance(vm);
+    break;
+  case INS_HSTORE:
+    advance(vm);
+    advance(vm);
+    *heap_cell(vm, vm->registers[fetch(vm, 1)]) = vm->registers[fetch(vm, 0)];
+    advance(vm);
+    break;
+  case INS_HRESET:
+    advance(vm);
+    fvm_heap_reset(fvm_heap(vm));
+    break;
+  case INS_ADD3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] + vm->registers[fetch(vm, 0)];
+    advance(vm);
+    break;
+  case INS_ADD3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] + fetch(vm, 0);
+    advance(vm);
+    break;
+  case INS_SUB3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] - vm->registers[fetch(vm, 0)];
+    advance(vm);
+    break;
+  case INS_SUB3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] - fetch(vm, 0);
+    advance(vm);
+    break;
+  case INS_MUL3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] * vm->registers[fetch(vm, 0)];
+    advance(vm);
+    break;
+  case INS_MUL3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] * fetch(vm, 0);
+    advance(vm);
+    break;
+  case INS_DIV3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] / vm->registers[fetch(vm, 0)];
+    advance(vm);
+    break;
+  case INS_DIV3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    vm->registers[fetch(vm, 2)] = vm->registers[fetch(vm, 1)] / fetch(vm, 0);
+    advance(vm);
+    break;
+  case INS_JE3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] == vm->registers[fetch(vm, 1)]);
+    break;
+  case INS_JE3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] == fetch(vm, 1));
+    break;
+  case INS_JNE3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] != vm->registers[fetch(vm, 1)]);
+    break;
+  case INS_JNE3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] != fetch(vm, 1));
+    break;
+  case INS_JG3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] > vm->registers[fetch(vm, 1)]);
+    break;
+  case INS_JG3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] > fetch(vm, 1));
+    break;
+  case INS_JL3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] < vm->registers[fetch(vm, 1)]);
+    break;
+  case INS_JL3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] < fetch(vm, 1));
+    break;
+  case INS_JGE3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] >= vm->registers[fetch(vm, 1)]);
+    break;
+  case INS_JGE3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] >= fetch(vm, 1));
+    break;
+  case INS_JLE3:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] <= vm->registers[fetch(vm, 1)]);
+    break;
+  case INS_JLE3I:
+    advance(vm);
+    advance(vm);
+    advance(vm);
+    branch_if(vm, vm->registers[fetch(vm, 2)] <= fetch(vm, 1));
+    break;
+  case INS_JTAB: {
+    advance(vm);
+    advance(vm);
+    /* IP is on the count with the table right after it, an index outside
+     * of it goes past the table. */
+    uint64_t index = (uint64_t)vm->registers[fetch(vm, 1)];
+    uint64_t count = (uint64_t)fetch(vm, 0);
+
+    if (index < count)
+      vm->registers[REG_IP] = fetch(vm, -(int)(index + 1));
+    else
+      vm->registers[REG_IP] += (int64_t)count + 1;
+
+    charge(vm);
+    break;
+  }
+  case INS_BREAK:
+    /* written over an instruction by the debugger: stop in front of it, as
+     * if the budget had run out. */
+    vm->running = false;
+    vm->budget = -1;
+    break;
+  default: {
+    char message[64];
+    snprintf(message, sizeof(message), "unknown instruction: %ld", fetch(vm, 0));
+    fvm_fail(message);
   }
+  }
+}
+
+/* an unverified program may write SP and IP like any other register, eval
+ * only expects the stack instructions to move SP and the branches to move
+ * IP. a write to IP ends the run like a branch does, so it is charged too. */
+static void eval_checked(FVM* vm) {
+  int64_t written = check(vm);
+
+  eval(vm);
+
+  if (written == REG_SP)
+    move_sp(vm, vm->registers[REG_SP]);
+  else if (written == REG_IP)
+    charge(vm);
 }
 
-void fvm_execute(FVM* vm) {
-  while (vm->running) {
-    eval(vm);
-    debug(vm);
+static void dispatch(FVM* vm) {
+  if (vm->program->verified) {
+    while (vm->running)
+      eval(vm);
+  } else {
+    while (vm->running)
+      eval_checked(vm);
   }
 }
 
-void fvm_init(FVM* vm, const int64_t* instructions) {
-  if (instructions)
+int64_t fvm_execute(FVM* vm) {
+  fvm_stack_activate(&vm->stack);
+  fvm_profile_activate(vm);
+
+  /* the budget never runs out, it only keeps count. halt ends a run, so
+   * what was charged is what was executed. */
+  vm->budget = INT64_MAX;
+  charge(vm);
+  dispatch(vm);
+
+  fvm_profile_activate(NULL);
+  fvm_stack_activate(NULL);
+
+  return INT64_MAX - vm->budget;
+}
+
+FVMStatus fvm_run_for(FVM* vm, int64_t budget) {
+  if (!vm->running)
+    return FVM_HALTED;
+
+  fvm_stack_activate(&vm->stack);
+  fvm_profile_activate(vm);
+
+  uint64_t ip = (uint64_t)vm->registers[REG_IP];
+  int64_t cost = ip <= vm->program->length ? vm->program->run_costs[ip] : 1;
+
+  if (cost > budget) {
+    /* the rest of this run does not fit, step what does. */
+    vm->budget = INT64_MAX;
+
+    for (int64_t i = 0; i < budget && vm->running; i++) {
+      if (vm->program->verified)
+        eval(vm);
+      else
+        eval_checked(vm);
+    }
+  } else {
+    vm->budget = budget - cost;
+    dispatch(vm);
+  }
+
+  if (vm->budget < 0) {
+    /* stopped at the start of a run it could not pay for, or yielded. */
     vm->running = true;
+  }
+
+  fvm_profile_activate(NULL);
+  fvm_stack_activate(NULL);
+
+  if (vm->blocked) {
+    vm->blocked = false;
+    return FVM_BLOCKED;
+  }
+
+  return vm->running ? FVM_PREEMPTED : FVM_HALTED;
+}
+
+/* whether the instruction at code writes IP through a register operand,
+ * which only an unverified program can do. */
+static bool writes_ip(const InstructionInfo* info, const int64_t* code) {
+  for (size_t i = 0; info->operands[i]; i++) {
+    if ((info->operands[i] == 'w' || info->operands[i] == 'm') && code[1 + i] == REG_IP)
+      return true;
+  }
+
+  return false;
+}
+
+void fvm_program_init(FVMProgram* program, const int64_t* instructions, size_t length) {
+  program->instructions = instructions;
+  program->length = length;
+  program->run_costs = malloc(sizeof(int64_t) * (length + 1));
+
+  if (!program->run_costs) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  /* addresses that are not the start of an instruction keep a cost of 1.
+   * running off the end costs one instruction as well: the unknown
+   * instruction error. */
+  for (size_t i = 0; i <= length; i++)
+    program->run_costs[i] = 1;
+
+  size_t* starts = malloc(sizeof(size_t) * (length + 1));
+  size_t starts_len = 0;
+  program->fibers = false;
 
-  vm->instructions = instructions;
+  if (!starts) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t address = 0; address < length;) {
+    const InstructionInfo* info = instruction_info(instructions[address]);
+
+    if (!info)
+      break;
+
+    starts[starts_len++] = address;
+
+    if (instructions[address] == INS_SPAWN)
+      program->fibers = true;
+
+    address += instruction_length(info, &instructions[address], length - address);
+  }
+
+  for (size_t i = starts_len; i-- > 0;) {
+    size_t address = starts[i];
+    const InstructionInfo* info = instruction_info(instructions[address]);
+    size_t next = address + instruction_length(info, &instructions[address], length - address);
+
+    if (!info->branch && next < length && !writes_ip(info, &instructions[address]))
+      program->run_costs[address] = 1 + program->run_costs[next];
+  }
+
+  free(starts);
+
+  const unsigned char* bytes = (const unsigned char*)instructions;
+  program->hash = 14695981039346656037ull;
+
+  for (size_t i = 0; i < length * sizeof(int64_t); i++) {
+    program->hash ^= bytes[i];
+    program->hash *= 1099511628211ull;
+  }
+
+  program->verified = fvm_verify(program, NULL);
+}
+
+void fvm_program_deinit(FVMProgram* program) {
+  free(program->run_costs);
+  program->run_costs = NULL;
+}
+
+void fvm_init(FVM* vm, const FVMProgram* program, size_t stack_size) {
+  vm->running = program->length > 0;
+  vm->program = program;
+  vm->instructions = program->instructions;
+  vm->budget = 0;
 
   for (int i = 0; i < REG_SIZE; i++)
     vm->registers[i] = 0;
 
+  for (int i = 0; i < FLAG_SIZE; i++)
+    vm->flags[i] = false;
+
   vm->registers[REG_SP] = -1;
+  vm->registers[REG_FP] = -1;
+  vm->call_sp = -1;
+  vm->call_capacity = 0;
+  vm->call_stack = NULL;
+  vm->vectors = NULL;
+  vm->shared = NULL;
+  vm->heap = NULL;
+  vm->scheduler = NULL;
+  vm->fiber = 0;
+  vm->joining = -1;
+  vm->channels = NULL;
+  vm->channel = NULL;
+  vm->sending = false;
+  vm->blocked = false;
+  vm->next_waiter = NULL;
+
+  fvm_stack_init(&vm->stack, stack_size);
+  fvm_output_init(&vm->output, STDOUT_FILENO);
+  fvm_input_init(&vm->input, STDIN_FILENO);
+}
+
+void fvm_redirect(FVM* vm, int input_fd, int output_fd) {
+  fvm_output_deinit(&vm->output);
+  fvm_input_deinit(&vm->input);
+  fvm_output_init(&vm->output, output_fd);
+  fvm_input_init(&vm->input, input_fd);
+}
+
+void fvm_deinit(FVM* vm) {
+  fvm_output_deinit(&vm->output);
+  fvm_input_deinit(&vm->input);
+  fvm_stack_deinit(&vm->stack);
+  free(vm->call_stack);
+  free(vm->vectors);
+  vm->call_stack = NULL;
+  vm->vectors = NULL;
+  fvm_shared_attach(vm, NULL);
+  fvm_channels_attach(vm, NULL);
+
+  if (vm->heap) {
+    fvm_heap_deinit(vm->heap);
+    free(vm->heap);
+    vm->heap = NULL;
+  }
 }
@@ -4,14 +4,106 @@
 #include <stdbool.h>
 
 #include "fvm_cpu.h"
+#include "fvm_heap.h"
+#include "fvm_io.h"
+#include "fvm_stack.h"
 
+typedef struct FVMProgram {
+  const int64_t* instructions;
+  size_t length;
+  /* for each address, the number of instructions from there up to and
+   * including the next branch. fvm_run_for charges a whole run at once. */
+  int64_t* run_costs;
+  /* set by fvm_program_init when fvm_verify accepts the program. */
+  bool verified;
+  /* set when the program contains spawn, it has to run under fvm_schedule. */
+  bool fibers;
+  /* FNV-1a of the instructions, to tell programs apart. */
+  uint64_t hash;
+} FVMProgram;
+
+typedef enum FVMStatus {
+  FVM_HALTED,
+  FVM_PREEMPTED,
+  /* waiting on something only another vm can provide, see vm->joining and
+   * vm->channel. */
+  FVM_BLOCKED,
+} FVMStatus;
+
+typedef struct FVMScheduler FVMScheduler;
+struct FVMChannel;
+struct FVMChannels;
+struct FVMShared;
+
+typedef int64_t FVMVector[VECTOR_LANES];
+
+/* everything eval touches on every instruction comes first. the rest is
+ * allocated on first use, so a vm that has not run yet takes a few hundred
+ * bytes: the call stack grows on demand, the vector registers and the heap
+ * appear with the first instruction that uses them and the stack is mapped
+ * on the first run. */
 typedef struct FVM {
+  int64_t registers[REG_SIZE];
+  bool flags[FLAG_SIZE];
   bool running;
+  int64_t budget;
   const int64_t* instructions;
-  int64_t registers[REG_SIZE];
-  int64_t flags[FLAG_SIZE];
-  int64_t stack[STACK_SIZE];
+  const FVMProgram* program;
+  int64_t call_sp;
+  int64_t call_capacity;
+  int64_t* call_stack;
+  FVMVector* vectors;
+  /* the region sload, sstore and the atomics work on, see fvm_shared.h. */
+  struct FVMShared* shared;
+  FVMHeap* heap;
+  /* set while the vm runs as a fiber, see fvm_sched.h. */
+  FVMScheduler* scheduler;
+  int64_t fiber;
+  int64_t joining;
+  /* the channels chan, send and recv work on, see fvm_channel.h. */
+  struct FVMChannels* channels;
+  /* the channel a blocked fiber waits on instead. */
+  struct FVMChannel* channel;
+  bool sending;
+  bool blocked;
+  struct FVM* next_waiter;
+  FVMStack stack;
+  FVMOutput output;
+  FVMInput input;
 } FVM;
 
-void fvm_init(FVM* vm, const int64_t* instructions);
-void fvm_execute(FVM* vm);
+void fvm_program_init(FVMProgram* program, const int64_t* instructions, size_t length);
+void fvm_program_deinit(FVMProgram* program);
+
+/* stack_size is the maximum stack size in cells, 0 picks STACK_SIZE. the
+ * program must outlive the vm. */
+void fvm_init(FVM* vm, const FVMProgram* program, size_t stack_size);
+void fvm_deinit(FVM* vm);
+
+/* points the vm's input and output, stdin and stdout by default, at other
+ * file descriptors. pending output is flushed first. */
+void fvm_redirect(FVM* vm, int input_fd, int output_fd);
+
+/* runs the vm until it halts, returns the number of instructions executed. */
+int64_t fvm_execute(FVM* vm);
+
+/* the REGISTERS: line fvm prints once the program halted. */
+void fvm_print_registers(const FVM* vm);
+
+/* the vector registers, allocated on first use. */
+FVMVector* fvm_vectors(FVM* vm);
+
+/* the heap, set up by the first alloc. */
+FVMHeap* fvm_heap(FVM* vm);
+
+/* the channels, a set of the vm's own made on first use unless the host
+ * attached one. */
+struct FVMChannels* fvm_channels(FVM* vm);
+
+/* makes room for size entries on the call stack, up to CALL_STACK_SIZE. */
+void fvm_reserve_calls(FVM* vm, int64_t size);
+
+/* executes at most budget instructions. returns FVM_PREEMPTED when the
+ * budget ran out before halt or a fiber yielded, FVM_BLOCKED when a fiber
+ * waits in join or on a channel; calling it again resumes where it stopped. */
+FVMStatus fvm_run_for(FVM* vm, int64_t budget);
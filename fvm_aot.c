@@ -0,0 +1,745 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "fvm_cpu.h"
+#include "fvm_native.h"
+#include "fvm_parser.h"
+
+/* fvm-aot translates an assembled program into a C file, one C label per
+ * label and straight gotos for jumps, and builds it with the C compiler.
+ * the result prints the same output and the same final registers as
+ * running the program with fvm. */
+
+static FILE* g_out;
+static const int64_t* g_instructions;
+static size_t g_length;
+static cvector_vector_type(ParsedLabel) g_labels;
+
+static void emit(const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vfprintf(g_out, format, args);
+  va_end(args);
+}
+
+/* the parser keeps duplicate labels around, jumps go to the first one. */
+static bool is_first_label(ParsedLabel* label) {
+  for (ParsedLabel* it = cvector_begin(g_labels); it != label; ++it) {
+    if (strcmp(it->name, label->name) == 0)
+      return false;
+  }
+
+  return true;
+}
+
+static const char* label_at(int64_t address) {
+  for (ParsedLabel* it = cvector_begin(g_labels); it != cvector_end(g_labels); ++it) {
+    if (it->address == address && is_first_label(it))
+      return it->name;
+  }
+
+  return NULL;
+}
+
+/* reading IP gives the address of the instruction's last operand, that is
+ * where the interpreter's IP points when it reads its registers. */
+static void emit_read(int64_t reg, size_t address, size_t length) {
+  if (reg == REG_IP)
+    emit("(int64_t)%zu", address + length - 1);
+  else
+    emit("reg_%s", register_name(reg));
+}
+
+/* writing IP is a jump to one past the written value, since the
+ * interpreter still advances IP after the write. */
+static void emit_write_begin(int64_t reg) {
+  if (reg == REG_IP)
+    emit("  target = 1 + (");
+  else
+    emit("  reg_%s = (", register_name(reg));
+}
+
+static void emit_write_end(int64_t reg) {
+  if (reg == REG_IP)
+    emit("); goto dispatch;\n");
+  else
+    emit(");\n");
+}
+
+static void emit_jump(int64_t target) {
+  const char* label = label_at(target);
+
+  if (label)
+    emit("goto fvm_%s;", label);
+  else
+    emit("{ target = %ld; goto dispatch; }", target);
+}
+
+static void emit_arithmetic(const int64_t* operands, const char* op, bool immediate, size_t address, size_t length) {
+  emit_write_begin(operands[0]);
+  emit_read(operands[0], address, length);
+  emit(" %s ", op);
+
+  if (immediate)
+    emit("(int64_t)%ld", operands[1]);
+  else
+    emit_read(operands[1], address, length);
+
+  emit_write_end(operands[0]);
+}
+
+static void emit_arithmetic3(const int64_t* operands, const char* op, bool immediate, size_t address, size_t length) {
+  emit_write_begin(operands[0]);
+  emit_read(operands[1], address, length);
+  emit(" %s ", op);
+
+  if (immediate)
+    emit("(int64_t)%ld", operands[2]);
+  else
+    emit_read(operands[2], address, length);
+
+  emit_write_end(operands[0]);
+}
+
+static void emit_fused_branch(const int64_t* operands, const char* op, bool immediate, size_t address,
+                              size_t length) {
+  emit("  if (");
+  emit_read(operands[0], address, length);
+  emit(" %s ", op);
+
+  if (immediate)
+    emit("(int64_t)%ld", operands[1]);
+  else
+    emit_read(operands[1], address, length);
+
+  emit(") ");
+  emit_jump(operands[2]);
+  emit("\n");
+}
+
+/* an index outside of the table matches no case and falls through. */
+static void emit_jump_table(const int64_t* operands, size_t address, size_t length) {
+  emit("  switch (");
+  emit_read(operands[0], address, length);
+  emit(") {\n");
+
+  for (int64_t i = 0; i < operands[1]; i++) {
+    emit("  case %ld: ", i);
+    emit_jump(operands[2 + i]);
+    emit("\n");
+  }
+
+  emit("  }\n");
+}
+
+static void emit_compare(const int64_t* operands, bool immediate, size_t address, size_t length) {
+  const char* ops[] = { "==", ">", "<" };
+  const char* flags[] = { "flag_eq", "flag_gt", "flag_lt" };
+
+  for (int i = 0; i < 3; i++) {
+    emit("  %s = ", flags[i]);
+    emit_read(operands[0], address, length);
+    emit(" %s ", ops[i]);
+
+    if (immediate)
+      emit("(int64_t)%ld", operands[1]);
+    else
+      emit_read(operands[1], address, length);
+
+    emit(";\n");
+  }
+}
+
+static const char* branch_condition(int64_t instruction) {
+  switch (instruction) {
+  case INS_JE:
+  case INS_JEI:
+    return "flag_eq";
+  case INS_JNE:
+  case INS_JNEI:
+    return "!flag_eq";
+  case INS_JG:
+  case INS_JGI:
+    return "flag_gt";
+  case INS_JL:
+  case INS_JLI:
+    return "flag_lt";
+  case INS_JGE:
+  case INS_JGEI:
+    return "flag_gt || flag_eq";
+  case INS_JLE:
+  case INS_JLEI:
+    return "flag_lt || flag_eq";
+  default:
+    return "1";
+  }
+}
+
+static void emit_instruction(size_t address) {
+  int64_t instruction = g_instructions[address];
+  const InstructionInfo* info = instruction_info(instruction);
+  const int64_t* operands = g_instructions + address + 1;
+  size_t length = instruction_length(info, &g_instructions[address], g_length - address);
+
+  switch (instruction) {
+  case INS_HALT:
+    emit("  halt(");
+
+    for (int64_t i = 0; i < REG_SIZE; i++) {
+      emit(i ? ", " : "");
+      emit_read(i, address, 1);
+    }
+
+    emit("); return 0;\n");
+    break;
+  case INS_PUSH:
+    emit("  { int64_t value = ");
+    emit_read(operands[0], address, length);
+    emit("; reg_SP += 1; stack[reg_SP] = value; }\n");
+    break;
+  case INS_PUSHI:
+    emit("  reg_SP += 1; stack[reg_SP] = (int64_t)%ld;\n", operands[0]);
+    break;
+  case INS_POP:
+    if (operands[0] == REG_IP) {
+      emit("  target = 1 + stack[reg_SP]; reg_SP -= 1; goto dispatch;\n");
+    } else {
+      emit("  reg_%s = stack[reg_SP]; reg_SP -= 1;\n", register_name(operands[0]));
+    }
+    break;
+  case INS_MOV:
+    emit_write_begin(operands[0]);
+    emit_read(operands[1], address, length);
+    emit_write_end(operands[0]);
+    break;
+  case INS_MOVI:
+    emit_write_begin(operands[0]);
+    emit("(int64_t)%ld", operands[1]);
+    emit_write_end(operands[0]);
+    break;
+  case INS_ADD:
+  case INS_ADDI:
+    emit_arithmetic(operands, "+", instruction == INS_ADDI, address, length);
+    break;
+  case INS_SUB:
+  case INS_SUBI:
+    emit_arithmetic(operands, "-", instruction == INS_SUBI, address, length);
+    break;
+  case INS_MUL:
+  case INS_MULI:
+    emit_arithmetic(operands, "*", instruction == INS_MULI, address, length);
+    break;
+  case INS_DIV:
+  case INS_DIVI:
+    emit_arithmetic(operands, "/", instruction == INS_DIVI, address, length);
+    break;
+  case INS_ADD3:
+  case INS_ADD3I:
+    emit_arithmetic3(operands, "+", instruction == INS_ADD3I, address, length);
+    break;
+  case INS_SUB3:
+  case INS_SUB3I:
+    emit_arithmetic3(operands, "-", instruction == INS_SUB3I, address, length);
+    break;
+  case INS_MUL3:
+  case INS_MUL3I:
+    emit_arithmetic3(operands, "*", instruction == INS_MUL3I, address, length);
+    break;
+  case INS_DIV3:
+  case INS_DIV3I:
+    emit_arithmetic3(operands, "/", instruction == INS_DIV3I, address, length);
+    break;
+  case INS_JE3:
+  case INS_JE3I:
+    emit_fused_branch(operands, "==", instruction == INS_JE3I, address, length);
+    break;
+  case INS_JNE3:
+  case INS_JNE3I:
+    emit_fused_branch(operands, "!=", instruction == INS_JNE3I, address, length);
+    break;
+  case INS_JG3:
+  case INS_JG3I:
+    emit_fused_branch(operands, ">", instruction == INS_JG3I, address, length);
+    break;
+  case INS_JL3:
+  case INS_JL3I:
+    emit_fused_branch(operands, "<", instruction == INS_JL3I, address, length);
+    break;
+  case INS_JGE3:
+  case INS_JGE3I:
+    emit_fused_branch(operands, ">=", instruction == INS_JGE3I, address, length);
+    break;
+  case INS_JLE3:
+  case INS_JLE3I:
+    emit_fused_branch(operands, "<=", instruction == INS_JLE3I, address, length);
+    break;
+  case INS_JTAB:
+    emit_jump_table(operands, address, length);
+    break;
+  case INS_CMP:
+  case INS_CMPI:
+    emit_compare(operands, instruction == INS_CMPI, address, length);
+    break;
+  case INS_JMP:
+  case INS_JE:
+  case INS_JNE:
+  case INS_JG:
+  case INS_JL:
+  case INS_JGE:
+  case INS_JLE:
+    emit("  if (%s) { target = ", branch_condition(instruction));
+    emit_read(operands[0], address, length);
+    emit("; goto dispatch; }\n");
+    break;
+  case INS_JMPI:
+  case INS_JEI:
+  case INS_JNEI:
+  case INS_JGI:
+  case INS_JLI:
+  case INS_JGEI:
+  case INS_JLEI:
+    emit("  if (%s) ", branch_condition(instruction));
+    emit_jump(operands[0]);
+    emit("\n");
+    break;
+  case INS_CALL:
+    emit("  call_push(%zu); target = ", address + 2);
+    emit_read(operands[0], address, length);
+    emit("; goto dispatch;\n");
+    break;
+  case INS_CALLI:
+    emit("  call_push(%zu); ", address + 2);
+    emit_jump(operands[0]);
+    emit("\n");
+    break;
+  case INS_RET:
+    emit("  target = call_pop(); goto dispatch;\n");
+    break;
+  case INS_ENTER:
+    emit("  call_push(reg_FP); reg_FP = reg_SP; reg_SP += (int64_t)%ld;\n", operands[0]);
+    break;
+  case INS_LEAVE:
+    emit("  reg_SP = reg_FP; reg_FP = call_pop();\n");
+    break;
+  case INS_LOAD:
+    emit_write_begin(operands[0]);
+    emit("stack[reg_FP + (int64_t)%ld]", operands[1]);
+    emit_write_end(operands[0]);
+    break;
+  case INS_STORE:
+    emit("  stack[reg_FP + (int64_t)%ld] = ", operands[0]);
+    emit_read(operands[1], address, length);
+    emit(";\n");
+    break;
+  case INS_PUTC:
+    emit("  put_byte((char)");
+    emit_read(operands[0], address, length);
+    emit(");\n");
+    break;
+  case INS_PUTCI:
+    emit("  put_byte((char)%ld);\n", operands[0]);
+    break;
+  case INS_PUTI:
+    emit("  put_int(");
+    emit_read(operands[0], address, length);
+    emit(");\n");
+    break;
+  case INS_PUTII:
+    emit("  put_int((int64_t)%ld);\n", operands[0]);
+    break;
+  case INS_WRITE:
+    emit("  for (int64_t i = 0; i < ");
+    emit_read(operands[1], address, length);
+    emit("; i++) put_byte((char)stack[");
+    emit_read(operands[0], address, length);
+    emit(" + i]);\n");
+    break;
+  case INS_READ:
+    emit_write_begin(operands[0]);
+    emit("get_byte()");
+    emit_write_end(operands[0]);
+    break;
+  case INS_VLOAD:
+    emit("  memcpy(vec[%ld], &stack[", operands[0]);
+    emit_read(operands[1], address, length);
+    emit("], sizeof(vec[0]));\n");
+    break;
+  case INS_VSTORE:
+    emit("  memcpy(&stack[");
+    emit_read(operands[0], address, length);
+    emit("], vec[%ld], sizeof(vec[0]));\n", operands[1]);
+    break;
+  case INS_VADD:
+  case INS_VSUB:
+  case INS_VMUL:
+    emit("  for (int i = 0; i < %d; i++) vec[%ld][i] = (int64_t)((uint64_t)vec[%ld][i] %s (uint64_t)vec[%ld][i]);\n",
+         VECTOR_LANES, operands[0], operands[0],
+         instruction == INS_VADD ? "+" : instruction == INS_VSUB ? "-" : "*", operands[1]);
+    break;
+  case INS_VCMP:
+    emit("  for (int i = 0; i < %d; i++) vec[%ld][i] = vec[%ld][i] == vec[%ld][i] ? -1 : 0;\n",
+         VECTOR_LANES, operands[0], operands[0], operands[1]);
+    break;
+  case INS_VSUM:
+    emit_write_begin(operands[0]);
+    emit("(int64_t)(");
+
+    for (int i = 0; i < VECTOR_LANES; i++)
+      emit("%s(uint64_t)vec[%ld][%d]", i ? " + " : "", operands[1], i);
+
+    emit(")");
+    emit_write_end(operands[0]);
+    break;
+  case INS_MCOPY:
+  case INS_MFILL:
+  case INS_MCMP:
+    emit("  { int64_t len = ");
+    emit_read(operands[2], address, length);
+    emit("; int64_t* a = mem_range(");
+    emit_read(operands[0], address, length);
+
+    if (instruction == INS_MFILL) {
+      emit(", len); int64_t value = ");
+      emit_read(operands[1], address, length);
+      emit("; for (int64_t i = 0; i < len; i++) a[i] = value; }\n");
+      break;
+    }
+
+    emit(", len); int64_t* b = mem_range(");
+    emit_read(operands[1], address, length);
+
+    if (instruction == INS_MCOPY) {
+      emit(", len); memmove(a, b, sizeof(int64_t) * len); }\n");
+    } else {
+      emit(", len); int64_t i = mem_compare(a, b, len); flag_eq = i == len;"
+           " flag_gt = i < len && a[i] > b[i]; flag_lt = i < len && a[i] < b[i]; }\n");
+    }
+    break;
+  default:
+    fprintf(stderr, "ERROR: cannot compile instruction '%s' at address %zu\n", info->name, address);
+    exit(1);
+  }
+}
+
+static const char* g_runtime =
+  "#include <signal.h>\n"
+  "#include <stdint.h>\n"
+  "#include <stdio.h>\n"
+  "#include <string.h>\n"
+  "#include <sys/mman.h>\n"
+  "#include <unistd.h>\n"
+  "\n"
+  "static int64_t* stack;\n"
+  "static size_t stack_bytes;\n"
+  "static size_t page_size;\n"
+  "static int64_t call_stack[CALL_STACK_SIZE];\n"
+  "static int64_t call_sp = -1;\n"
+  "static char output[65536];\n"
+  "static size_t output_len;\n"
+  "static char input[4096];\n"
+  "static size_t input_position, input_len;\n"
+  "\n"
+  "static void die(const char* message) {\n"
+  "  write(STDERR_FILENO, message, strlen(message));\n"
+  "  _exit(1);\n"
+  "}\n"
+  "\n"
+  "static void on_fault(int signal, siginfo_t* info, void* context) {\n"
+  "  char* address = info->si_addr;\n"
+  "  char* base = (char*)stack;\n"
+  "  (void)signal;\n"
+  "  (void)context;\n"
+  "\n"
+  "  if (address >= base + stack_bytes && address < base + stack_bytes + page_size)\n"
+  "    die(\"ERROR: stack overflow!\\n\");\n"
+  "\n"
+  "  if (address >= base - page_size && address < base)\n"
+  "    die(\"ERROR: stack underflow!\\n\");\n"
+  "\n"
+  "  die(\"ERROR: segmentation fault!\\n\");\n"
+  "}\n"
+  "\n"
+  "static void stack_init(void) {\n"
+  "  struct sigaction action;\n"
+  "  memset(&action, 0, sizeof(action));\n"
+  "  action.sa_sigaction = on_fault;\n"
+  "  action.sa_flags = SA_SIGINFO;\n"
+  "  sigaction(SIGSEGV, &action, NULL);\n"
+  "\n"
+  "  page_size = (size_t)sysconf(_SC_PAGESIZE);\n"
+  "  stack_bytes = (STACK_SIZE * sizeof(int64_t) + page_size - 1) & ~(page_size - 1);\n"
+  "\n"
+  "  char* mapping = mmap(NULL, stack_bytes + 2 * page_size, PROT_NONE,\n"
+  "                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);\n"
+  "\n"
+  "  if (mapping == MAP_FAILED || mprotect(mapping + page_size, stack_bytes, PROT_READ | PROT_WRITE) != 0)\n"
+  "    die(\"ERROR: cannot map the stack!\\n\");\n"
+  "\n"
+  "  stack = (int64_t*)(mapping + page_size);\n"
+  "}\n"
+  "\n"
+  "static void flush(void) {\n"
+  "  for (size_t written = 0; written < output_len;) {\n"
+  "    ssize_t n = write(STDOUT_FILENO, output + written, output_len - written);\n"
+  "\n"
+  "    if (n < 0)\n"
+  "      die(\"ERROR: cannot write output!\\n\");\n"
+  "\n"
+  "    written += (size_t)n;\n"
+  "  }\n"
+  "\n"
+  "  output_len = 0;\n"
+  "}\n"
+  "\n"
+  "static void put_byte(char byte) {\n"
+  "  if (output_len == sizeof(output))\n"
+  "    flush();\n"
+  "\n"
+  "  output[output_len++] = byte;\n"
+  "}\n"
+  "\n"
+  "static void put_int(int64_t value) {\n"
+  "  char digits[20];\n"
+  "  int length = 0;\n"
+  "  uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;\n"
+  "\n"
+  "  do {\n"
+  "    digits[length++] = (char)('0' + magnitude % 10);\n"
+  "    magnitude /= 10;\n"
+  "  } while (magnitude);\n"
+  "\n"
+  "  if (value < 0)\n"
+  "    put_byte('-');\n"
+  "\n"
+  "  while (length > 0)\n"
+  "    put_byte(digits[--length]);\n"
+  "}\n"
+  "\n"
+  "static int64_t get_byte(void) {\n"
+  "  if (input_position == input_len) {\n"
+  "    flush();\n"
+  "\n"
+  "    ssize_t n = read(STDIN_FILENO, input, sizeof(input));\n"
+  "\n"
+  "    if (n <= 0)\n"
+  "      return -1;\n"
+  "\n"
+  "    input_position = 0;\n"
+  "    input_len = (size_t)n;\n"
+  "  }\n"
+  "\n"
+  "  return (unsigned char)input[input_position++];\n"
+  "}\n"
+  "\n"
+  "static void call_push(int64_t value) {\n"
+  "  if (call_sp + 1 >= CALL_STACK_SIZE)\n"
+  "    die(\"ERROR: call stack overflow!\\n\");\n"
+  "\n"
+  "  call_stack[++call_sp] = value;\n"
+  "}\n"
+  "\n"
+  "static int64_t call_pop(void) {\n"
+  "  if (call_sp < 0)\n"
+  "    die(\"ERROR: call stack underflow!\\n\");\n"
+  "\n"
+  "  return call_stack[call_sp--];\n"
+  "}\n"
+  "\n"
+  "static int64_t* mem_range(int64_t start, int64_t len) {\n"
+  "  if (start < 0 || len < 0 || start > STACK_SIZE || len > STACK_SIZE - start)\n"
+  "    die(\"ERROR: memory access out of bounds!\\n\");\n"
+  "\n"
+  "  return stack + start;\n"
+  "}\n"
+  "\n"
+  "static int64_t mem_compare(const int64_t* a, const int64_t* b, int64_t len) {\n"
+  "  int64_t i = 0;\n"
+  "\n"
+  "  while (i < len && a[i] == b[i])\n"
+  "    i += 1;\n"
+  "\n"
+  "  return i;\n"
+  "}\n"
+  "\n";
+
+static void emit_program(const char* source) {
+  bool* starts = calloc(g_length + 1, sizeof(bool));
+
+  if (!starts) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t address = 0; address < g_length;) {
+    const InstructionInfo* info = instruction_info(g_instructions[address]);
+
+    if (!info || instruction_length(info, &g_instructions[address], g_length - address) > g_length - address) {
+      fprintf(stderr, "ERROR: invalid instruction at address %zu\n", address);
+      exit(1);
+    }
+
+    starts[address] = true;
+    address += instruction_length(info, &g_instructions[address], g_length - address);
+  }
+
+  emit("/* generated by fvm-aot from %s */\n", source);
+  emit("#define STACK_SIZE %ld\n", (int64_t)STACK_SIZE);
+  emit("#define CALL_STACK_SIZE %ld\n\n", (int64_t)CALL_STACK_SIZE);
+  emit("%s", g_runtime);
+
+  emit("static void halt(");
+
+  for (int64_t i = 0; i < REG_SIZE; i++)
+    emit("%sint64_t reg_%s", i ? ", " : "", register_name(i));
+
+  emit(") {\n  flush();\n  printf(\"REGISTERS: ");
+
+  for (int64_t i = 0; i < REG_SIZE; i++)
+    emit("[%%ld] ");
+
+  emit("\\n\"");
+
+  for (int64_t i = 0; i < REG_SIZE; i++)
+    emit(", (long)reg_%s", register_name(i));
+
+  emit(");\n}\n\n");
+
+  emit("int main(void) {\n");
+
+  for (int64_t i = 0; i < REG_SIZE; i++) {
+    if (i != REG_IP)
+      emit("  int64_t reg_%s = %d;\n", register_name(i), i == REG_SP || i == REG_FP ? -1 : 0);
+  }
+
+  emit("  int64_t flag_eq = 0, flag_gt = 0, flag_lt = 0;\n");
+  emit("  int64_t vec[%d][%d] = { 0 };\n", VREG_SIZE, VECTOR_LANES);
+  emit("  int64_t target = 0;\n\n");
+  emit("  stack_init();\n\n");
+
+  for (size_t address = 0; address < g_length;) {
+    const InstructionInfo* info = instruction_info(g_instructions[address]);
+
+    for (ParsedLabel* it = cvector_begin(g_labels); it != cvector_end(g_labels); ++it) {
+      if (it->address == (int64_t)address && is_first_label(it))
+        emit("fvm_%s:\n", it->name);
+    }
+
+    emit("L%zu:\n", address);
+    emit_instruction(address);
+    address += instruction_length(info, &g_instructions[address], g_length - address);
+  }
+
+  /* running off the end is the interpreter's unknown instruction error. */
+  emit("  die(\"ERROR: unknown instruction: 0\\n\");\n\n");
+
+  /* jumps through registers and returns land here. */
+  emit("dispatch:\n  switch (target) {\n");
+
+  for (size_t address = 0; address < g_length; address++) {
+    if (starts[address])
+      emit("  case %zu: goto L%zu;\n", address, address);
+  }
+
+  emit("  default: die(\"ERROR: invalid jump target!\\n\");\n  }\n\n");
+  emit("  return 0;\n}\n");
+
+  free(starts);
+}
+
+static int compile(const char* c_path, const char* output) {
+  const char* compiler = getenv("CC");
+
+  if (!compiler)
+    compiler = "clang";
+
+  pid_t pid = fork();
+
+  if (pid == -1) {
+    fprintf(stderr, "ERROR: cannot start the C compiler!\n");
+    return 1;
+  }
+
+  if (pid == 0) {
+    execlp(compiler, compiler, "-O2", "-o", output, c_path, (char*)NULL);
+    fprintf(stderr, "ERROR: cannot run the C compiler: '%s'\n", compiler);
+    _exit(1);
+  }
+
+  int status;
+
+  if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "ERROR: the C compiler failed\n");
+    return 1;
+  }
+
+  return 0;
+}
+
+static void usage(const char* program) {
+  fprintf(stderr, "usage: %s [-C] [-o output] file\n", program);
+}
+
+int main(int argc, char** argv) {
+  fvm_native_builtins();
+
+  const char* output = "a.out";
+  bool c_only = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "Co:")) != -1) {
+    switch (option) {
+    case 'C':
+      c_only = true;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind >= argc) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  cvector_vector_type(int64_t) instructions = assemble_file(argv[optind], &g_labels);
+  g_instructions = instructions;
+  g_length = cvector_size(instructions);
+
+  size_t c_path_len = strlen(output) + 3;
+  char* c_path = malloc(c_path_len);
+
+  if (!c_path) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    return 1;
+  }
+
+  snprintf(c_path, c_path_len, "%s%s", output, c_only ? "" : ".c");
+  g_out = fopen(c_path, "w");
+
+  if (!g_out) {
+    fprintf(stderr, "ERROR: cannot open: '%s'\n", c_path);
+    return 1;
+  }
+
+  emit_program(argv[optind]);
+  fclose(g_out);
+
+  int result = c_only ? 0 : compile(c_path, output);
+
+  if (!c_only)
+    unlink(c_path);
+
+  free(c_path);
+  labels_free(g_labels);
+  cvector_free(instructions);
+
+  return result;
+}
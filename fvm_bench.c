@@ -0,0 +1,300 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fvm.h"
+#include "fvm_channel.h"
+#include "fvm_parser.h"
+#include "fvm_perf.h"
+#include "fvm_sched.h"
+
+/* fvm-bench measures how fast messages get through channels. a pipeline of
+ * stages passes the numbers 1 to n along: a producer sends them, forwarders
+ * pass them on and a consumer adds them up. each stage is a vm, run once on
+ * a thread of its own and once as a fiber, with spsc and with mpmc
+ * channels between the stages. */
+
+/* B is the channel a stage receives from, C the one it sends to and D the
+ * number of messages. main spawns the stages over the channels C, C + 1 and
+ * so on, with F forwarders in between. */
+static const char* g_source =
+  "main:\n"
+  "  spawn producer\n"
+  "  mov B, C\n"
+  "  add C, 1\n"
+  "main_loop:\n"
+  "  cmp F, 0\n"
+  "  je main_last\n"
+  "  spawn forwarder\n"
+  "  mov B, C\n"
+  "  add C, 1\n"
+  "  sub F, 1\n"
+  "  jmp main_loop\n"
+  "main_last:\n"
+  "  spawn consumer\n"
+  "  join A\n"
+  "  halt\n"
+  "producer:\n"
+  "  mov A, 0\n"
+  "producer_loop:\n"
+  "  add A, 1\n"
+  "  send C, A\n"
+  "  cmp A, D\n"
+  "  jl producer_loop\n"
+  "  halt\n"
+  "forwarder:\n"
+  "  mov E, 0\n"
+  "forwarder_loop:\n"
+  "  recv A, B\n"
+  "  send C, A\n"
+  "  add E, 1\n"
+  "  cmp E, D\n"
+  "  jl forwarder_loop\n"
+  "  halt\n"
+  "consumer:\n"
+  "  mov E, 0\n"
+  "  mov F, 0\n"
+  "consumer_loop:\n"
+  "  recv A, B\n"
+  "  add F, A\n"
+  "  add E, 1\n"
+  "  cmp E, D\n"
+  "  jl consumer_loop\n"
+  "  mov A, F\n"
+  "  halt\n";
+
+typedef struct Options {
+  int64_t messages;
+  int64_t stages;
+  int64_t capacity;
+  size_t threads;
+  bool counters;
+} Options;
+
+typedef struct Stage {
+  pthread_t thread;
+  FVM vm;
+} Stage;
+
+static FVMProgram g_program;
+static cvector_vector_type(ParsedLabel) g_labels;
+
+static double now_seconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static int64_t label(const char* name) {
+  for (ParsedLabel* it = cvector_begin(g_labels); it != cvector_end(g_labels); ++it) {
+    if (strcmp(it->name, name) == 0)
+      return it->address;
+  }
+
+  fprintf(stderr, "ERROR: no label '%s' in the benchmark!\n", name);
+  exit(1);
+}
+
+/* the stages - 1 channels between the stages, with consecutive ids. returns
+ * the first. */
+static int64_t new_channels(FVMChannels* set, const Options* options, FVMChannelKind kind) {
+  int64_t first = -1;
+
+  for (int64_t i = 0; i < options->stages - 1; i++) {
+    int64_t id = fvm_channel_new(set, options->capacity, kind);
+
+    if (id == -1) {
+      fprintf(stderr, "ERROR: cannot create the channels!\n");
+      exit(1);
+    }
+
+    if (first == -1)
+      first = id;
+  }
+
+  return first;
+}
+
+static void* run_stage(void* arg) {
+  Stage* stage = arg;
+
+  while (fvm_run_for(&stage->vm, INT64_MAX) != FVM_HALTED)
+    ;
+
+  return NULL;
+}
+
+/* every stage on a thread of its own, blocking on the channels. */
+static int64_t run_threads(const Options* options, FVMChannelKind kind) {
+  FVMChannels* set = fvm_channels_new();
+  int64_t first = new_channels(set, options, kind);
+  Stage* stages = calloc(options->stages, sizeof(Stage));
+
+  if (!stages) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (int64_t i = 0; i < options->stages; i++) {
+    FVM* vm = &stages[i].vm;
+    fvm_init(vm, &g_program, 0);
+    fvm_channels_attach(vm, set);
+
+    const char* entry = i == 0 ? "producer" : i == options->stages - 1 ? "consumer" : "forwarder";
+    vm->registers[REG_IP] = label(entry);
+    vm->registers[REG_B] = first + i - 1;
+    vm->registers[REG_C] = first + i;
+    vm->registers[REG_D] = options->messages;
+
+    if (pthread_create(&stages[i].thread, NULL, run_stage, &stages[i]) != 0) {
+      fprintf(stderr, "ERROR: cannot start a stage thread!\n");
+      exit(1);
+    }
+  }
+
+  /* the stages hold on to the channels until they are done. */
+  fvm_channels_release(set);
+
+  for (int64_t i = 0; i < options->stages; i++)
+    pthread_join(stages[i].thread, NULL);
+
+  int64_t sum = stages[options->stages - 1].vm.registers[REG_A];
+
+  for (int64_t i = 0; i < options->stages; i++)
+    fvm_deinit(&stages[i].vm);
+
+  free(stages);
+
+  return sum;
+}
+
+/* every stage a fiber, parking on the channels. */
+static int64_t run_fibers(const Options* options, FVMChannelKind kind) {
+  FVM vm;
+  fvm_init(&vm, &g_program, 0);
+
+  vm.registers[REG_IP] = label("main");
+  vm.registers[REG_C] = new_channels(fvm_channels(&vm), options, kind);
+  vm.registers[REG_D] = options->messages;
+  vm.registers[REG_F] = options->stages - 2;
+
+  fvm_schedule(&vm, options->threads);
+
+  int64_t sum = vm.registers[REG_A];
+  fvm_deinit(&vm);
+
+  return sum;
+}
+
+static void report(const Options* options, const char* name, FVMChannelKind kind,
+                   int64_t (*run)(const Options*, FVMChannelKind)) {
+  FVMPerf perf;
+  bool counters = options->counters && fvm_perf_open(&perf);
+
+  if (counters)
+    fvm_perf_start(&perf);
+
+  double start = now_seconds();
+  int64_t sum = run(options, kind);
+  double seconds = now_seconds() - start;
+
+  if (counters)
+    fvm_perf_stop(&perf);
+
+  if (sum != options->messages * (options->messages + 1) / 2) {
+    fprintf(stderr, "ERROR: %s %s: the consumer got %ld!\n", name, kind == FVM_CHANNEL_SPSC ? "spsc" : "mpmc", sum);
+    exit(1);
+  }
+
+  /* every message crosses each of the stages - 1 channels once. */
+  double sent = (double)options->messages * (double)(options->stages - 1);
+
+  printf("%-8s %s: %8.3f s, %12.0f messages/s through the pipeline, %12.0f sends/s\n", name,
+         kind == FVM_CHANNEL_SPSC ? "spsc" : "mpmc", seconds, (double)options->messages / seconds, sent / seconds);
+
+  /* fibers don't count the instructions they execute, so the counters go
+   * per message, the same for all four. */
+  if (counters) {
+    fflush(stdout);
+    fvm_perf_print(&perf, (double)options->messages, "message");
+    fvm_perf_close(&perf);
+  }
+}
+
+static void usage(const char* program) {
+  fprintf(stderr, "usage: %s [-e] [-n messages] [-s stages] [-c capacity] [-t threads]\n", program);
+}
+
+int main(int argc, char** argv) {
+  Options options;
+  options.messages = 1000000;
+  options.stages = 4;
+  options.capacity = 1024;
+  options.threads = 0;
+  options.counters = false;
+
+  int option;
+
+  while ((option = getopt(argc, argv, "en:s:c:t:")) != -1) {
+    switch (option) {
+    case 'e':
+      options.counters = true;
+      break;
+    case 'n':
+      options.messages = strtoll(optarg, NULL, 10);
+      break;
+    case 's':
+      options.stages = strtoll(optarg, NULL, 10);
+      break;
+    case 'c':
+      options.capacity = strtoll(optarg, NULL, 10);
+      break;
+    case 't':
+      options.threads = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (options.messages < 1 || options.stages < 2) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  parser_init(g_source);
+  cvector_vector_type(ParsedInstruction) parsed = parser_parse();
+  g_labels = parser_labels();
+  parser_deinit();
+
+  cvector_vector_type(int64_t) instructions = instructions_codegen(parsed);
+  parsed_instructions_free(parsed);
+
+  fvm_program_init(&g_program, instructions, cvector_size(instructions));
+
+  printf("%ld messages through %ld stages, channels of %ld\n", options.messages, options.stages,
+         options.capacity);
+
+  if (options.counters) {
+    FVMPerf perf;
+
+    if (fvm_perf_open(&perf))
+      fvm_perf_close(&perf);
+    else
+      fprintf(stderr, "WARNING: no performance counters available, running without them\n");
+  }
+
+  report(&options, "threads", FVM_CHANNEL_SPSC, run_threads);
+  report(&options, "threads", FVM_CHANNEL_MPMC, run_threads);
+  report(&options, "fibers", FVM_CHANNEL_SPSC, run_fibers);
+  report(&options, "fibers", FVM_CHANNEL_MPMC, run_fibers);
+
+  fvm_program_deinit(&g_program);
+  labels_free(g_labels);
+  cvector_free(instructions);
+}
@@ -0,0 +1,381 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fvm_channel.h"
+#include "fvm_sched.h"
+
+/* keeps the indices the senders write, the ones the receivers write and
+ * the rest apart, so the two sides don't fight over a cache line. */
+#define CACHE_LINE 64
+
+/* an mpmc slot. its sequence says whose turn it is: the sender of message
+ * number i may fill the slot while it is i, the receiver may empty it once
+ * it is i + 1, after which it becomes i + capacity for the next round. */
+typedef struct Cell {
+  atomic_size_t sequence;
+  int64_t value;
+} Cell;
+
+/* whoever is waiting on one side of a channel. count is what the other side
+ * looks at without taking the lock to see whether it has to wake anyone. */
+typedef struct Waiters {
+  atomic_size_t count;
+  pthread_cond_t ready;
+  /* parked fibers, oldest first, linked through next_waiter. */
+  FVM* first;
+  FVM* last;
+} Waiters;
+
+struct FVMChannel {
+  /* messages ever sent, written by the senders. */
+  _Alignas(CACHE_LINE) atomic_size_t head;
+  /* spsc: the sender's last look at tail. */
+  size_t tail_seen;
+  /* messages ever received, written by the receivers. */
+  _Alignas(CACHE_LINE) atomic_size_t tail;
+  /* spsc: the receiver's last look at head. */
+  size_t head_seen;
+  _Alignas(CACHE_LINE) FVMChannelKind kind;
+  size_t mask;
+  Cell* cells;
+  int64_t* values;
+  pthread_mutex_t lock;
+  Waiters senders;
+  Waiters receivers;
+};
+
+struct FVMChannels {
+  pthread_mutex_t lock;
+  /* channels by id, in chunks that never move. count is stored last when a
+   * channel is added, anything below it can be read without the lock. */
+  FVMChannel** chunks[CHANNEL_CHUNKS];
+  atomic_int_fast64_t count;
+  atomic_size_t references;
+};
+
+static void* checked(void* pointer) {
+  if (!pointer) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  return pointer;
+}
+
+static void waiters_init(Waiters* waiters) {
+  atomic_init(&waiters->count, 0);
+  pthread_cond_init(&waiters->ready, NULL);
+  waiters->first = NULL;
+  waiters->last = NULL;
+}
+
+FVMChannels* fvm_channels_new(void) {
+  FVMChannels* set = checked(calloc(1, sizeof(FVMChannels)));
+  pthread_mutex_init(&set->lock, NULL);
+  atomic_init(&set->count, 0);
+  atomic_init(&set->references, 1);
+
+  return set;
+}
+
+void fvm_channels_attach(FVM* vm, FVMChannels* set) {
+  if (set)
+    atomic_fetch_add_explicit(&set->references, 1, memory_order_relaxed);
+
+  if (vm->channels)
+    fvm_channels_release(vm->channels);
+
+  vm->channels = set;
+}
+
+static void channel_free(FVMChannel* channel) {
+  pthread_cond_destroy(&channel->senders.ready);
+  pthread_cond_destroy(&channel->receivers.ready);
+  pthread_mutex_destroy(&channel->lock);
+  free(channel->cells);
+  free(channel->values);
+  free(channel);
+}
+
+void fvm_channels_release(FVMChannels* set) {
+  /* whatever the other vms sent happens before the channels go away. */
+  if (atomic_fetch_sub_explicit(&set->references, 1, memory_order_acq_rel) != 1)
+    return;
+
+  int64_t count = atomic_load(&set->count);
+
+  for (int64_t id = 0; id < count; id++)
+    channel_free(set->chunks[id / CHANNEL_CHUNK][id % CHANNEL_CHUNK]);
+
+  for (size_t i = 0; i < CHANNEL_CHUNKS; i++)
+    free(set->chunks[i]);
+
+  pthread_mutex_destroy(&set->lock);
+  free(set);
+}
+
+bool fvm_channels_shared(FVMChannels* set) {
+  return atomic_load_explicit(&set->references, memory_order_acquire) > 1;
+}
+
+int64_t fvm_channel_new(FVMChannels* set, int64_t capacity, FVMChannelKind kind) {
+  if (capacity < 1 || capacity > CHANNEL_MAX_CAPACITY)
+    return -1;
+
+  /* an mpmc ring of one slot could not tell full from empty. */
+  size_t size = kind == FVM_CHANNEL_MPMC ? 2 : 1;
+
+  while ((int64_t)size < capacity)
+    size *= 2;
+
+  FVMChannel* channel = checked(aligned_alloc(CACHE_LINE, sizeof(FVMChannel)));
+  atomic_init(&channel->head, 0);
+  atomic_init(&channel->tail, 0);
+  channel->tail_seen = 0;
+  channel->head_seen = 0;
+  channel->kind = kind;
+  channel->mask = size - 1;
+  channel->cells = NULL;
+  channel->values = NULL;
+  pthread_mutex_init(&channel->lock, NULL);
+  waiters_init(&channel->senders);
+  waiters_init(&channel->receivers);
+
+  if (kind == FVM_CHANNEL_SPSC) {
+    channel->values = checked(malloc(sizeof(int64_t) * size));
+  } else {
+    channel->cells = checked(malloc(sizeof(Cell) * size));
+
+    for (size_t i = 0; i < size; i++)
+      atomic_init(&channel->cells[i].sequence, i);
+  }
+
+  pthread_mutex_lock(&set->lock);
+
+  int64_t id = atomic_load(&set->count);
+
+  if (id >= (int64_t)CHANNEL_CHUNK * CHANNEL_CHUNKS) {
+    pthread_mutex_unlock(&set->lock);
+    channel_free(channel);
+    return -1;
+  }
+
+  if (!set->chunks[id / CHANNEL_CHUNK])
+    set->chunks[id / CHANNEL_CHUNK] = checked(calloc(CHANNEL_CHUNK, sizeof(FVMChannel*)));
+
+  set->chunks[id / CHANNEL_CHUNK][id % CHANNEL_CHUNK] = channel;
+  atomic_store(&set->count, id + 1);
+
+  pthread_mutex_unlock(&set->lock);
+
+  return id;
+}
+
+FVMChannel* fvm_channel_get(FVMChannels* set, int64_t id) {
+  if (id < 0 || id >= atomic_load(&set->count))
+    return NULL;
+
+  return set->chunks[id / CHANNEL_CHUNK][id % CHANNEL_CHUNK];
+}
+
+static bool put(FVMChannel* channel, int64_t value) {
+  if (channel->kind == FVM_CHANNEL_SPSC) {
+    size_t head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+
+    /* tail is only read again once the ring looks full. */
+    if (head - channel->tail_seen > channel->mask) {
+      channel->tail_seen = atomic_load_explicit(&channel->tail, memory_order_acquire);
+
+      if (head - channel->tail_seen > channel->mask)
+        return false;
+    }
+
+    channel->values[head & channel->mask] = value;
+    atomic_store_explicit(&channel->head, head + 1, memory_order_release);
+    return true;
+  }
+
+  size_t head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+
+  for (;;) {
+    Cell* cell = &channel->cells[head & channel->mask];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t turn = (intptr_t)sequence - (intptr_t)head;
+
+    if (turn == 0) {
+      /* our turn: claim the slot, or try the next one if a sender beat us. */
+      if (atomic_compare_exchange_weak_explicit(&channel->head, &head, head + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        cell->value = value;
+        atomic_store_explicit(&cell->sequence, head + 1, memory_order_release);
+        return true;
+      }
+    } else if (turn < 0) {
+      /* the receiver of the previous round has not emptied it yet. */
+      return false;
+    } else {
+      head = atomic_load_explicit(&channel->head, memory_order_relaxed);
+    }
+  }
+}
+
+static bool take(FVMChannel* channel, int64_t* value) {
+  if (channel->kind == FVM_CHANNEL_SPSC) {
+    size_t tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+
+    if (tail == channel->head_seen) {
+      channel->head_seen = atomic_load_explicit(&channel->head, memory_order_acquire);
+
+      if (tail == channel->head_seen)
+        return false;
+    }
+
+    *value = channel->values[tail & channel->mask];
+    atomic_store_explicit(&channel->tail, tail + 1, memory_order_release);
+    return true;
+  }
+
+  size_t tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+
+  for (;;) {
+    Cell* cell = &channel->cells[tail & channel->mask];
+    size_t sequence = atomic_load_explicit(&cell->sequence, memory_order_acquire);
+    intptr_t turn = (intptr_t)sequence - (intptr_t)(tail + 1);
+
+    if (turn == 0) {
+      if (atomic_compare_exchange_weak_explicit(&channel->tail, &tail, tail + 1, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+        *value = cell->value;
+        atomic_store_explicit(&cell->sequence, tail + channel->mask + 1, memory_order_release);
+        return true;
+      }
+    } else if (turn < 0) {
+      /* nothing sent into this slot yet. */
+      return false;
+    } else {
+      tail = atomic_load_explicit(&channel->tail, memory_order_relaxed);
+    }
+  }
+}
+
+/* a conservative look for parking: true whenever the operation might
+ * succeed now, a slot claimed but not yet filled or emptied counts. tail is
+ * read last and may have passed the head we saw. */
+static bool might_succeed(FVMChannel* channel, bool sending) {
+  size_t head = atomic_load(&channel->head);
+  size_t tail = atomic_load(&channel->tail);
+
+  return sending ? (intptr_t)(head - tail) <= (intptr_t)channel->mask : head != tail;
+}
+
+/* called after a send or recv succeeded, with the waiters of the other side.
+ * the fence pairs with the one in the increment of count by a waiter: either
+ * we see it is there, or it sees what we just did before it goes to sleep. */
+static void wake(FVMChannel* channel, Waiters* waiters) {
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if (atomic_load_explicit(&waiters->count, memory_order_relaxed) == 0)
+    return;
+
+  pthread_mutex_lock(&channel->lock);
+
+  FVM* fiber = waiters->first;
+
+  if (fiber) {
+    waiters->first = fiber->next_waiter;
+
+    if (!waiters->first)
+      waiters->last = NULL;
+
+    atomic_fetch_sub(&waiters->count, 1);
+  } else {
+    pthread_cond_signal(&waiters->ready);
+  }
+
+  pthread_mutex_unlock(&channel->lock);
+
+  if (fiber)
+    fvm_sched_wake(fiber);
+}
+
+bool fvm_channel_try_send(FVMChannel* channel, int64_t value) {
+  if (!put(channel, value))
+    return false;
+
+  wake(channel, &channel->receivers);
+  return true;
+}
+
+bool fvm_channel_try_recv(FVMChannel* channel, int64_t* value) {
+  if (!take(channel, value))
+    return false;
+
+  wake(channel, &channel->senders);
+  return true;
+}
+
+void fvm_channel_send(FVMChannel* channel, int64_t value) {
+  if (fvm_channel_try_send(channel, value))
+    return;
+
+  pthread_mutex_lock(&channel->lock);
+  atomic_fetch_add(&channel->senders.count, 1);
+
+  while (!put(channel, value))
+    pthread_cond_wait(&channel->senders.ready, &channel->lock);
+
+  atomic_fetch_sub(&channel->senders.count, 1);
+  pthread_mutex_unlock(&channel->lock);
+
+  wake(channel, &channel->receivers);
+}
+
+int64_t fvm_channel_recv(FVMChannel* channel) {
+  int64_t value;
+
+  if (fvm_channel_try_recv(channel, &value))
+    return value;
+
+  pthread_mutex_lock(&channel->lock);
+  atomic_fetch_add(&channel->receivers.count, 1);
+
+  while (!take(channel, &value))
+    pthread_cond_wait(&channel->receivers.ready, &channel->lock);
+
+  atomic_fetch_sub(&channel->receivers.count, 1);
+  pthread_mutex_unlock(&channel->lock);
+
+  wake(channel, &channel->senders);
+
+  return value;
+}
+
+bool fvm_channel_park(FVM* vm) {
+  FVMChannel* channel = vm->channel;
+  Waiters* waiters = vm->sending ? &channel->senders : &channel->receivers;
+
+  pthread_mutex_lock(&channel->lock);
+  atomic_fetch_add(&waiters->count, 1);
+
+  /* the other side may have made room or sent while we were stopping. */
+  if (might_succeed(channel, vm->sending)) {
+    atomic_fetch_sub(&waiters->count, 1);
+    pthread_mutex_unlock(&channel->lock);
+    return false;
+  }
+
+  vm->next_waiter = NULL;
+
+  if (waiters->last)
+    waiters->last->next_waiter = vm;
+  else
+    waiters->first = vm;
+
+  waiters->last = vm;
+
+  pthread_mutex_unlock(&channel->lock);
+
+  return true;
+}
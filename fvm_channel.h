@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fvm.h"
+
+/* channels carry int64 messages between vms, whether they run as fibers or
+ * on threads of their own. each one is a bounded ring buffer: sending and
+ * receiving never take a lock, only waiting for room or for a message does.
+ * channels belong to a set, which the vms that may use them are attached
+ * to, and are named by small integer ids within it. fibers and forks share
+ * the set of the vm they came from, and a set lives until the last vm and
+ * the host let go of it.
+ *
+ *   chan R, n     creates a channel for n messages, its id goes into R
+ *   send R, S     sends S on the channel with id R
+ *   recv R, S     receives a message from the channel with id S into R
+ *
+ * a fiber that can't go on parks and is run again once the other side made
+ * progress. a vm on a thread of its own sleeps on the channel, unless no
+ * other vm can reach its channels, which makes that a deadlock. */
+#define CHANNEL_MAX_CAPACITY (1 << 20)
+#define CHANNEL_CHUNK 1024
+#define CHANNEL_CHUNKS 64
+
+typedef enum FVMChannelKind {
+  /* any number of senders and receivers. */
+  FVM_CHANNEL_MPMC,
+  /* a single sending and a single receiving vm, cheaper per message. */
+  FVM_CHANNEL_SPSC,
+} FVMChannelKind;
+
+typedef struct FVMChannel FVMChannel;
+typedef struct FVMChannels FVMChannels;
+
+/* an empty set of channels, referenced once by the caller. */
+FVMChannels* fvm_channels_new(void);
+
+/* gives vm the channels of set, or none for NULL, and lets go of the set
+ * it had before. */
+void fvm_channels_attach(FVM* vm, FVMChannels* set);
+
+/* frees the set and its channels once nobody references it anymore. */
+void fvm_channels_release(FVMChannels* set);
+
+/* whether anyone but a single vm holds on to the set. */
+bool fvm_channels_shared(FVMChannels* set);
+
+/* capacity is rounded up to a power of two, two at least for mpmc. returns
+ * the id of the new channel, or -1 when capacity is not in
+ * 1..CHANNEL_MAX_CAPACITY or there are CHANNEL_CHUNK * CHANNEL_CHUNKS
+ * channels in the set already. */
+int64_t fvm_channel_new(FVMChannels* set, int64_t capacity, FVMChannelKind kind);
+
+/* NULL for an id no channel in the set has. */
+FVMChannel* fvm_channel_get(FVMChannels* set, int64_t id);
+
+/* false when the channel is full or empty. */
+bool fvm_channel_try_send(FVMChannel* channel, int64_t value);
+bool fvm_channel_try_recv(FVMChannel* channel, int64_t* value);
+
+/* wait on the calling thread until there is room or a message. */
+void fvm_channel_send(FVMChannel* channel, int64_t value);
+int64_t fvm_channel_recv(FVMChannel* channel);
+
+/* for the scheduler: puts a fiber that stopped in send or recv on
+ * vm->channel on its wait list, to be handed to fvm_sched_wake once it can
+ * go on. false when it can go on right away. */
+bool fvm_channel_park(FVM* vm);
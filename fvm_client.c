@@ -0,0 +1,269 @@
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+/* fvm-client sends one request to a running `fvm serve` and prints the
+ * reply. with -n it sends the request that many times over -c connections
+ * at once and reports the throughput and the latencies it saw. */
+
+typedef struct Connection {
+  int fd;
+  char buffer[4096];
+  size_t position;
+  size_t length;
+} Connection;
+
+typedef struct Worker {
+  pthread_t thread;
+  size_t requests;
+  size_t errors;
+  double* latencies;
+  /* the last reply, printed once at the end. */
+  char* reply;
+  size_t reply_len;
+} Worker;
+
+static const char* g_socket;
+static char* g_request;
+static size_t g_request_len;
+
+static bool connect_to(Connection* connection, const char* path) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, path, sizeof(address.sun_path) - 1);
+
+  connection->fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  connection->position = 0;
+  connection->length = 0;
+
+  return connection->fd != -1 && connect(connection->fd, (struct sockaddr*)&address, sizeof(address)) == 0;
+}
+
+static int read_byte(Connection* connection) {
+  if (connection->position == connection->length) {
+    ssize_t n = read(connection->fd, connection->buffer, sizeof(connection->buffer));
+
+    if (n <= 0)
+      return -1;
+
+    connection->position = 0;
+    connection->length = (size_t)n;
+  }
+
+  return (unsigned char)connection->buffer[connection->position++];
+}
+
+/* reads one reply: the header line and, for "ok <n> ...", n bytes more. */
+static char* read_reply(Connection* connection, size_t* length, bool* ok) {
+  size_t capacity = 256;
+  size_t used = 0;
+  char* reply = malloc(capacity);
+  int byte;
+
+  if (!reply) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  while ((byte = read_byte(connection)) != -1) {
+    if (used + 1 >= capacity) {
+      capacity *= 2;
+      reply = realloc(reply, capacity);
+
+      if (!reply) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        exit(1);
+      }
+    }
+
+    reply[used++] = (char)byte;
+
+    if (byte == '\n')
+      break;
+  }
+
+  if (byte == -1) {
+    free(reply);
+    return NULL;
+  }
+
+  *ok = strncmp(reply, "ok ", 3) == 0;
+  size_t payload = *ok ? strtoul(reply + 3, NULL, 10) : 0;
+
+  reply = realloc(reply, used + payload + 1);
+
+  if (!reply) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t i = 0; i < payload; i++) {
+    if ((byte = read_byte(connection)) == -1) {
+      free(reply);
+      return NULL;
+    }
+
+    reply[used++] = (char)byte;
+  }
+
+  reply[used] = '\0';
+  *length = used;
+
+  return reply;
+}
+
+static double now_micros() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)now.tv_sec * 1e6 + (double)now.tv_nsec / 1e3;
+}
+
+static void* run_worker(void* arg) {
+  Worker* worker = arg;
+  Connection connection;
+
+  if (!connect_to(&connection, g_socket)) {
+    fprintf(stderr, "ERROR: cannot connect to: '%s'\n", g_socket);
+    exit(1);
+  }
+
+  for (size_t i = 0; i < worker->requests; i++) {
+    double start = now_micros();
+
+    if (write(connection.fd, g_request, g_request_len) != (ssize_t)g_request_len) {
+      fprintf(stderr, "ERROR: cannot send the request!\n");
+      exit(1);
+    }
+
+    bool ok;
+    size_t length;
+    char* reply = read_reply(&connection, &length, &ok);
+
+    if (!reply) {
+      fprintf(stderr, "ERROR: the server hung up!\n");
+      exit(1);
+    }
+
+    worker->latencies[i] = now_micros() - start;
+    worker->errors += !ok;
+
+    free(worker->reply);
+    worker->reply = reply;
+    worker->reply_len = length;
+  }
+
+  close(connection.fd);
+
+  return NULL;
+}
+
+static int compare_doubles(const void* lhs, const void* rhs) {
+  double a = *(const double*)lhs;
+  double b = *(const double*)rhs;
+
+  return (a > b) - (a < b);
+}
+
+static void usage(const char* program) {
+  fprintf(stderr, "usage: %s [-n requests] [-c connections] socket request...\n", program);
+}
+
+int main(int argc, char** argv) {
+  size_t requests = 1;
+  size_t connections = 1;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:c:")) != -1) {
+    switch (option) {
+    case 'n':
+      requests = strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      connections = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind + 1 >= argc || requests == 0 || connections == 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (connections > requests)
+    connections = requests;
+
+  g_socket = argv[optind];
+
+  /* the rest of the arguments make up the request line. */
+  for (int i = optind + 1; i < argc; i++)
+    g_request_len += strlen(argv[i]) + 1;
+
+  g_request = malloc(g_request_len + 1);
+  Worker* workers = calloc(connections, sizeof(Worker));
+  double* latencies = malloc(sizeof(double) * requests);
+
+  if (!g_request || !workers || !latencies) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    return 1;
+  }
+
+  g_request[0] = '\0';
+
+  for (int i = optind + 1; i < argc; i++) {
+    strcat(g_request, argv[i]);
+    strcat(g_request, i + 1 < argc ? " " : "\n");
+  }
+
+  double start = now_micros();
+  size_t assigned = 0;
+
+  for (size_t i = 0; i < connections; i++) {
+    workers[i].requests = requests / connections + (i < requests % connections);
+    workers[i].latencies = latencies + assigned;
+    assigned += workers[i].requests;
+
+    if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]) != 0) {
+      fprintf(stderr, "ERROR: cannot start a connection!\n");
+      return 1;
+    }
+  }
+
+  size_t errors = 0;
+
+  for (size_t i = 0; i < connections; i++) {
+    pthread_join(workers[i].thread, NULL);
+    errors += workers[i].errors;
+  }
+
+  double seconds = (now_micros() - start) / 1e6;
+
+  fwrite(workers[0].reply, 1, workers[0].reply_len, stdout);
+
+  if (requests > 1) {
+    qsort(latencies, requests, sizeof(double), compare_doubles);
+
+    printf("requests: %zu, errors: %zu, seconds: %.3f, requests/s: %.0f, p50: %.1f us, p99: %.1f us\n",
+           requests, errors, seconds, (double)requests / seconds, latencies[(requests - 1) * 50 / 100],
+           latencies[(requests - 1) * 99 / 100]);
+  }
+
+  for (size_t i = 0; i < connections; i++)
+    free(workers[i].reply);
+
+  free(workers);
+  free(latencies);
+  free(g_request);
+
+  return errors ? 1 : 0;
+}
@@ -0,0 +1,216 @@
+#include <ctype.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "fvm_cpu.h"
+
+static const InstructionInfo g_instructions[] = {
+  [INS_HALT]  = { "halt",  "",   true  },
+  [INS_PUSH]  = { "push",  "r",  false },
+  [INS_PUSHI] = { "push",  "i",  false },
+  [INS_POP]   = { "pop",   "w",  false },
+  [INS_MOV]   = { "mov",   "wr", false },
+  [INS_MOVI]  = { "mov",   "wi", false },
+  [INS_ADD]   = { "add",   "mr", false },
+  [INS_ADDI]  = { "add",   "mi", false },
+  [INS_SUB]   = { "sub",   "mr", false },
+  [INS_SUBI]  = { "sub",   "mi", false },
+  [INS_MUL]   = { "mul",   "mr", false },
+  [INS_MULI]  = { "mul",   "mi", false },
+  [INS_DIV]   = { "div",   "mr", false },
+  [INS_DIVI]  = { "div",   "mi", false },
+  [INS_CMP]   = { "cmp",   "rr", false },
+  [INS_CMPI]  = { "cmp",   "ri", false },
+  [INS_JMP]   = { "jmp",   "r",  true  },
+  [INS_JMPI]  = { "jmp",   "t",  true  },
+  [INS_JE]    = { "je",    "r",  true  },
+  [INS_JEI]   = { "je",    "t",  true  },
+  [INS_JNE]   = { "jne",   "r",  true  },
+  [INS_JNEI]  = { "jne",   "t",  true  },
+  [INS_JG]    = { "jg",    "r",  true  },
+  [INS_JGI]   = { "jg",    "t",  true  },
+  [INS_JL]    = { "jl",    "r",  true  },
+  [INS_JLI]   = { "jl",    "t",  true  },
+  [INS_JGE]   = { "jge",   "r",  true  },
+  [INS_JGEI]  = { "jge",   "t",  true  },
+  [INS_JLE]   = { "jle",   "r",  true  },
+  [INS_JLEI]  = { "jle",   "t",  true  },
+  [INS_CALL]  = { "call",  "r",  true  },
+  [INS_CALLI] = { "call",  "t",  true  },
+  [INS_RET]   = { "ret",   "",   true  },
+  [INS_ENTER] = { "enter", "i",  false },
+  [INS_LEAVE] = { "leave", "",   false },
+  [INS_LOAD]  = { "load",  "wi", false },
+  [INS_STORE] = { "store", "ir", false },
+  [INS_PUTC]  = { "putc",  "r",  false },
+  [INS_PUTCI] = { "putc",  "i",  false },
+  [INS_PUTI]  = { "puti",  "r",  false },
+  [INS_PUTII] = { "puti",  "i",  false },
+  [INS_WRITE] = { "write", "rr", false },
+  [INS_READ]  = { "read",  "w",  false },
+
+  [INS_NATIVE] = { "native", "n", false },
+
+  [INS_VLOAD]  = { "vload",  "vr", false },
+  [INS_VSTORE] = { "vstore", "rv", false },
+  [INS_VADD]   = { "vadd",   "vv", false },
+  [INS_VSUB]   = { "vsub",   "vv", false },
+  [INS_VMUL]   = { "vmul",   "vv", false },
+  [INS_VCMP]   = { "vcmp",   "vv", false },
+  [INS_VSUM]   = { "vsum",   "wv", false },
+
+  [INS_MCOPY] = { "mcopy", "rrr", false },
+  [INS_MFILL] = { "mfill", "rrr", false },
+  [INS_MCMP]  = { "mcmp",  "rrr", false },
+
+  [INS_SPAWN] = { "spawn", "t", false },
+  [INS_YIELD] = { "yield", "",  true  },
+  [INS_JOIN]  = { "join",  "m", true  },
+
+  [INS_CHAN] = { "chan", "wi", false },
+  [INS_SEND] = { "send", "rr", false },
+  [INS_RECV] = { "recv", "wr", false },
+
+  [INS_SLOAD]  = { "sload",  "wr",  false },
+  [INS_SSTORE] = { "sstore", "rr",  false },
+  [INS_XADD]   = { "xadd",   "rm",  false },
+  [INS_XCHG]   = { "xchg",   "rm",  false },
+  [INS_CAS]    = { "cas",    "rmr", false },
+  [INS_FENCE]  = { "fence",  "",    false },
+
+  [INS_ALLOC]  = { "alloc",  "wr", false },
+  [INS_ALLOCI] = { "alloc",  "wi", false },
+  [INS_FREE]   = { "free",   "r",  false },
+  [INS_HLOAD]  = { "hload",  "wr", false },
+  [INS_HSTORE] = { "hstore", "rr", false },
+  [INS_HRESET] = { "hreset", "",   false },
+
+  [INS_ADD3]  = { "add", "wrr", false },
+  [INS_ADD3I] = { "add", "wri", false },
+  [INS_SUB3]  = { "sub", "wrr", false },
+  [INS_SUB3I] = { "sub", "wri", false },
+  [INS_MUL3]  = { "mul", "wrr", false },
+  [INS_MUL3I] = { "mul", "wri", false },
+  [INS_DIV3]  = { "div", "wrr", false },
+  [INS_DIV3I] = { "div", "wri", false },
+
+  [INS_JE3]   = { "je",  "rrt", true  },
+  [INS_JE3I]  = { "je",  "rit", true  },
+  [INS_JNE3]  = { "jne", "rrt", true  },
+  [INS_JNE3I] = { "jne", "rit", true  },
+  [INS_JG3]   = { "jg",  "rrt", true  },
+  [INS_JG3I]  = { "jg",  "rit", true  },
+  [INS_JL3]   = { "jl",  "rrt", true  },
+  [INS_JL3I]  = { "jl",  "rit", true  },
+  [INS_JGE3]  = { "jge", "rrt", true  },
+  [INS_JGE3I] = { "jge", "rit", true  },
+  [INS_JLE3]  = { "jle", "rrt", true  },
+  [INS_JLE3I] = { "jle", "rit", true  },
+
+  [INS_JTAB] = { "jtab", "rc", true  },
+
+  [INS_BREAK] = { "break", "", false },
+};
+
+static const char* g_registers[] = {
+  [REG_A] = "A",
+  [REG_B] = "B",
+  [REG_C] = "C",
+  [REG_D] = "D",
+  [REG_E] = "E",
+  [REG_F] = "F",
+  [6] = "R6",
+  [7] = "R7",
+  [8] = "R8",
+  [9] = "R9",
+  [10] = "R10",
+  [11] = "R11",
+  [12] = "R12",
+  [13] = "R13",
+  [14] = "R14",
+  [15] = "R15",
+  [16] = "R16",
+  [17] = "R17",
+  [18] = "R18",
+  [19] = "R19",
+  [20] = "R20",
+  [21] = "R21",
+  [22] = "R22",
+  [23] = "R23",
+  [24] = "R24",
+  [25] = "R25",
+  [26] = "R26",
+  [27] = "R27",
+  [28] = "R28",
+  [29] = "R29",
+  [30] = "R30",
+  [31] = "R31",
+  [REG_IP] = "IP",
+  [REG_SP] = "SP",
+  [REG_FP] = "FP",
+};
+
+const char* register_name(int64_t reg) {
+  if (reg < 0 || reg >= REG_SIZE)
+    return NULL;
+
+  return g_registers[reg];
+}
+
+int64_t register_from_name(const char* name, size_t length) {
+  /* R0 to R5 are the same registers as A to F. */
+  if (length >= 2 && length <= 3 && name[0] == 'R' && isdigit(name[1]) && (length == 2 || name[1] != '0')) {
+    int64_t reg = name[1] - '0';
+
+    if (length == 3) {
+      if (!isdigit(name[2]))
+        return -1;
+
+      reg = reg * 10 + name[2] - '0';
+    }
+
+    return reg < GENERAL_REGISTERS ? reg : -1;
+  }
+
+  for (int64_t reg = 0; reg < REG_SIZE; reg++) {
+    if (strlen(g_registers[reg]) == length && strncmp(g_registers[reg], name, length) == 0)
+      return reg;
+  }
+
+  return -1;
+}
+
+const InstructionInfo* instruction_info(int64_t instruction) {
+  if (instruction < 0 || instruction >= INS_SIZE)
+    return NULL;
+
+  return &g_instructions[instruction];
+}
+
+bool jumps_through_register(const InstructionInfo* info) {
+  return info->branch && strchr(info->operands, 'r') && !jump_table_offset(info) && !strchr(info->operands, 't');
+}
+
+size_t jump_table_offset(const InstructionInfo* info) {
+  /* the count is always the last operand. */
+  return strchr(info->operands, 'c') ? 1 + strlen(info->operands) : 0;
+}
+
+size_t instruction_length(const InstructionInfo* info, const int64_t* code, size_t available) {
+  size_t length = 1;
+
+  for (const char* it = info->operands; *it; it++)
+    length += 1;
+
+  size_t table = jump_table_offset(info);
+
+  if (!table)
+    return length;
+
+  int64_t count = length <= available ? code[table - 1] : -1;
+
+  if (count < 0 || (uint64_t)count > available - length)
+    return available + 1;
+
+  return length + (size_t)count;
+}
@@ -1,6 +1,23 @@
 #pragma once
 
-#define STACK_SIZE 6000
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* stack sizes are in cells: STACK_SIZE is the default maximum, the stack
+ * starts out with STACK_INITIAL_SIZE and grows on demand. */
+#define STACK_SIZE (1 << 20)
+#define STACK_INITIAL_SIZE 512
+#define CALL_STACK_SIZE 1024
+#define CALL_STACK_INITIAL_SIZE 16
+
+/* vector registers V0 to V7, each VECTOR_LANES cells wide. */
+#define VREG_SIZE 8
+#define VECTOR_LANES 4
+
+/* general registers R0 to R31, the first six also go by A to F. IP, SP and
+ * FP come after them. a register operand is its index. */
+#define GENERAL_REGISTERS 32
 
 typedef enum Register {
   REG_A,
@@ -9,8 +26,9 @@ typedef enum Register {
   REG_D,
   REG_E,
   REG_F,
-  REG_IP,
+  REG_IP = GENERAL_REGISTERS,
   REG_SP,
+  REG_FP,
   REG_SIZE,
 } Register;
 
@@ -52,4 +70,100 @@ typedef enum Instruction {
   INS_JGEI,  
   INS_JLE,  
   INS_JLEI,
+  INS_CALL,
+  INS_CALLI,
+  INS_RET,
+  INS_ENTER,
+  INS_LEAVE,
+  INS_LOAD,
+  INS_STORE,
+  INS_PUTC,
+  INS_PUTCI,
+  INS_PUTI,
+  INS_PUTII,
+  INS_WRITE,
+  INS_READ,
+  INS_NATIVE,
+  INS_VLOAD,
+  INS_VSTORE,
+  INS_VADD,
+  INS_VSUB,
+  INS_VMUL,
+  INS_VCMP,
+  INS_VSUM,
+  INS_MCOPY,
+  INS_MFILL,
+  INS_MCMP,
+  INS_SPAWN,
+  INS_YIELD,
+  INS_JOIN,
+  INS_CHAN,
+  INS_SEND,
+  INS_RECV,
+  INS_SLOAD,
+  INS_SSTORE,
+  INS_XADD,
+  INS_XCHG,
+  INS_CAS,
+  INS_FENCE,
+  INS_ALLOC,
+  INS_ALLOCI,
+  INS_FREE,
+  INS_HLOAD,
+  INS_HSTORE,
+  INS_HRESET,
+  /* add A, B, C sets A to B + C, je A, B, label compares and jumps in one. */
+  INS_ADD3,
+  INS_ADD3I,
+  INS_SUB3,
+  INS_SUB3I,
+  INS_MUL3,
+  INS_MUL3I,
+  INS_DIV3,
+  INS_DIV3I,
+  INS_JE3,
+  INS_JE3I,
+  INS_JNE3,
+  INS_JNE3I,
+  INS_JG3,
+  INS_JG3I,
+  INS_JL3,
+  INS_JL3I,
+  INS_JGE3,
+  INS_JGE3I,
+  INS_JLE3,
+  INS_JLE3I,
+  /* jtab A, l0, l1, ... jumps to the A-th label, or past itself if there is
+   * none. */
+  INS_JTAB,
+  /* only ever patched in by the debugger, see fvm_debug.h. */
+  INS_BREAK,
+  INS_SIZE,
 } Instruction;
+
+/* operands: r register that is read, w register that is written, m register
+ * that is read and written, i immediate, t jump target, n native function,
+ * v vector register, c count of jump targets that follow the operands */
+typedef struct InstructionInfo {
+  const char* name;
+  const char* operands;
+  bool branch;
+} InstructionInfo;
+
+/* returns NULL for unknown opcodes. branch is set for every instruction that
+ * may transfer control, which is where straight-line runs of code end. */
+const InstructionInfo* instruction_info(int64_t instruction);
+/* a branch that goes where a register points rather than to a jump target
+ * operand, like jmp A or call A. */
+bool jumps_through_register(const InstructionInfo* info);
+
+/* the assembler name of a register, NULL if it is out of range. */
+const char* register_name(int64_t reg);
+/* the register named by the length characters at name, -1 for none. */
+int64_t register_from_name(const char* name, size_t length);
+/* the cells taken up by the instruction at code, which has available cells
+ * left before the end of the program. a table of jump targets counts too,
+ * and one that does not fit makes the length come out over available. */
+size_t instruction_length(const InstructionInfo* info, const int64_t* code, size_t available);
+/* where the jump targets that follow the operands start, 0 for none. */
+size_t jump_table_offset(const InstructionInfo* info);
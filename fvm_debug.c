@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fvm_debug.h"
+
+#define COMMAND_SIZE 256
+
+typedef struct Breakpoint {
+  int64_t address;
+  /* the opcode INS_BREAK replaced. */
+  int64_t opcode;
+} Breakpoint;
+
+static int64_t* g_code;
+static size_t g_length;
+static cvector_vector_type(ParsedLabel) g_labels;
+static cvector_vector_type(Breakpoint) g_breakpoints;
+/* which addresses an instruction starts at, only those take breakpoints. */
+static bool* g_starts;
+
+static Breakpoint* find_breakpoint(int64_t address) {
+  for (Breakpoint* it = cvector_begin(g_breakpoints); it != cvector_end(g_breakpoints); ++it) {
+    if (it->address == address)
+      return it;
+  }
+
+  return NULL;
+}
+
+/* the opcode at address as the program has it. */
+static int64_t opcode_at(int64_t address) {
+  Breakpoint* breakpoint = find_breakpoint(address);
+  return breakpoint ? breakpoint->opcode : g_code[address];
+}
+
+static void find_starts() {
+  g_starts = calloc(g_length + 1, sizeof(bool));
+
+  if (!g_starts) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t address = 0; address < g_length;) {
+    const InstructionInfo* info = instruction_info(g_code[address]);
+
+    if (!info)
+      break;
+
+    g_starts[address] = true;
+    address += instruction_length(info, &g_code[address], g_length - address);
+  }
+}
+
+/* address as label+offset, the label being the closest one before it. */
+static void print_location(int64_t address) {
+  const ParsedLabel* closest = NULL;
+
+  for (ParsedLabel* it = cvector_begin(g_labels); it != cvector_end(g_labels); ++it) {
+    if (it->address <= address && (!closest || it->address > closest->address))
+      closest = it;
+  }
+
+  if (!closest)
+    printf("%ld", address);
+  else if (closest->address == address)
+    printf("%ld <%s>", address, closest->name);
+  else
+    printf("%ld <%s+%ld>", address, closest->name, address - closest->address);
+}
+
+static void print_instruction(int64_t address) {
+  const InstructionInfo* info = instruction_info(opcode_at(address));
+
+  printf("%s ", find_breakpoint(address) ? "*" : " ");
+  print_location(address);
+
+  if (!info || instruction_length(info, &g_code[address], g_length - (size_t)address) > g_length - (size_t)address) {
+    printf(": ???\n");
+    return;
+  }
+
+  printf(": %s", info->name);
+
+  for (size_t i = 0; info->operands[i]; i++) {
+    int64_t operand = g_code[address + 1 + i];
+    const char* reg = register_name(operand);
+
+    printf(i == 0 ? " " : ", ");
+
+    switch (info->operands[i]) {
+    case 'r':
+    case 'w':
+    case 'm':
+      printf("%s", reg ? reg : "?");
+      break;
+    case 'v':
+      printf("V%ld", operand);
+      break;
+    case 'n':
+      printf("native %ld", operand);
+      break;
+    case 't':
+      print_location(operand);
+      break;
+    case 'c':
+      /* written as the table itself rather than its length. */
+      for (int64_t j = 0; j < operand; j++) {
+        printf(j == 0 ? "" : ", ");
+        print_location(g_code[address + (int64_t)jump_table_offset(info) + j]);
+      }
+      break;
+    default:
+      printf("%ld", operand);
+    }
+  }
+
+  printf("\n");
+}
+
+static bool parse_location(const char* text, int64_t* address) {
+  char* end;
+  *address = strtol(text, &end, 10);
+
+  if (end == text || *end) {
+    bool found = false;
+
+    for (ParsedLabel* it = cvector_begin(g_labels); it != cvector_end(g_labels) && !found; ++it) {
+      if (strcmp(it->name, text) == 0) {
+        *address = it->address;
+        found = true;
+      }
+    }
+
+    if (!found) {
+      printf("no label '%s'\n", text);
+      return false;
+    }
+  }
+
+  if (*address < 0 || (size_t)*address >= g_length || !g_starts[*address]) {
+    printf("no instruction starts at %ld\n", *address);
+    return false;
+  }
+
+  return true;
+}
+
+static void set_breakpoint(const char* text) {
+  int64_t address;
+
+  if (!parse_location(text, &address))
+    return;
+
+  if (!find_breakpoint(address)) {
+    Breakpoint breakpoint;
+    breakpoint.address = address;
+    breakpoint.opcode = g_code[address];
+    cvector_push_back(g_breakpoints, breakpoint);
+    g_code[address] = INS_BREAK;
+  }
+
+  printf("breakpoint at ");
+  print_location(address);
+  printf("\n");
+}
+
+static void delete_breakpoint(const char* text) {
+  int64_t address;
+
+  if (!parse_location(text, &address))
+    return;
+
+  Breakpoint* breakpoint = find_breakpoint(address);
+
+  if (!breakpoint) {
+    printf("no breakpoint at %ld\n", address);
+    return;
+  }
+
+  g_code[address] = breakpoint->opcode;
+  cvector_erase(g_breakpoints, (size_t)(breakpoint - g_breakpoints));
+}
+
+/* runs budget instructions at most. a breakpoint under IP is stepped over
+ * with its opcode put back for that one instruction. */
+static FVMStatus resume(FVM* vm, int64_t budget) {
+  int64_t ip = vm->registers[REG_IP];
+  Breakpoint* breakpoint = ip >= 0 && (size_t)ip < g_length ? find_breakpoint(ip) : NULL;
+
+  if (breakpoint) {
+    g_code[ip] = breakpoint->opcode;
+    FVMStatus status = fvm_run_for(vm, 1);
+    g_code[ip] = INS_BREAK;
+
+    if (status == FVM_HALTED || budget == 1)
+      return status;
+  }
+
+  return fvm_run_for(vm, budget);
+}
+
+static void print_registers(FVM* vm) {
+  for (int i = 0; i < REG_SIZE; i++) {
+    /* R6 and up only once they are used. */
+    if (i > REG_F && i < GENERAL_REGISTERS && !vm->registers[i])
+      continue;
+
+    printf("%s=%ld ", register_name(i), vm->registers[i]);
+  }
+
+  printf("\nflags:%s%s%s\n", vm->flags[FLAG_EQ] ? " EQ" : "", vm->flags[FLAG_GT] ? " GT" : "",
+         vm->flags[FLAG_LT] ? " LT" : "");
+}
+
+static void print_stack(FVM* vm, int64_t count) {
+  int64_t sp = vm->registers[REG_SP];
+  int64_t committed = (int64_t)(vm->stack.committed / sizeof(int64_t));
+
+  for (int64_t i = sp; i > sp - count && i >= 0; i--) {
+    /* a parked or never used stack has nothing mapped. */
+    if (!vm->stack.base || i >= committed)
+      continue;
+
+    printf("%6ld: %ld%s%s\n", i, vm->stack.base[i], i == sp ? " <- SP" : "",
+           i == vm->registers[REG_FP] ? " <- FP" : "");
+  }
+}
+
+static void stopped(FVM* vm, FVMStatus status) {
+  fvm_output_flush(&vm->output);
+
+  if (status == FVM_HALTED) {
+    printf("halted\n");
+    return;
+  }
+
+  print_instruction(vm->registers[REG_IP]);
+}
+
+static int64_t count_argument(const char* text, int64_t fallback) {
+  int64_t count = text ? strtol(text, NULL, 10) : fallback;
+  return count > 0 ? count : fallback;
+}
+
+void fvm_debug(FVM* vm, int64_t* instructions, cvector_vector_type(ParsedLabel) labels) {
+  g_code = instructions;
+  g_length = vm->program->length;
+  g_labels = labels;
+  g_breakpoints = NULL;
+  find_starts();
+
+  char line[COMMAND_SIZE];
+
+  print_instruction(vm->registers[REG_IP]);
+
+  for (;;) {
+    printf("(fvm) ");
+    fflush(stdout);
+
+    if (!fgets(line, sizeof(line), stdin))
+      break;
+
+    char* command = strtok(line, " \t\n");
+    char* argument = strtok(NULL, " \t\n");
+
+    if (!command)
+      continue;
+
+    if (strcmp(command, "q") == 0 || strcmp(command, "quit") == 0)
+      break;
+
+    if (strcmp(command, "b") == 0 || strcmp(command, "break") == 0) {
+      if (argument)
+        set_breakpoint(argument);
+      else
+        printf("break where?\n");
+    } else if (strcmp(command, "d") == 0 || strcmp(command, "delete") == 0) {
+      if (argument)
+        delete_breakpoint(argument);
+      else
+        printf("delete which?\n");
+    } else if (strcmp(command, "r") == 0 || strcmp(command, "run") == 0 || strcmp(command, "c") == 0 ||
+               strcmp(command, "continue") == 0) {
+      if (!vm->running) {
+        printf("halted\n");
+        continue;
+      }
+
+      stopped(vm, resume(vm, INT64_MAX));
+    } else if (strcmp(command, "s") == 0 || strcmp(command, "step") == 0) {
+      FVMStatus status = FVM_PREEMPTED;
+
+      for (int64_t i = count_argument(argument, 1); i > 0 && status != FVM_HALTED; i--)
+        status = resume(vm, 1);
+
+      stopped(vm, status);
+    } else if (strcmp(command, "regs") == 0) {
+      print_registers(vm);
+    } else if (strcmp(command, "stack") == 0) {
+      print_stack(vm, count_argument(argument, 8));
+    } else if (strcmp(command, "l") == 0 || strcmp(command, "list") == 0) {
+      int64_t address = vm->registers[REG_IP];
+
+      for (int64_t i = count_argument(argument, 5); i > 0 && address >= 0 && (size_t)address < g_length; i--) {
+        print_instruction(address);
+
+        const InstructionInfo* info = instruction_info(opcode_at(address));
+
+        if (!info)
+          break;
+
+        address += (int64_t)instruction_length(info, &g_code[address], g_length - (size_t)address);
+      }
+    } else {
+      printf("commands: break L, delete L, continue, step [n], regs, stack [n], list [n], quit\n");
+    }
+  }
+
+  /* the program is left the way it was assembled. */
+  for (Breakpoint* it = cvector_begin(g_breakpoints); it != cvector_end(g_breakpoints); ++it)
+    g_code[it->address] = it->opcode;
+
+  cvector_free(g_breakpoints);
+  g_breakpoints = NULL;
+  free(g_starts);
+  g_starts = NULL;
+}
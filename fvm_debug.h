@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "fvm.h"
+#include "fvm_parser.h"
+
+/* fvm -g: a debugger reading commands from stdin. a breakpoint is the
+ * INS_BREAK opcode written over the first cell of an instruction, which
+ * stops the vm in front of it as if its budget ran out; the original opcode
+ * is put back to step past it and when the breakpoint is deleted. so the vm
+ * never looks for breakpoints itself and runs at full speed in between.
+ *
+ *   break L      stops before the instruction at label or address L
+ *   delete L     removes the breakpoint at L
+ *   continue     runs up to the next breakpoint or halt, run does the same
+ *   step [n]     executes n instructions, 1 by default
+ *   regs         prints the registers and flags
+ *   stack [n]    prints the top n stack cells, 8 by default
+ *   list [n]     prints the next n instructions, 5 by default
+ *   quit
+ *
+ * every command can be cut down to its first letter. instructions is the
+ * program vm runs, the one the breakpoints are written into. */
+void fvm_debug(FVM* vm, int64_t* instructions, cvector_vector_type(ParsedLabel) labels);
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fvm_heap.h"
+
+void fvm_heap_init(FVMHeap* heap) {
+  heap->cells = NULL;
+  heap->starts = NULL;
+  heap->capacity = 0;
+  heap->top = 0;
+
+  for (int i = 0; i < HEAP_CLASSES; i++)
+    heap->free[i] = -1;
+
+  memset(&heap->stats, 0, sizeof(heap->stats));
+}
+
+void fvm_heap_deinit(FVMHeap* heap) {
+  free(heap->cells);
+  free(heap->starts);
+  heap->cells = NULL;
+  heap->starts = NULL;
+  heap->capacity = 0;
+}
+
+void fvm_heap_reserve(FVMHeap* heap, int64_t size) {
+  if (size <= heap->capacity)
+    return;
+
+  int64_t capacity = heap->capacity ? heap->capacity : HEAP_INITIAL_SIZE;
+
+  while (capacity < size)
+    capacity *= 2;
+
+  if (capacity > HEAP_SIZE)
+    capacity = HEAP_SIZE;
+
+  int64_t* cells = realloc(heap->cells, sizeof(int64_t) * capacity);
+  int8_t* starts = cells ? realloc(heap->starts, (size_t)capacity) : NULL;
+
+  if (!cells || !starts) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  memset(starts + heap->capacity, 0, (size_t)(capacity - heap->capacity));
+
+  heap->cells = cells;
+  heap->starts = starts;
+  heap->capacity = capacity;
+}
+
+static int size_class(int64_t size) {
+  int class = 0;
+
+  while (((int64_t)1 << class) < size)
+    class += 1;
+
+  return class;
+}
+
+bool fvm_heap_alloc(FVMHeap* heap, int64_t size, int64_t* address) {
+  if (size < 0 || size > HEAP_SIZE / 2)
+    return false;
+
+  /* an empty block still gets a cell, its free list link goes there. */
+  int class = size_class(size);
+  int64_t cells = (int64_t)1 << class;
+  int64_t block = heap->free[class];
+
+  if (block != -1) {
+    int64_t next = heap->cells[block];
+    bool linked = next >= 1 && next < heap->top && heap->starts[next] == -1 - class;
+
+    heap->free[class] = linked ? next : -1;
+    heap->stats.reused += 1;
+  } else {
+    block = heap->top ? heap->top : 1;
+
+    if (block + cells > HEAP_SIZE)
+      return false;
+
+    fvm_heap_reserve(heap, block + cells);
+    heap->top = block + cells;
+
+    if (heap->top > heap->stats.peak)
+      heap->stats.peak = heap->top;
+  }
+
+  heap->starts[block] = (int8_t)(class + 1);
+  memset(&heap->cells[block], 0, sizeof(int64_t) * cells);
+
+  heap->stats.allocs += 1;
+  heap->stats.live += cells;
+  *address = block;
+
+  return true;
+}
+
+bool fvm_heap_free(FVMHeap* heap, int64_t address) {
+  if (address < 1 || address >= heap->top || heap->starts[address] <= 0)
+    return false;
+
+  int class = heap->starts[address] - 1;
+
+  heap->starts[address] = (int8_t)(-1 - class);
+  heap->cells[address] = heap->free[class];
+  heap->free[class] = address;
+
+  heap->stats.frees += 1;
+  heap->stats.live -= (int64_t)1 << class;
+
+  return true;
+}
+
+void fvm_heap_reset(FVMHeap* heap) {
+  /* the cells stay allocated for the next round. */
+  if (heap->top)
+    memset(heap->starts, 0, (size_t)heap->top);
+
+  heap->top = 0;
+
+  for (int i = 0; i < HEAP_CLASSES; i++)
+    heap->free[i] = -1;
+
+  heap->stats.resets += 1;
+  heap->stats.live = 0;
+}
+
+void fvm_heap_print_stats(const FVMHeapStats* stats) {
+  fprintf(stderr, "HEAP:\n");
+  fprintf(stderr, "  allocs: %lu (%lu from free lists)\n", stats->allocs, stats->reused);
+  fprintf(stderr, "  frees:  %lu\n", stats->frees);
+  fprintf(stderr, "  resets: %lu\n", stats->resets);
+  fprintf(stderr, "  live:   %ld cells\n", stats->live);
+  fprintf(stderr, "  peak:   %ld cells\n", stats->peak);
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* a vm's heap is a growable array of cells of its own, addressed by index
+ * like the stack is:
+ *
+ *   alloc R, n     R = the address of a new block of n zeroed cells
+ *   free R         gives the block at R back
+ *   hload R, S     R = heap cell S
+ *   hstore R, S    heap cell R = S
+ *   hreset         frees every block at once
+ *
+ * blocks are carved off the end of the heap with a bump pointer, starting
+ * at cell 1 so that 0 is never an address. freed ones go onto a free list
+ * per size class, powers of two, which later allocations of the class take
+ * from first. hreset empties the whole heap, long-lived blocks included.
+ *
+ * where the blocks start is kept apart from the cells, which the program
+ * can write, so free only ever takes an allocated block. the free lists are
+ * linked through the first cell of each free block, and a link the program
+ * overwrote ends its list there. a vm runs on one thread at a time, so none
+ * of this takes a lock. */
+#define HEAP_SIZE (1 << 24)
+#define HEAP_INITIAL_SIZE 1024
+/* enough classes for the largest block, HEAP_SIZE / 2 cells. */
+#define HEAP_CLASSES 24
+
+typedef struct FVMHeapStats {
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t resets;
+  /* allocations served from a free list instead of the bump pointer. */
+  uint64_t reused;
+  /* cells in blocks that are allocated right now. */
+  int64_t live;
+  /* the furthest the bump pointer got. */
+  int64_t peak;
+} FVMHeapStats;
+
+typedef struct FVMHeap {
+  int64_t* cells;
+  /* per cell: class + 1 where an allocated block starts, -1 - class where a
+   * free one does, 0 elsewhere. */
+  int8_t* starts;
+  int64_t capacity;
+  /* the bump pointer, cells past it were never handed out. */
+  int64_t top;
+  /* the first free block of each class, linked through their first cell,
+   * -1 when there is none. */
+  int64_t free[HEAP_CLASSES];
+  FVMHeapStats stats;
+} FVMHeap;
+
+void fvm_heap_init(FVMHeap* heap);
+void fvm_heap_deinit(FVMHeap* heap);
+
+/* alloc returns false when size is not in 0..HEAP_SIZE / 2 or the heap is
+ * full, free for an address that is not the start of an allocated block. */
+bool fvm_heap_alloc(FVMHeap* heap, int64_t size, int64_t* address);
+bool fvm_heap_free(FVMHeap* heap, int64_t address);
+void fvm_heap_reset(FVMHeap* heap);
+
+/* makes room for size cells, up to HEAP_SIZE. */
+void fvm_heap_reserve(FVMHeap* heap, int64_t size);
+
+void fvm_heap_print_stats(const FVMHeapStats* stats);
@@ -0,0 +1,151 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "fvm_io.h"
+
+void fvm_output_init(FVMOutput* output, int fd) {
+  output->fd = fd;
+  output->chunk = 0;
+  output->used = 0;
+
+  for (size_t i = 0; i < IO_CHUNKS; i++)
+    output->chunks[i] = NULL;
+}
+
+void fvm_output_deinit(FVMOutput* output) {
+  fvm_output_flush(output);
+
+  for (size_t i = 0; i < IO_CHUNKS; i++) {
+    free(output->chunks[i]);
+    output->chunks[i] = NULL;
+  }
+}
+
+void fvm_output_flush(FVMOutput* output) {
+  struct iovec iov[IO_CHUNKS];
+  int iov_len = 0;
+
+  for (size_t i = 0; i <= output->chunk && i < IO_CHUNKS; i++) {
+    size_t length = i < output->chunk ? IO_CHUNK_SIZE : output->used;
+
+    if (length == 0)
+      continue;
+
+    iov[iov_len].iov_base = output->chunks[i];
+    iov[iov_len].iov_len = length;
+    iov_len += 1;
+  }
+
+  /* keep the order with anything the host printed through stdio. */
+  if (output->fd == STDOUT_FILENO)
+    fflush(stdout);
+
+  int first = 0;
+
+  while (first < iov_len) {
+    ssize_t written = writev(output->fd, iov + first, iov_len - first);
+
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+
+      fprintf(stderr, "ERROR: cannot write output!\n");
+      exit(1);
+    }
+
+    /* skip whatever a short write already got out. */
+    while (first < iov_len && (size_t)written >= iov[first].iov_len) {
+      written -= iov[first].iov_len;
+      first += 1;
+    }
+
+    if (first < iov_len) {
+      iov[first].iov_base = (char*)iov[first].iov_base + written;
+      iov[first].iov_len -= written;
+    }
+  }
+
+  output->chunk = 0;
+  output->used = 0;
+}
+
+void fvm_output_byte(FVMOutput* output, char byte) {
+  if (output->used == IO_CHUNK_SIZE) {
+    output->chunk += 1;
+    output->used = 0;
+
+    if (output->chunk == IO_CHUNKS)
+      fvm_output_flush(output);
+  }
+
+  if (!output->chunks[output->chunk]) {
+    output->chunks[output->chunk] = malloc(IO_CHUNK_SIZE);
+
+    if (!output->chunks[output->chunk]) {
+      fprintf(stderr, "ERROR: cannot allocate memory!\n");
+      exit(1);
+    }
+  }
+
+  output->chunks[output->chunk][output->used] = byte;
+  output->used += 1;
+}
+
+void fvm_output_int(FVMOutput* output, int64_t value) {
+  char digits[20];
+  int length = 0;
+  uint64_t magnitude = value < 0 ? -(uint64_t)value : (uint64_t)value;
+
+  do {
+    digits[length++] = (char)('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+
+  if (value < 0)
+    fvm_output_byte(output, '-');
+
+  while (length > 0)
+    fvm_output_byte(output, digits[--length]);
+}
+
+void fvm_input_init(FVMInput* input, int fd) {
+  input->fd = fd;
+  input->buffer = NULL;
+  input->position = 0;
+  input->length = 0;
+}
+
+void fvm_input_deinit(FVMInput* input) {
+  free(input->buffer);
+  input->buffer = NULL;
+}
+
+int64_t fvm_input_byte(FVMInput* input) {
+  if (input->position == input->length) {
+    if (!input->buffer) {
+      input->buffer = malloc(IO_CHUNK_SIZE);
+
+      if (!input->buffer) {
+        fprintf(stderr, "ERROR: cannot allocate memory!\n");
+        exit(1);
+      }
+    }
+
+    ssize_t length;
+
+    do {
+      length = read(input->fd, input->buffer, IO_CHUNK_SIZE);
+    } while (length < 0 && errno == EINTR);
+
+    if (length <= 0)
+      return -1;
+
+    input->position = 0;
+    input->length = (size_t)length;
+  }
+
+  return (unsigned char)input->buffer[input->position++];
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IO_CHUNK_SIZE 4096
+#define IO_CHUNKS 16
+
+/* output is collected in chunks that are only allocated once they are
+ * needed and written out with a single writev when all of them are full,
+ * on halt or on an explicit flush. */
+typedef struct FVMOutput {
+  int fd;
+  char* chunks[IO_CHUNKS];
+  size_t chunk;
+  size_t used;
+} FVMOutput;
+
+typedef struct FVMInput {
+  int fd;
+  char* buffer;
+  size_t position;
+  size_t length;
+} FVMInput;
+
+void fvm_output_init(FVMOutput* output, int fd);
+void fvm_output_deinit(FVMOutput* output);
+void fvm_output_flush(FVMOutput* output);
+void fvm_output_byte(FVMOutput* output, char byte);
+void fvm_output_int(FVMOutput* output, int64_t value);
+
+void fvm_input_init(FVMInput* input, int fd);
+void fvm_input_deinit(FVMInput* input);
+
+/* returns -1 at the end of the input. */
+int64_t fvm_input_byte(FVMInput* input);
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fvm_native.h"
+#include "fvm_object.h"
+#include "fvm_parser.h"
+
+/* file.asm gives file.o. */
+static char* object_path(const char* source) {
+  const char* dot = strrchr(source, '.');
+  size_t stem = dot && !strchr(dot, '/') ? (size_t)(dot - source) : strlen(source);
+  char* path = malloc(stem + 3);
+
+  if (!path) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  memcpy(path, source, stem);
+  strcpy(path + stem, ".o");
+
+  return path;
+}
+
+static void load(const char* path, FVMObject* object) {
+  if (!fvm_object_file(path)) {
+    assemble_object(path, object);
+    return;
+  }
+
+  if (!fvm_object_read(object, path))
+    exit(1);
+}
+
+static void usage(const char* program) {
+  fprintf(stderr, "usage: %s -c [-o output] file\n", program);
+  fprintf(stderr, "       %s [-o output] file...\n", program);
+}
+
+int main(int argc, char** argv) {
+  fvm_native_builtins();
+
+  const char* output = NULL;
+  bool assemble_only = false;
+  int option;
+
+  while ((option = getopt(argc, argv, "co:")) != -1) {
+    switch (option) {
+    case 'c':
+      assemble_only = true;
+      break;
+    case 'o':
+      output = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind >= argc || (assemble_only && optind + 1 != argc)) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  if (assemble_only) {
+    FVMObject object;
+    assemble_object(argv[optind], &object);
+
+    char* path = output ? NULL : object_path(argv[optind]);
+    bool ok = fvm_object_write(&object, output ? output : path);
+
+    free(path);
+    fvm_object_free(&object);
+
+    return ok ? 0 : 1;
+  }
+
+  size_t count = (size_t)(argc - optind);
+  FVMObject* objects = calloc(count, sizeof(FVMObject));
+
+  if (!objects) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < count; i++)
+    load(argv[optind + i], &objects[i]);
+
+  FVMObject linked;
+  fvm_object_link(objects, count, &linked);
+
+  bool ok = fvm_object_write(&linked, output ? output : "a.out");
+
+  for (size_t i = 0; i < count; i++)
+    fvm_object_free(&objects[i]);
+
+  fvm_object_free(&linked);
+  free(objects);
+
+  return ok ? 0 : 1;
+}
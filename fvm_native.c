@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fvm_native.h"
+
+FVMNative fvm_natives[NATIVE_SIZE];
+
+static const char* g_names[NATIVE_SIZE];
+static int64_t g_count;
+
+int64_t fvm_native_register(const char* name, FVMNative function) {
+  int64_t index = fvm_native_find(name, strlen(name));
+
+  if (index != -1) {
+    fvm_natives[index] = function;
+    return index;
+  }
+
+  if (g_count == NATIVE_SIZE) {
+    fprintf(stderr, "ERROR: too many native functions!\n");
+    exit(1);
+  }
+
+  g_names[g_count] = name;
+  fvm_natives[g_count] = function;
+  g_count += 1;
+
+  return g_count - 1;
+}
+
+static int64_t native_abs(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f) {
+  (void)b, (void)c, (void)d, (void)e, (void)f;
+
+  return a < 0 ? (int64_t)(0 - (uint64_t)a) : a;
+}
+
+static int64_t native_min(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f) {
+  (void)c, (void)d, (void)e, (void)f;
+
+  return a < b ? a : b;
+}
+
+static int64_t native_max(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f) {
+  (void)c, (void)d, (void)e, (void)f;
+
+  return a > b ? a : b;
+}
+
+/* the largest root whose square is at most a, -1 for negative numbers. */
+static int64_t native_isqrt(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f) {
+  (void)b, (void)c, (void)d, (void)e, (void)f;
+
+  if (a < 0)
+    return -1;
+
+  int64_t root = 0;
+
+  for (int64_t bit = (int64_t)1 << 31; bit; bit >>= 1) {
+    int64_t next = root | bit;
+
+    if (next <= a / next)
+      root = next;
+  }
+
+  return root;
+}
+
+void fvm_native_builtins(void) {
+  fvm_native_register("abs", native_abs);
+  fvm_native_register("min", native_min);
+  fvm_native_register("max", native_max);
+  fvm_native_register("isqrt", native_isqrt);
+}
+
+int64_t fvm_native_find(const char* name, size_t length) {
+  for (int64_t i = 0; i < g_count; i++) {
+    if (strlen(g_names[i]) == length && memcmp(g_names[i], name, length) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+int64_t fvm_native_count() {
+  return g_count;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define NATIVE_SIZE 256
+
+/* native functions get registers A to F and return into A. */
+typedef int64_t (*FVMNative)(int64_t a, int64_t b, int64_t c, int64_t d, int64_t e, int64_t f);
+
+/* indexed directly by the native instruction, the assembler resolves names. */
+extern FVMNative fvm_natives[NATIVE_SIZE];
+
+/* natives have to be registered before the programs calling them are
+ * assembled. returns the index of the function. */
+int64_t fvm_native_register(const char* name, FVMNative function);
+
+/* registers abs, min, max and isqrt, the natives every fvm program can
+ * call. every tool that assembles registers them first thing, so they get
+ * the same indices everywhere; an embedder adds its own after them. */
+void fvm_native_builtins(void);
+
+/* returns -1 if there is no native function with that name. */
+int64_t fvm_native_find(const char* name, size_t length);
+int64_t fvm_native_count();
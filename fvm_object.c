@@ -0,0 +1,281 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fvm_object.h"
+#include "fvm_trap.h"
+
+#define OBJECT_MAGIC 0x4f4d5646 /* "FVMO" */
+#define OBJECT_VERSION 1
+
+typedef struct ObjectHeader {
+  uint32_t magic;
+  uint32_t version;
+  int64_t code_len;
+  int64_t symbols_len;
+  int64_t relocations_len;
+  /* the symbol names follow everything else, each one nul terminated. */
+  int64_t names_len;
+} ObjectHeader;
+
+typedef struct ObjectSymbol {
+  int64_t name;
+  int64_t kind;
+  int64_t address;
+} ObjectSymbol;
+
+void fvm_object_free(FVMObject* object) {
+  for (FVMSymbol* it = cvector_begin(object->symbols); it != cvector_end(object->symbols); ++it)
+    free(it->name);
+
+  cvector_free(object->code);
+  cvector_free(object->symbols);
+  cvector_free(object->relocations);
+
+  object->code = NULL;
+  object->symbols = NULL;
+  object->relocations = NULL;
+}
+
+bool fvm_object_file(const char* path) {
+  FILE* file = fopen(path, "rb");
+
+  if (!file)
+    return false;
+
+  uint32_t magic = 0;
+  bool object = fread(&magic, sizeof(magic), 1, file) == 1 && magic == OBJECT_MAGIC;
+  fclose(file);
+
+  return object;
+}
+
+bool fvm_object_write(const FVMObject* object, const char* path) {
+  FILE* file = fopen(path, "wb");
+
+  if (!file) {
+    fprintf(stderr, "ERROR: cannot open: '%s'\n", path);
+    return false;
+  }
+
+  ObjectHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = OBJECT_MAGIC;
+  header.version = OBJECT_VERSION;
+  header.code_len = (int64_t)cvector_size(object->code);
+  header.symbols_len = (int64_t)cvector_size(object->symbols);
+  header.relocations_len = (int64_t)cvector_size(object->relocations);
+
+  for (FVMSymbol* it = cvector_begin(object->symbols); it != cvector_end(object->symbols); ++it)
+    header.names_len += (int64_t)strlen(it->name) + 1;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(object->code, sizeof(int64_t), header.code_len, file) == (size_t)header.code_len;
+
+  int64_t name = 0;
+
+  for (FVMSymbol* it = cvector_begin(object->symbols); ok && it != cvector_end(object->symbols); ++it) {
+    ObjectSymbol symbol;
+    symbol.name = name;
+    symbol.kind = it->kind;
+    symbol.address = it->address;
+    name += (int64_t)strlen(it->name) + 1;
+
+    ok = fwrite(&symbol, sizeof(symbol), 1, file) == 1;
+  }
+
+  ok = ok && fwrite(object->relocations, sizeof(FVMRelocation), header.relocations_len, file) ==
+               (size_t)header.relocations_len;
+
+  for (FVMSymbol* it = cvector_begin(object->symbols); ok && it != cvector_end(object->symbols); ++it)
+    ok = fwrite(it->name, 1, strlen(it->name) + 1, file) == strlen(it->name) + 1;
+
+  if (fclose(file) != 0)
+    ok = false;
+
+  if (!ok)
+    fprintf(stderr, "ERROR: cannot write object: '%s'\n", path);
+
+  return ok;
+}
+
+static bool read_body(FVMObject* object, const ObjectHeader* header, FILE* file) {
+  int64_t* code = malloc(sizeof(int64_t) * (size_t)(header->code_len + 1));
+  ObjectSymbol* symbols = malloc(sizeof(ObjectSymbol) * (size_t)(header->symbols_len + 1));
+  FVMRelocation* relocations = malloc(sizeof(FVMRelocation) * (size_t)(header->relocations_len + 1));
+  char* names = malloc((size_t)header->names_len + 1);
+
+  if (!code || !symbols || !relocations || !names) {
+    fprintf(stderr, "ERROR: failed to allocate memory!\n");
+    exit(1);
+  }
+
+  bool ok = fread(code, sizeof(int64_t), header->code_len, file) == (size_t)header->code_len &&
+            fread(symbols, sizeof(ObjectSymbol), header->symbols_len, file) == (size_t)header->symbols_len &&
+            fread(relocations, sizeof(FVMRelocation), header->relocations_len, file) ==
+              (size_t)header->relocations_len &&
+            fread(names, 1, header->names_len, file) == (size_t)header->names_len &&
+            (header->names_len == 0 || names[header->names_len - 1] == 0);
+
+  /* everything an object refers to has to lie inside it, so the linker can
+   * trust what it reads. */
+  for (int64_t i = 0; ok && i < header->symbols_len; i++) {
+    ObjectSymbol* it = &symbols[i];
+
+    ok = it->name >= 0 && it->name < header->names_len && it->kind >= FVM_SYMBOL_LOCAL &&
+         it->kind <= FVM_SYMBOL_IMPORT &&
+         (it->kind == FVM_SYMBOL_IMPORT || (it->address >= 0 && it->address <= header->code_len));
+  }
+
+  for (int64_t i = 0; ok && i < header->relocations_len; i++) {
+    ok = relocations[i].offset >= 0 && relocations[i].offset < header->code_len && relocations[i].symbol >= 0 &&
+         relocations[i].symbol < header->symbols_len;
+  }
+
+  for (int64_t i = 0; ok && i < header->code_len; i++)
+    cvector_push_back(object->code, code[i]);
+
+  for (int64_t i = 0; ok && i < header->symbols_len; i++) {
+    FVMSymbol symbol;
+    symbol.name = strdup(names + symbols[i].name);
+    symbol.kind = (FVMSymbolKind)symbols[i].kind;
+    symbol.address = symbols[i].address;
+
+    if (!symbol.name) {
+      fprintf(stderr, "ERROR: failed to allocate memory!\n");
+      exit(1);
+    }
+
+    cvector_push_back(object->symbols, symbol);
+  }
+
+  for (int64_t i = 0; ok && i < header->relocations_len; i++)
+    cvector_push_back(object->relocations, relocations[i]);
+
+  free(code);
+  free(symbols);
+  free(relocations);
+  free(names);
+
+  return ok;
+}
+
+bool fvm_object_read(FVMObject* object, const char* path) {
+  object->code = NULL;
+  object->symbols = NULL;
+  object->relocations = NULL;
+
+  FILE* file = fopen(path, "rb");
+
+  if (!file) {
+    fprintf(stderr, "ERROR: cannot open: '%s'\n", path);
+    return false;
+  }
+
+  ObjectHeader header;
+
+  bool ok = fread(&header, sizeof(header), 1, file) == 1 && header.magic == OBJECT_MAGIC &&
+            header.version == OBJECT_VERSION && header.code_len >= 0 && header.symbols_len >= 0 &&
+            header.relocations_len >= 0 && header.names_len >= 0 && read_body(object, &header, file);
+
+  fclose(file);
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: not a valid object: '%s'\n", path);
+    fvm_object_free(object);
+  }
+
+  return ok;
+}
+
+static int64_t find_global(const FVMObject* object, const char* name) {
+  for (size_t i = 0; i < cvector_size(object->symbols); i++) {
+    if (object->symbols[i].kind == FVM_SYMBOL_GLOBAL && strcmp(object->symbols[i].name, name) == 0)
+      return (int64_t)i;
+  }
+
+  return -1;
+}
+
+void fvm_object_link(const FVMObject* objects, size_t count, FVMObject* linked) {
+  linked->code = NULL;
+  linked->symbols = NULL;
+  linked->relocations = NULL;
+
+  /* where each object's symbols ended up in the linked one. */
+  int64_t** symbol_map = calloc(count, sizeof(int64_t*));
+  int64_t* bases = calloc(count, sizeof(int64_t));
+
+  if (!symbol_map || !bases) {
+    fprintf(stderr, "ERROR: failed to allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const FVMObject* object = &objects[i];
+
+    bases[i] = (int64_t)cvector_size(linked->code);
+    symbol_map[i] = calloc(cvector_size(object->symbols) + 1, sizeof(int64_t));
+
+    if (!symbol_map[i]) {
+      fprintf(stderr, "ERROR: failed to allocate memory!\n");
+      exit(1);
+    }
+
+    for (int64_t* it = cvector_begin(object->code); it != cvector_end(object->code); ++it)
+      cvector_push_back(linked->code, *it);
+
+    for (size_t j = 0; j < cvector_size(object->symbols); j++) {
+      const FVMSymbol* it = &object->symbols[j];
+
+      if (it->kind == FVM_SYMBOL_IMPORT)
+        continue;
+
+      if (it->kind == FVM_SYMBOL_GLOBAL && find_global(linked, it->name) != -1) {
+        fvm_failf("symbol defined more than once: '%s'", it->name);
+      }
+
+      FVMSymbol symbol;
+      symbol.name = strdup(it->name);
+      symbol.kind = it->kind;
+      symbol.address = bases[i] + it->address;
+
+      if (!symbol.name) {
+        fprintf(stderr, "ERROR: failed to allocate memory!\n");
+        exit(1);
+      }
+
+      symbol_map[i][j] = (int64_t)cvector_size(linked->symbols);
+      cvector_push_back(linked->symbols, symbol);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    const FVMObject* object = &objects[i];
+
+    for (size_t j = 0; j < cvector_size(object->symbols); j++) {
+      if (object->symbols[j].kind != FVM_SYMBOL_IMPORT)
+        continue;
+
+      symbol_map[i][j] = find_global(linked, object->symbols[j].name);
+
+      if (symbol_map[i][j] == -1) {
+        fvm_failf("undefined symbol: '%s'", object->symbols[j].name);
+      }
+    }
+
+    for (FVMRelocation* it = cvector_begin(object->relocations); it != cvector_end(object->relocations); ++it) {
+      FVMRelocation relocation;
+      relocation.offset = bases[i] + it->offset;
+      relocation.symbol = symbol_map[i][it->symbol];
+
+      linked->code[relocation.offset] = linked->symbols[relocation.symbol].address;
+      cvector_push_back(linked->relocations, relocation);
+    }
+
+    free(symbol_map[i]);
+  }
+
+  free(symbol_map);
+  free(bases);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cvector.h"
+
+/* a relocatable object is the code of one assembled file together with
+ * its labels, kept relative to its first cell, and a relocation for every
+ * cell that holds a label's address. labels are local to the file unless
+ * it names them with the global directive; a label it uses without
+ * defining becomes an import that some other object has to export. fvm-ld
+ * links objects into one module, which is an object again, with every
+ * import resolved. */
+typedef enum FVMSymbolKind {
+  FVM_SYMBOL_LOCAL,
+  FVM_SYMBOL_GLOBAL,
+  FVM_SYMBOL_IMPORT,
+} FVMSymbolKind;
+
+typedef struct FVMSymbol {
+  char* name;
+  FVMSymbolKind kind;
+  /* unused for imports. */
+  int64_t address;
+} FVMSymbol;
+
+typedef struct FVMRelocation {
+  /* the code cell that gets the symbol's address. */
+  int64_t offset;
+  int64_t symbol;
+} FVMRelocation;
+
+typedef struct FVMObject {
+  cvector_vector_type(int64_t) code;
+  cvector_vector_type(FVMSymbol) symbols;
+  cvector_vector_type(FVMRelocation) relocations;
+} FVMObject;
+
+void fvm_object_free(FVMObject* object);
+
+/* whether path starts like an object, as opposed to assembly. */
+bool fvm_object_file(const char* path);
+
+bool fvm_object_write(const FVMObject* object, const char* path);
+bool fvm_object_read(FVMObject* object, const char* path);
+
+/* lays out count objects one after the other, in order, and resolves
+ * every import against the globals of all of them. exits on a global
+ * defined twice or an import nobody defines. */
+void fvm_object_link(const FVMObject* objects, size_t count, FVMObject* linked);
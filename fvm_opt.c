@@ -0,0 +1,2005 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fvm_opt.h"
+
+#define NODE_OPERANDS 4
+#define MAX_ROUNDS 16
+#define EVAL_FUEL 1000000
+#define EVAL_STACK 4096
+/* the most nodes a loop body is unrolled to. */
+#define UNROLL_NODES 16
+
+/* the flags are tracked as one more register slot after the real ones. */
+#define SLOT_FLAGS REG_SIZE
+#define SLOT_SIZE (REG_SIZE + 1)
+#define REGISTER_SLOTS ((1ull << REG_SIZE) - 1)
+
+typedef struct Node {
+  int64_t op;
+  /* jump targets hold node indices while optimizing. */
+  int64_t args[NODE_OPERANDS];
+  /* the entries of a jtab, node indices like the other targets. NULL for
+   * everything else. */
+  cvector_vector_type(int64_t) table;
+  int64_t address;
+  bool removed;
+} Node;
+
+typedef enum ValueKind {
+  VALUE_UNDEF,
+  VALUE_CONST,
+  VALUE_UNKNOWN,
+} ValueKind;
+
+typedef struct Value {
+  ValueKind kind;
+  int64_t value;
+} Value;
+
+typedef struct State {
+  Value slots[SLOT_SIZE];
+} State;
+
+typedef struct Block {
+  size_t first;
+  size_t last;
+  cvector_vector_type(size_t) succs;
+  cvector_vector_type(size_t) preds;
+  bool visited;
+  /* a spawn target, where fibers start with registers copied from wherever
+   * they were spawned. */
+  bool entry;
+  State in;
+  uint64_t live_in;
+  uint64_t live_out;
+} Block;
+
+static cvector_vector_type(Node) g_nodes;
+static cvector_vector_type(Block) g_blocks;
+static cvector_vector_type(size_t) g_block_of;
+static bool g_fresh;
+
+static const InstructionInfo* info_of(const Node* node) {
+  return instruction_info(node->op);
+}
+
+static size_t node_length(const Node* node) {
+  return 1 + strlen(info_of(node)->operands) + cvector_size(node->table);
+}
+
+/* a node's jump targets are its 't' operands followed by the entries of its
+ * jump table. */
+static size_t target_count(const Node* node) {
+  const InstructionInfo* info = info_of(node);
+  size_t count = cvector_size(node->table);
+
+  for (size_t i = 0; info->operands[i]; i++)
+    count += info->operands[i] == 't';
+
+  return count;
+}
+
+static int64_t* target_at(Node* node, size_t index) {
+  const InstructionInfo* info = info_of(node);
+
+  for (size_t i = 0; info->operands[i]; i++) {
+    if (info->operands[i] != 't')
+      continue;
+
+    if (index == 0)
+      return &node->args[i];
+
+    index -= 1;
+  }
+
+  return &node->table[index];
+}
+
+static void free_nodes() {
+  for (Node* it = cvector_begin(g_nodes); it != cvector_end(g_nodes); ++it)
+    cvector_free(it->table);
+
+  cvector_free(g_nodes);
+  g_nodes = NULL;
+}
+
+static size_t node_count() {
+  return cvector_size(g_nodes);
+}
+
+static size_t next_live(size_t index) {
+  while (index < node_count() && g_nodes[index].removed)
+    index += 1;
+
+  return index;
+}
+
+/* the flag jump that takes the same branch as a fused compare and branch,
+ * op itself for anything else. */
+static int64_t flag_form(int64_t op) {
+  switch (op) {
+  case INS_JE3:
+  case INS_JE3I:
+    return INS_JEI;
+  case INS_JNE3:
+  case INS_JNE3I:
+    return INS_JNEI;
+  case INS_JG3:
+  case INS_JG3I:
+    return INS_JGI;
+  case INS_JL3:
+  case INS_JL3I:
+    return INS_JLI;
+  case INS_JGE3:
+  case INS_JGE3I:
+    return INS_JGEI;
+  case INS_JLE3:
+  case INS_JLE3I:
+    return INS_JLEI;
+  default:
+    return op;
+  }
+}
+
+static bool is_fused(int64_t op) {
+  return flag_form(op) != op;
+}
+
+/* the fused compare and branch for a flag jump right after cmp, -1 if there
+ * is none. */
+static int64_t fused_form(int64_t op, bool immediate) {
+  switch (op) {
+  case INS_JEI:
+    return immediate ? INS_JE3I : INS_JE3;
+  case INS_JNEI:
+    return immediate ? INS_JNE3I : INS_JNE3;
+  case INS_JGI:
+    return immediate ? INS_JG3I : INS_JG3;
+  case INS_JLI:
+    return immediate ? INS_JL3I : INS_JL3;
+  case INS_JGEI:
+    return immediate ? INS_JGE3I : INS_JGE3;
+  case INS_JLEI:
+    return immediate ? INS_JLE3I : INS_JLE3;
+  default:
+    return -1;
+  }
+}
+
+static bool is_conditional(int64_t op) {
+  switch (flag_form(op)) {
+  case INS_JEI:
+  case INS_JNEI:
+  case INS_JGI:
+  case INS_JLI:
+  case INS_JGEI:
+  case INS_JLEI:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/* which operand a jump to a label has its target in: the last one for a
+ * fused compare and branch, the first for the rest. */
+static size_t target_arg(int64_t op) {
+  return is_fused(op) ? 2 : 0;
+}
+
+static bool is_register_kind(char kind) {
+  return kind == 'r' || kind == 'w' || kind == 'm';
+}
+
+static uint64_t slot_bit(int64_t slot) {
+  return 1ull << slot;
+}
+
+static uint64_t node_uses(const Node* node) {
+  const InstructionInfo* info = info_of(node);
+  uint64_t uses = 0;
+
+  for (size_t i = 0; info->operands[i]; i++) {
+    if (info->operands[i] == 'r' || info->operands[i] == 'm')
+      uses |= slot_bit(node->args[i]);
+  }
+
+  switch (node->op) {
+  case INS_HALT:
+    uses |= REGISTER_SLOTS;
+    break;
+  case INS_PUSH:
+  case INS_PUSHI:
+  case INS_POP:
+    uses |= slot_bit(REG_SP);
+    break;
+  case INS_ENTER:
+    uses |= slot_bit(REG_SP) | slot_bit(REG_FP);
+    break;
+  case INS_LEAVE:
+  case INS_LOAD:
+  case INS_STORE:
+    uses |= slot_bit(REG_FP);
+    break;
+  case INS_NATIVE:
+  case INS_SPAWN:
+    uses |= slot_bit(REG_A) | slot_bit(REG_B) | slot_bit(REG_C) |
+            slot_bit(REG_D) | slot_bit(REG_E) | slot_bit(REG_F);
+    break;
+  default:
+    if (is_conditional(node->op) && !is_fused(node->op))
+      uses |= slot_bit(SLOT_FLAGS);
+  }
+
+  return uses;
+}
+
+static uint64_t node_defs(const Node* node) {
+  const InstructionInfo* info = info_of(node);
+  uint64_t defs = 0;
+
+  for (size_t i = 0; info->operands[i]; i++) {
+    if (info->operands[i] == 'w' || info->operands[i] == 'm')
+      defs |= slot_bit(node->args[i]);
+  }
+
+  switch (node->op) {
+  case INS_PUSH:
+  case INS_PUSHI:
+  case INS_POP:
+    defs |= slot_bit(REG_SP);
+    break;
+  case INS_ENTER:
+  case INS_LEAVE:
+    defs |= slot_bit(REG_SP) | slot_bit(REG_FP);
+    break;
+  case INS_CMP:
+  case INS_CMPI:
+  case INS_MCMP:
+  case INS_CAS:
+    defs |= slot_bit(SLOT_FLAGS);
+    break;
+  case INS_NATIVE:
+  case INS_SPAWN:
+    defs |= slot_bit(REG_A);
+    break;
+  }
+
+  return defs;
+}
+
+/* instructions that only write their registers and cannot trap. */
+static bool is_pure(const Node* node) {
+  switch (node->op) {
+  case INS_MOV:
+  case INS_MOVI:
+  case INS_ADD:
+  case INS_ADDI:
+  case INS_SUB:
+  case INS_SUBI:
+  case INS_MUL:
+  case INS_MULI:
+  case INS_CMP:
+  case INS_CMPI:
+  case INS_ADD3:
+  case INS_ADD3I:
+  case INS_SUB3:
+  case INS_SUB3I:
+  case INS_MUL3:
+  case INS_MUL3I:
+    return true;
+  case INS_DIVI:
+    return node->args[1] != 0 && node->args[1] != -1;
+  case INS_DIV3I:
+    return node->args[2] != 0 && node->args[2] != -1;
+  default:
+    return false;
+  }
+}
+
+static bool compute(int64_t op, int64_t a, int64_t b, int64_t* result) {
+  switch (op) {
+  case INS_ADD:
+  case INS_ADDI:
+  case INS_ADD3:
+  case INS_ADD3I:
+    *result = (int64_t)((uint64_t)a + (uint64_t)b);
+    return true;
+  case INS_SUB:
+  case INS_SUBI:
+  case INS_SUB3:
+  case INS_SUB3I:
+    *result = (int64_t)((uint64_t)a - (uint64_t)b);
+    return true;
+  case INS_MUL:
+  case INS_MULI:
+  case INS_MUL3:
+  case INS_MUL3I:
+    *result = (int64_t)((uint64_t)a * (uint64_t)b);
+    return true;
+  case INS_DIV:
+  case INS_DIVI:
+  case INS_DIV3:
+  case INS_DIV3I:
+    if (b == 0 || (a == INT64_MIN && b == -1))
+      return false;
+
+    *result = a / b;
+    return true;
+  default:
+    return false;
+  }
+}
+
+static int64_t compare(int64_t a, int64_t b) {
+  return (a == b) | (a > b) << 1 | (a < b) << 2;
+}
+
+static bool is_taken(int64_t op, int64_t flags) {
+  switch (op) {
+  case INS_JEI:
+    return flags & 1;
+  case INS_JNEI:
+    return !(flags & 1);
+  case INS_JGI:
+    return flags & 2;
+  case INS_JLI:
+    return flags & 4;
+  case INS_JGEI:
+    return flags & 3;
+  case INS_JLEI:
+    return flags & 5;
+  default:
+    return true;
+  }
+}
+
+/* 1 when a conditional jump is known to be taken with what slots hold, 0
+ * when it is known not to be and -1 when that depends. */
+static int branch_outcome(const Node* node, const Value* slots) {
+  int64_t flags;
+
+  if (is_fused(node->op)) {
+    bool immediate = info_of(node)->operands[1] == 'i';
+    const Value* a = &slots[node->args[0]];
+    const Value* b = &slots[node->args[1]];
+
+    if (a->kind != VALUE_CONST || (!immediate && b->kind != VALUE_CONST))
+      return -1;
+
+    flags = compare(a->value, immediate ? node->args[1] : b->value);
+  } else {
+    if (slots[SLOT_FLAGS].kind != VALUE_CONST)
+      return -1;
+
+    flags = slots[SLOT_FLAGS].value;
+  }
+
+  return is_taken(flag_form(node->op), flags);
+}
+
+static bool decode(const int64_t* instructions, size_t length) {
+  cvector_vector_type(int64_t) node_at = NULL;
+
+  for (size_t i = 0; i < length; i++)
+    cvector_push_back(node_at, -1);
+
+  for (size_t address = 0; address < length;) {
+    const InstructionInfo* info = instruction_info(instructions[address]);
+
+    if (!info || instruction_length(info, &instructions[address], length - address) > length - address)
+      goto fail;
+
+    Node node;
+    memset(&node, 0, sizeof(node));
+    node.op = instructions[address];
+    node.address = (int64_t)address;
+
+    for (size_t i = 0; info->operands[i]; i++) {
+      char kind = info->operands[i];
+      node.args[i] = instructions[address + 1 + i];
+
+      if (is_register_kind(kind) && (node.args[i] < 0 || node.args[i] >= REG_SIZE))
+        goto fail;
+
+      /* IP's value depends on where the code ends up. */
+      if (is_register_kind(kind) && node.args[i] == REG_IP)
+        goto fail;
+
+      if (kind == 'r' && jumps_through_register(info))
+        goto fail;
+    }
+
+    size_t size = instruction_length(info, &instructions[address], length - address);
+
+    /* a jump table is a multi-way branch, its entries are targets like
+     * any other. */
+    for (size_t i = jump_table_offset(info); i && i < size; i++)
+      cvector_push_back(node.table, instructions[address + i]);
+
+    node_at[address] = (int64_t)node_count();
+    cvector_push_back(g_nodes, node);
+    address += size;
+  }
+
+  for (Node* it = cvector_begin(g_nodes); it != cvector_end(g_nodes); ++it) {
+    for (size_t i = 0; i < target_count(it); i++) {
+      int64_t* target = target_at(it, i);
+
+      if (*target < 0 || (size_t)*target >= length || node_at[*target] == -1)
+        goto fail;
+
+      *target = node_at[*target];
+    }
+  }
+
+  cvector_free(node_at);
+  return true;
+
+fail:
+  cvector_free(node_at);
+  return false;
+}
+
+static void free_blocks() {
+  for (Block* it = cvector_begin(g_blocks); it != cvector_end(g_blocks); ++it) {
+    cvector_free(it->succs);
+    cvector_free(it->preds);
+  }
+
+  cvector_free(g_blocks);
+  g_blocks = NULL;
+}
+
+static void add_edge(size_t from, size_t node) {
+  node = next_live(node);
+
+  if (node >= node_count())
+    return;
+
+  size_t to = g_block_of[node];
+
+  for (size_t* it = cvector_begin(g_blocks[from].succs); it != cvector_end(g_blocks[from].succs); ++it) {
+    if (*it == to)
+      return;
+  }
+
+  cvector_push_back(g_blocks[from].succs, to);
+  cvector_push_back(g_blocks[to].preds, from);
+}
+
+static void build_blocks() {
+  free_blocks();
+  cvector_clear(g_block_of);
+
+  cvector_vector_type(bool) leader = NULL;
+
+  for (size_t i = 0; i < node_count(); i++) {
+    cvector_push_back(leader, false);
+    cvector_push_back(g_block_of, 0);
+  }
+
+  bool after_branch = true;
+
+  for (size_t i = 0; i < node_count(); i++) {
+    Node* node = &g_nodes[i];
+
+    if (node->removed)
+      continue;
+
+    if (after_branch)
+      leader[i] = true;
+
+    for (size_t j = 0; j < target_count(node); j++) {
+      size_t target = next_live((size_t)*target_at(node, j));
+
+      if (target < node_count())
+        leader[target] = true;
+    }
+
+    after_branch = info_of(node)->branch;
+  }
+
+  for (size_t i = 0; i < node_count(); i++) {
+    if (g_nodes[i].removed)
+      continue;
+
+    if (leader[i]) {
+      Block block;
+      memset(&block, 0, sizeof(block));
+      block.first = i;
+      cvector_push_back(g_blocks, block);
+    }
+
+    g_blocks[cvector_size(g_blocks) - 1].last = i;
+    g_block_of[i] = cvector_size(g_blocks) - 1;
+  }
+
+  cvector_free(leader);
+
+  for (size_t i = 0; i < node_count(); i++) {
+    if (g_nodes[i].removed || g_nodes[i].op != INS_SPAWN)
+      continue;
+
+    size_t target = next_live((size_t)g_nodes[i].args[0]);
+
+    if (target < node_count())
+      g_blocks[g_block_of[target]].entry = true;
+  }
+
+  for (size_t b = 0; b < cvector_size(g_blocks); b++) {
+    Node* last = &g_nodes[g_blocks[b].last];
+
+    switch (last->op) {
+    case INS_HALT:
+      break;
+    case INS_JMPI:
+    case INS_CALLI:
+      add_edge(b, (size_t)last->args[0]);
+      break;
+    case INS_JTAB:
+      /* an index outside the table goes on with the next node. */
+      for (size_t i = 0; i < cvector_size(last->table); i++)
+        add_edge(b, (size_t)last->table[i]);
+
+      add_edge(b, g_blocks[b].last + 1);
+      break;
+    case INS_RET:
+      /* a return can land after any call. */
+      for (size_t i = 0; i < node_count(); i++) {
+        if (!g_nodes[i].removed && g_nodes[i].op == INS_CALLI)
+          add_edge(b, i + 1);
+      }
+      break;
+    default:
+      if (is_conditional(last->op))
+        add_edge(b, (size_t)last->args[target_arg(last->op)]);
+
+      add_edge(b, g_blocks[b].last + 1);
+    }
+  }
+}
+
+static Value value_const(int64_t value) {
+  Value result;
+  result.kind = VALUE_CONST;
+  result.value = value;
+
+  return result;
+}
+
+static Value value_unknown() {
+  Value result;
+  result.kind = VALUE_UNKNOWN;
+  result.value = 0;
+
+  return result;
+}
+
+static bool state_join(State* into, const State* from) {
+  bool changed = false;
+
+  for (size_t i = 0; i < SLOT_SIZE; i++) {
+    Value* a = &into->slots[i];
+    const Value* b = &from->slots[i];
+
+    if (b->kind == VALUE_UNDEF || a->kind == VALUE_UNKNOWN)
+      continue;
+
+    if (a->kind == VALUE_UNDEF) {
+      *a = *b;
+      changed = true;
+    } else if (b->kind == VALUE_UNKNOWN || a->value != b->value) {
+      *a = value_unknown();
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+static void entry_state(State* state) {
+  for (size_t i = 0; i < SLOT_SIZE; i++)
+    state->slots[i] = g_fresh ? value_const(0) : value_unknown();
+
+  if (g_fresh) {
+    state->slots[REG_SP] = value_const(-1);
+    state->slots[REG_FP] = value_const(-1);
+  }
+}
+
+static void transfer(State* state, const Node* node) {
+  Value* slots = state->slots;
+  const int64_t* args = node->args;
+  int64_t result;
+
+  switch (node->op) {
+  case INS_MOV:
+    slots[args[0]] = slots[args[1]];
+    break;
+  case INS_MOVI:
+    slots[args[0]] = value_const(args[1]);
+    break;
+  case INS_ADD:
+  case INS_SUB:
+  case INS_MUL:
+  case INS_DIV:
+    if (slots[args[0]].kind == VALUE_CONST && slots[args[1]].kind == VALUE_CONST &&
+        compute(node->op, slots[args[0]].value, slots[args[1]].value, &result))
+      slots[args[0]] = value_const(result);
+    else
+      slots[args[0]] = value_unknown();
+    break;
+  case INS_ADDI:
+  case INS_SUBI:
+  case INS_MULI:
+  case INS_DIVI:
+    if (slots[args[0]].kind == VALUE_CONST && compute(node->op, slots[args[0]].value, args[1], &result))
+      slots[args[0]] = value_const(result);
+    else
+      slots[args[0]] = value_unknown();
+    break;
+  case INS_ADD3:
+  case INS_SUB3:
+  case INS_MUL3:
+  case INS_DIV3:
+    if (slots[args[1]].kind == VALUE_CONST && slots[args[2]].kind == VALUE_CONST &&
+        compute(node->op, slots[args[1]].value, slots[args[2]].value, &result))
+      slots[args[0]] = value_const(result);
+    else
+      slots[args[0]] = value_unknown();
+    break;
+  case INS_ADD3I:
+  case INS_SUB3I:
+  case INS_MUL3I:
+  case INS_DIV3I:
+    if (slots[args[1]].kind == VALUE_CONST && compute(node->op, slots[args[1]].value, args[2], &result))
+      slots[args[0]] = value_const(result);
+    else
+      slots[args[0]] = value_unknown();
+    break;
+  case INS_CMP:
+    if (slots[args[0]].kind == VALUE_CONST && slots[args[1]].kind == VALUE_CONST)
+      slots[SLOT_FLAGS] = value_const(compare(slots[args[0]].value, slots[args[1]].value));
+    else
+      slots[SLOT_FLAGS] = value_unknown();
+    break;
+  case INS_CMPI:
+    if (slots[args[0]].kind == VALUE_CONST)
+      slots[SLOT_FLAGS] = value_const(compare(slots[args[0]].value, args[1]));
+    else
+      slots[SLOT_FLAGS] = value_unknown();
+    break;
+  case INS_PUSH:
+  case INS_PUSHI:
+    if (slots[REG_SP].kind == VALUE_CONST)
+      slots[REG_SP] = value_const(slots[REG_SP].value + 1);
+    break;
+  case INS_POP:
+    slots[args[0]] = value_unknown();
+
+    if (slots[REG_SP].kind == VALUE_CONST && args[0] != REG_SP)
+      slots[REG_SP] = value_const(slots[REG_SP].value - 1);
+    else
+      slots[REG_SP] = value_unknown();
+    break;
+  case INS_ENTER:
+    slots[REG_FP] = slots[REG_SP];
+
+    if (slots[REG_SP].kind == VALUE_CONST)
+      slots[REG_SP] = value_const(slots[REG_SP].value + args[0]);
+    break;
+  case INS_LEAVE:
+    slots[REG_SP] = slots[REG_FP];
+    slots[REG_FP] = value_unknown();
+    break;
+  default: {
+    uint64_t defs = node_defs(node);
+
+    for (size_t i = 0; i < SLOT_SIZE; i++) {
+      if (defs & slot_bit((int64_t)i))
+        slots[i] = value_unknown();
+    }
+  }
+  }
+}
+
+/* sparse conditional constant propagation over the blocks: only edges that
+ * can be taken with what is known so far are followed. */
+static void propagate(size_t block, State* out) {
+  Block* it = &g_blocks[block];
+  *out = it->in;
+
+  for (size_t i = it->first; i <= it->last; i++) {
+    if (!g_nodes[i].removed)
+      transfer(out, &g_nodes[i]);
+  }
+}
+
+static void analyze_constants() {
+  for (Block* it = cvector_begin(g_blocks); it != cvector_end(g_blocks); ++it) {
+    it->visited = false;
+
+    for (size_t i = 0; i < SLOT_SIZE; i++)
+      it->in.slots[i].kind = VALUE_UNDEF;
+  }
+
+  if (cvector_empty(g_blocks))
+    return;
+
+  cvector_vector_type(size_t) worklist = NULL;
+  entry_state(&g_blocks[0].in);
+  g_blocks[0].visited = true;
+  cvector_push_back(worklist, 0);
+
+  /* a fiber knows nothing but its fresh stack. */
+  for (size_t b = 0; b < cvector_size(g_blocks); b++) {
+    if (!g_blocks[b].entry)
+      continue;
+
+    for (size_t i = 0; i < SLOT_SIZE; i++)
+      g_blocks[b].in.slots[i] = value_unknown();
+
+    g_blocks[b].in.slots[REG_SP] = value_const(-1);
+    g_blocks[b].in.slots[REG_FP] = value_const(-1);
+    g_blocks[b].visited = true;
+    cvector_push_back(worklist, b);
+  }
+
+  while (!cvector_empty(worklist)) {
+    size_t block = worklist[cvector_size(worklist) - 1];
+    cvector_pop_back(worklist);
+
+    State out;
+    propagate(block, &out);
+
+    Node* last = &g_nodes[g_blocks[block].last];
+    int outcome = is_conditional(last->op) ? branch_outcome(last, out.slots) : -1;
+
+    for (size_t* succ = cvector_begin(g_blocks[block].succs); succ != cvector_end(g_blocks[block].succs); ++succ) {
+      if (outcome != -1) {
+        bool taken = outcome;
+        size_t target = g_block_of[next_live((size_t)last->args[target_arg(last->op)])];
+        size_t fallthrough = g_blocks[block].last + 1 < node_count() ? next_live(g_blocks[block].last + 1) : node_count();
+
+        if (taken && *succ != target)
+          continue;
+
+        if (!taken && (fallthrough >= node_count() || *succ != g_block_of[fallthrough]))
+          continue;
+      }
+
+      Block* to = &g_blocks[*succ];
+
+      if (state_join(&to->in, &out) || !to->visited) {
+        to->visited = true;
+        cvector_push_back(worklist, *succ);
+      }
+    }
+  }
+
+  cvector_free(worklist);
+}
+
+static bool set_node(Node* node, int64_t op, int64_t a, int64_t b) {
+  if (node->op == op && node->args[0] == a && node->args[1] == b)
+    return false;
+
+  node->op = op;
+  node->args[0] = a;
+  node->args[1] = b;
+
+  return true;
+}
+
+static int64_t immediate_form(int64_t op) {
+  switch (op) {
+  case INS_MOV:
+    return INS_MOVI;
+  case INS_ADD:
+    return INS_ADDI;
+  case INS_SUB:
+    return INS_SUBI;
+  case INS_MUL:
+    return INS_MULI;
+  case INS_DIV:
+    return INS_DIVI;
+  case INS_CMP:
+    return INS_CMPI;
+  default:
+    return -1;
+  }
+}
+
+static int64_t single_immediate_form(int64_t op) {
+  switch (op) {
+  case INS_PUSH:
+    return INS_PUSHI;
+  case INS_PUTC:
+    return INS_PUTCI;
+  case INS_PUTI:
+    return INS_PUTII;
+  default:
+    return -1;
+  }
+}
+
+/* add A, B, C becomes add A, B, 5 once C is known, je A, B, label becomes
+ * je A, 5, label once B is. returns the operand that turns immediate. */
+static int64_t fused_immediate_form(int64_t op, size_t* operand) {
+  *operand = is_fused(op) ? 1 : 2;
+
+  switch (op) {
+  case INS_ADD3:
+    return INS_ADD3I;
+  case INS_SUB3:
+    return INS_SUB3I;
+  case INS_MUL3:
+    return INS_MUL3I;
+  case INS_DIV3:
+    return INS_DIV3I;
+  case INS_JE3:
+    return INS_JE3I;
+  case INS_JNE3:
+    return INS_JNE3I;
+  case INS_JG3:
+    return INS_JG3I;
+  case INS_JL3:
+    return INS_JL3I;
+  case INS_JGE3:
+    return INS_JGE3I;
+  case INS_JLE3:
+    return INS_JLE3I;
+  default:
+    return -1;
+  }
+}
+
+static bool fold_constants() {
+  bool changed = false;
+
+  analyze_constants();
+
+  for (Block* block = cvector_begin(g_blocks); block != cvector_end(g_blocks); ++block) {
+    if (!block->visited) {
+      for (size_t i = block->first; i <= block->last; i++)
+        g_nodes[i].removed = true;
+
+      changed = true;
+      continue;
+    }
+
+    State state = block->in;
+
+    for (size_t i = block->first; i <= block->last; i++) {
+      Node* node = &g_nodes[i];
+
+      if (node->removed)
+        continue;
+
+      Value* slots = state.slots;
+
+      int outcome = is_conditional(node->op) ? branch_outcome(node, slots) : -1;
+
+      /* a known index picks one entry, or the default case. */
+      if (node->op == INS_JTAB && slots[node->args[0]].kind == VALUE_CONST) {
+        uint64_t index = (uint64_t)slots[node->args[0]].value;
+
+        if (index < cvector_size(node->table)) {
+          node->args[0] = node->table[index];
+          node->op = INS_JMPI;
+        } else {
+          node->removed = true;
+        }
+
+        cvector_free(node->table);
+        node->table = NULL;
+        changed = true;
+        continue;
+      }
+
+      if (outcome != -1) {
+        if (outcome) {
+          node->args[0] = node->args[target_arg(node->op)];
+          node->op = INS_JMPI;
+        } else {
+          node->removed = true;
+        }
+
+        changed = true;
+        continue;
+      }
+
+      State after = state;
+      transfer(&after, node);
+
+      if (is_pure(node) || node->op == INS_DIV || node->op == INS_DIV3) {
+        int64_t dest = node->args[0];
+        uint64_t defs = node_defs(node);
+
+        if (!(defs & slot_bit(SLOT_FLAGS)) && after.slots[dest].kind == VALUE_CONST)
+          changed |= set_node(node, INS_MOVI, dest, after.slots[dest].value);
+      }
+
+      int64_t immediate = immediate_form(node->op);
+
+      if (immediate != -1 && slots[node->args[1]].kind == VALUE_CONST &&
+          !(node->op == INS_DIV && slots[node->args[1]].value == 0))
+        changed |= set_node(node, immediate, node->args[0], slots[node->args[1]].value);
+
+      immediate = single_immediate_form(node->op);
+
+      if (immediate != -1 && slots[node->args[0]].kind == VALUE_CONST)
+        changed |= set_node(node, immediate, slots[node->args[0]].value, 0);
+
+      size_t operand;
+      immediate = fused_immediate_form(node->op, &operand);
+
+      if (immediate != -1 && slots[node->args[operand]].kind == VALUE_CONST &&
+          !(node->op == INS_DIV3 && slots[node->args[operand]].value == 0)) {
+        node->op = immediate;
+        node->args[operand] = slots[node->args[operand]].value;
+        changed = true;
+      }
+
+      state = after;
+    }
+  }
+
+  return changed;
+}
+
+static bool propagate_copies() {
+  bool changed = false;
+
+  for (Block* block = cvector_begin(g_blocks); block != cvector_end(g_blocks); ++block) {
+    int64_t copy_of[SLOT_SIZE];
+
+    for (size_t i = 0; i < SLOT_SIZE; i++)
+      copy_of[i] = -1;
+
+    for (size_t i = block->first; i <= block->last; i++) {
+      Node* node = &g_nodes[i];
+
+      if (node->removed)
+        continue;
+
+      const InstructionInfo* info = info_of(node);
+
+      for (size_t j = 0; info->operands[j]; j++) {
+        if (info->operands[j] == 'r' && copy_of[node->args[j]] != -1) {
+          node->args[j] = copy_of[node->args[j]];
+          changed = true;
+        }
+      }
+
+      uint64_t defs = node_defs(node);
+
+      for (size_t slot = 0; slot < SLOT_SIZE; slot++) {
+        if ((defs & slot_bit((int64_t)slot)) || (copy_of[slot] != -1 && (defs & slot_bit(copy_of[slot]))))
+          copy_of[slot] = -1;
+      }
+
+      if (node->op == INS_MOV && node->args[0] != node->args[1])
+        copy_of[node->args[0]] = node->args[1];
+    }
+  }
+
+  return changed;
+}
+
+static void analyze_liveness() {
+  bool changed = true;
+
+  for (Block* it = cvector_begin(g_blocks); it != cvector_end(g_blocks); ++it) {
+    it->live_in = 0;
+    it->live_out = 0;
+  }
+
+  while (changed) {
+    changed = false;
+
+    for (size_t b = cvector_size(g_blocks); b-- > 0;) {
+      Block* block = &g_blocks[b];
+      uint64_t live = 0;
+
+      for (size_t* succ = cvector_begin(block->succs); succ != cvector_end(block->succs); ++succ)
+        live |= g_blocks[*succ].live_in;
+
+      block->live_out = live;
+
+      for (size_t i = block->last + 1; i-- > block->first;) {
+        if (!g_nodes[i].removed)
+          live = (live & ~node_defs(&g_nodes[i])) | node_uses(&g_nodes[i]);
+      }
+
+      if (live != block->live_in) {
+        block->live_in = live;
+        changed = true;
+      }
+    }
+  }
+}
+
+static bool eliminate_dead_code() {
+  bool changed = false;
+
+  analyze_liveness();
+
+  for (Block* block = cvector_begin(g_blocks); block != cvector_end(g_blocks); ++block) {
+    uint64_t live = block->live_out;
+
+    for (size_t i = block->last + 1; i-- > block->first;) {
+      Node* node = &g_nodes[i];
+
+      if (node->removed)
+        continue;
+
+      uint64_t defs = node_defs(node);
+      bool self_move = node->op == INS_MOV && node->args[0] == node->args[1];
+
+      if (self_move || (is_pure(node) && !(defs & live))) {
+        node->removed = true;
+        changed = true;
+        continue;
+      }
+
+      live = (live & ~defs) | node_uses(node);
+    }
+  }
+
+  return changed;
+}
+
+/* cmp and the flag jump right after it become one compare and branch when
+ * nothing after the jump reads the flags, which saves a dispatch every time
+ * the pair runs. */
+static bool fuse_compares() {
+  bool changed = false;
+
+  analyze_liveness();
+
+  for (Block* block = cvector_begin(g_blocks); block != cvector_end(g_blocks); ++block) {
+    Node* jump = &g_nodes[block->last];
+    int64_t fused = fused_form(jump->op, false);
+
+    if (fused == -1 || (block->live_out & slot_bit(SLOT_FLAGS)))
+      continue;
+
+    size_t i = block->last;
+
+    while (i > block->first && g_nodes[i - 1].removed)
+      i -= 1;
+
+    if (i == block->first)
+      continue;
+
+    Node* cmp = &g_nodes[i - 1];
+
+    if (cmp->op != INS_CMP && cmp->op != INS_CMPI)
+      continue;
+
+    jump->op = fused_form(jump->op, cmp->op == INS_CMPI);
+    jump->args[2] = jump->args[0];
+    jump->args[0] = cmp->args[0];
+    jump->args[1] = cmp->args[1];
+    cmp->removed = true;
+    changed = true;
+  }
+
+  return changed;
+}
+
+static bool simplify_jumps() {
+  bool changed = false;
+
+  for (size_t i = 0; i < node_count(); i++) {
+    Node* node = &g_nodes[i];
+
+    if (node->removed || (node->op != INS_JMPI && !is_conditional(node->op) && node->op != INS_CALLI))
+      continue;
+
+    int64_t* arg = &node->args[target_arg(node->op)];
+    size_t target = next_live((size_t)*arg);
+
+    /* jumping to a jump. */
+    if (target < node_count() && target != i && g_nodes[target].op == INS_JMPI &&
+        next_live((size_t)g_nodes[target].args[0]) != target) {
+      *arg = g_nodes[target].args[0];
+      target = next_live((size_t)*arg);
+      changed = true;
+    }
+
+    if (node->op != INS_CALLI && target == next_live(i + 1)) {
+      node->removed = true;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+/* inserts a node before index, its own jump targets included. jumps to index
+ * land on the new node unless skip_new is set. */
+static void insert_node(size_t index, Node node, bool skip_new) {
+  /* kept out of next_live's way until it is in place. */
+  node.removed = true;
+  cvector_push_back(g_nodes, node);
+
+  for (Node* it = cvector_begin(g_nodes); it != cvector_end(g_nodes); ++it) {
+    for (size_t j = 0; j < target_count(it); j++) {
+      int64_t* target = target_at(it, j);
+      *target = (int64_t)next_live((size_t)*target);
+
+      if ((size_t)*target > index || ((size_t)*target == index && skip_new))
+        *target += 1;
+    }
+  }
+
+  node = g_nodes[node_count() - 1];
+  memmove(&g_nodes[index + 1], &g_nodes[index], sizeof(Node) * (node_count() - 1 - index));
+  g_nodes[index] = node;
+  g_nodes[index].removed = false;
+}
+
+/* moves one instruction out of a loop header when its operands don't change
+ * in the loop, it is the loop's only definition of its register and the
+ * value from before the loop isn't needed. loops have to be laid out
+ * contiguously and entered only through the block right before them. */
+static bool hoist_invariants() {
+  analyze_liveness();
+
+  for (size_t b = 1; b < cvector_size(g_blocks); b++) {
+    Block* header = &g_blocks[b];
+    size_t end = b;
+    size_t outside = 0;
+    bool loop = false;
+
+    for (size_t* pred = cvector_begin(header->preds); pred != cvector_end(header->preds); ++pred) {
+      if (*pred >= b) {
+        loop = true;
+
+        if (*pred > end)
+          end = *pred;
+      } else if (*pred == b - 1) {
+        outside += 1;
+      } else {
+        outside += 2;
+      }
+    }
+
+    if (!loop || outside != 1 || header->entry)
+      continue;
+
+    Block* preheader = &g_blocks[b - 1];
+    Node* preheader_last = &g_nodes[preheader->last];
+
+    if (cvector_size(preheader->succs) != 1 || (info_of(preheader_last)->branch && preheader_last->op != INS_JMPI))
+      continue;
+
+    bool single_entry = true;
+    uint64_t defs = 0;
+    int def_counts[SLOT_SIZE] = { 0 };
+
+    for (size_t l = b; l <= end; l++) {
+      for (size_t* pred = cvector_begin(g_blocks[l].preds); pred != cvector_end(g_blocks[l].preds); ++pred) {
+        if (l != b && (*pred < b || *pred > end))
+          single_entry = false;
+      }
+
+      if (g_blocks[l].entry)
+        single_entry = false;
+
+      for (size_t i = g_blocks[l].first; i <= g_blocks[l].last; i++) {
+        if (g_nodes[i].removed)
+          continue;
+
+        uint64_t node_def = node_defs(&g_nodes[i]);
+        defs |= node_def;
+
+        for (size_t slot = 0; slot < SLOT_SIZE; slot++) {
+          if (node_def & slot_bit((int64_t)slot))
+            def_counts[slot] += 1;
+        }
+      }
+    }
+
+    if (!single_entry)
+      continue;
+
+    for (size_t i = header->first; i < header->last; i++) {
+      Node* node = &g_nodes[i];
+
+      if (node->removed || !is_pure(node))
+        continue;
+
+      uint64_t node_def = node_defs(node);
+      bool invariant = !(node_uses(node) & defs) && !(node_def & header->live_in);
+
+      for (size_t slot = 0; slot < SLOT_SIZE; slot++) {
+        if ((node_def & slot_bit((int64_t)slot)) && def_counts[slot] != 1)
+          invariant = false;
+      }
+
+      if (!invariant)
+        continue;
+
+      Node hoisted = *node;
+      node->removed = true;
+
+      if (preheader_last->op == INS_JMPI)
+        insert_node(preheader->last, hoisted, false);
+      else
+        insert_node(header->first, hoisted, true);
+
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/* how many times the body of a loop runs when its counter starts out at
+ * start, moves by step in every run and the loop goes on while op, a fused
+ * compare with an immediate, is taken for the counter and bound. 0 when the
+ * counter would wrap around first. */
+static int64_t trip_count(int64_t op, int64_t start, int64_t step, int64_t bound) {
+  __int128 first = (__int128)start + step;
+  __int128 count;
+
+  if (!is_taken(flag_form(op), compare((int64_t)first, bound)) && first >= INT64_MIN && first <= INT64_MAX)
+    return 1;
+
+  switch (flag_form(op)) {
+  case INS_JEI:
+    count = 2;
+    break;
+  case INS_JNEI:
+    if (((__int128)bound - start) % step != 0 || ((__int128)bound - start) / step < 1)
+      return 0;
+
+    count = ((__int128)bound - start) / step;
+    break;
+  case INS_JLI:
+    count = step > 0 ? ((__int128)bound - start + step - 1) / step : 0;
+    break;
+  case INS_JLEI:
+    count = step > 0 ? ((__int128)bound - start) / step + 1 : 0;
+    break;
+  case INS_JGI:
+    count = step < 0 ? ((__int128)start - bound - step - 1) / -step : 0;
+    break;
+  case INS_JGEI:
+    count = step < 0 ? ((__int128)start - bound) / -step + 1 : 0;
+    break;
+  default:
+    return 0;
+  }
+
+  __int128 last = (__int128)start + count * step;
+
+  if (count < 1 || count > INT64_MAX || last < INT64_MIN || last > INT64_MAX)
+    return 0;
+
+  return (int64_t)count;
+}
+
+/* the step of a counter: the one node of a loop body that writes it adds or
+ * subtracts a constant. 0 when the register is no counter. */
+static int64_t counter_step(const Block* block, int64_t reg) {
+  int64_t step = 0;
+
+  for (size_t i = block->first; i < block->last; i++) {
+    const Node* node = &g_nodes[i];
+
+    if (node->removed || !(node_defs(node) & slot_bit(reg)))
+      continue;
+
+    if (step || reg >= GENERAL_REGISTERS || (node->op != INS_ADDI && node->op != INS_SUBI) || node->args[1] == 0 ||
+        node->args[1] == INT64_MIN)
+      return 0;
+
+    step = node->op == INS_ADDI ? node->args[1] : -node->args[1];
+  }
+
+  return step;
+}
+
+/* finds counted loops that are a single block jumping back to itself while
+ * a counter compares to a constant, with the counter's start known. the
+ * trip count follows from the three. a loop whose registers are either
+ * counters or never read afterwards is replaced by setting the counters to
+ * where they end up. any other loop is unrolled by a factor that divides
+ * the trip count, so only every so many runs of the body pay for the test. */
+static bool simplify_loops() {
+  analyze_constants();
+  analyze_liveness();
+
+  for (size_t b = 0; b < cvector_size(g_blocks); b++) {
+    Block* block = &g_blocks[b];
+    Node* jump = &g_nodes[block->last];
+
+    if (!block->visited || block->entry || !is_fused(jump->op) || info_of(jump)->operands[1] != 'i' ||
+        next_live((size_t)jump->args[2]) != block->first)
+      continue;
+
+    State entry;
+
+    for (size_t i = 0; i < SLOT_SIZE; i++)
+      entry.slots[i].kind = VALUE_UNDEF;
+
+    for (size_t* pred = cvector_begin(block->preds); pred != cvector_end(block->preds); ++pred) {
+      State out;
+
+      if (*pred == b || !g_blocks[*pred].visited)
+        continue;
+
+      propagate(*pred, &out);
+      state_join(&entry, &out);
+    }
+
+    int64_t counter = jump->args[0];
+    int64_t step = counter_step(block, counter);
+
+    if (!step || entry.slots[counter].kind != VALUE_CONST)
+      continue;
+
+    int64_t trips = trip_count(jump->op, entry.slots[counter].value, step, jump->args[1]);
+
+    if (!trips)
+      continue;
+
+    size_t exit = next_live(block->last + 1);
+    uint64_t live = exit < node_count() ? g_blocks[g_block_of[exit]].live_in : 0;
+    size_t body = 0;
+    bool removable = true;
+
+    for (size_t i = block->first; i < block->last; i++) {
+      Node* node = &g_nodes[i];
+
+      if (node->removed)
+        continue;
+
+      body += 1;
+
+      if (!is_pure(node))
+        removable = false;
+
+      for (int64_t slot = 0; slot < SLOT_SIZE; slot++) {
+        if ((node_defs(node) & live & slot_bit(slot)) && !counter_step(block, slot))
+          removable = false;
+      }
+    }
+
+    if (removable) {
+      /* the counters in order, then the loop goes. */
+      size_t first = block->first;
+      size_t last = block->last;
+      size_t inserted = 0;
+      uint64_t done = 0;
+
+      for (size_t i = last; i-- > first;) {
+        /* every insertion moves the body up by one. */
+        Node node = g_nodes[i + inserted];
+
+        if (node.removed || !(node_defs(&node) & live) || (done & slot_bit(node.args[0])))
+          continue;
+
+        uint64_t moved = (uint64_t)trips * (uint64_t)counter_step(block, node.args[0]);
+
+        if (entry.slots[node.args[0]].kind == VALUE_CONST) {
+          node.op = INS_MOVI;
+          node.args[1] = (int64_t)((uint64_t)entry.slots[node.args[0]].value + moved);
+        } else {
+          node.op = INS_ADDI;
+          node.args[1] = (int64_t)moved;
+        }
+
+        node.address = -1;
+        done |= slot_bit(node.args[0]);
+        insert_node(first, node, false);
+        inserted += 1;
+      }
+
+      for (size_t i = first + inserted; i <= last + inserted; i++)
+        g_nodes[i].removed = true;
+
+      return true;
+    }
+
+    int64_t factor = 0;
+
+    for (int64_t k = 2; body && k * (int64_t)body <= UNROLL_NODES; k++) {
+      if (trips % k == 0)
+        factor = k;
+    }
+
+    if (!factor)
+      continue;
+
+    size_t at = block->last;
+
+    for (int64_t k = 1; k < factor; k++) {
+      for (size_t i = block->first; i < block->last; i++) {
+        if (g_nodes[i].removed)
+          continue;
+
+        insert_node(at, g_nodes[i], true);
+        at += 1;
+      }
+    }
+
+    return true;
+  }
+
+  return false;
+}
+
+/* runs the program from its fresh state for as long as everything it does
+ * is known, then replaces what it ran by code that recreates the state it
+ * ended up in. */
+static bool evaluate_prefix() {
+  int64_t regs[REG_SIZE] = { 0 };
+  int64_t* stack = calloc(EVAL_STACK, sizeof(int64_t));
+  int64_t high = -1;
+  int64_t flags = 0;
+  int64_t steps = 0;
+  size_t pc = next_live(0);
+  bool done = false;
+
+  if (!stack) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  regs[REG_SP] = -1;
+  regs[REG_FP] = -1;
+
+  while (!done && steps < EVAL_FUEL && pc < node_count()) {
+    Node* node = &g_nodes[pc];
+    const int64_t* args = node->args;
+    int64_t result;
+    int64_t index;
+    size_t next = next_live(pc + 1);
+
+    switch (node->op) {
+    case INS_MOV:
+      regs[args[0]] = regs[args[1]];
+      break;
+    case INS_MOVI:
+      regs[args[0]] = args[1];
+      break;
+    case INS_ADD:
+    case INS_SUB:
+    case INS_MUL:
+    case INS_DIV:
+      if (!compute(node->op, regs[args[0]], regs[args[1]], &result))
+        done = true;
+      else
+        regs[args[0]] = result;
+      break;
+    case INS_ADDI:
+    case INS_SUBI:
+    case INS_MULI:
+    case INS_DIVI:
+      if (!compute(node->op, regs[args[0]], args[1], &result))
+        done = true;
+      else
+        regs[args[0]] = result;
+      break;
+    case INS_ADD3:
+    case INS_SUB3:
+    case INS_MUL3:
+    case INS_DIV3:
+      if (!compute(node->op, regs[args[1]], regs[args[2]], &result))
+        done = true;
+      else
+        regs[args[0]] = result;
+      break;
+    case INS_ADD3I:
+    case INS_SUB3I:
+    case INS_MUL3I:
+    case INS_DIV3I:
+      if (!compute(node->op, regs[args[1]], args[2], &result))
+        done = true;
+      else
+        regs[args[0]] = result;
+      break;
+    case INS_CMP:
+      flags = compare(regs[args[0]], regs[args[1]]);
+      break;
+    case INS_CMPI:
+      flags = compare(regs[args[0]], args[1]);
+      break;
+    case INS_JMPI:
+      next = next_live((size_t)args[0]);
+      break;
+    case INS_JTAB:
+      if ((uint64_t)regs[args[0]] < cvector_size(node->table))
+        next = next_live((size_t)node->table[regs[args[0]]]);
+      break;
+    case INS_PUSH:
+    case INS_PUSHI:
+      index = regs[REG_SP] + 1;
+
+      if (index < 0 || index >= EVAL_STACK) {
+        done = true;
+        break;
+      }
+
+      stack[index] = node->op == INS_PUSH ? regs[args[0]] : args[0];
+      regs[REG_SP] = index;
+
+      if (index > high)
+        high = index;
+      break;
+    case INS_POP:
+      index = regs[REG_SP];
+
+      if (index < 0 || index > high) {
+        done = true;
+        break;
+      }
+
+      regs[args[0]] = stack[index];
+      regs[REG_SP] -= 1;
+      break;
+    default:
+      if (is_fused(node->op)) {
+        int64_t b = info_of(node)->operands[1] == 'i' ? args[1] : regs[args[1]];
+
+        if (is_taken(flag_form(node->op), compare(regs[args[0]], b)))
+          next = next_live((size_t)args[2]);
+      } else if (is_conditional(node->op)) {
+        if (is_taken(node->op, flags))
+          next = next_live((size_t)args[0]);
+      } else {
+        done = true;
+      }
+    }
+
+    if (!done) {
+      pc = next;
+      steps += 1;
+    }
+  }
+
+  /* pushes rebuild the stack, then the registers and the flags follow. */
+  cvector_vector_type(Node) prefix = NULL;
+  Node node;
+  memset(&node, 0, sizeof(node));
+  node.address = -1;
+
+  for (int64_t i = 0; i <= high; i++) {
+    node.op = INS_PUSHI;
+    node.args[0] = stack[i];
+    cvector_push_back(prefix, node);
+  }
+
+  int64_t initial[REG_SIZE] = { 0 };
+  initial[REG_SP] = high;
+  initial[REG_FP] = -1;
+
+  for (int64_t reg = 0; reg < REG_SIZE; reg++) {
+    if (reg == REG_IP || regs[reg] == initial[reg])
+      continue;
+
+    node.op = INS_MOVI;
+    node.args[0] = reg;
+    node.args[1] = regs[reg];
+    cvector_push_back(prefix, node);
+  }
+
+  bool ok = true;
+
+  if (flags) {
+    node.op = INS_CMPI;
+    node.args[0] = REG_A;
+
+    if (flags & 1) {
+      node.args[1] = regs[REG_A];
+    } else if (flags & 2) {
+      node.args[1] = regs[REG_A] - 1;
+      ok = regs[REG_A] != INT64_MIN;
+    } else {
+      node.args[1] = regs[REG_A] + 1;
+      ok = regs[REG_A] != INT64_MAX;
+    }
+
+    cvector_push_back(prefix, node);
+  }
+
+  size_t prefix_len = cvector_size(prefix) + 1;
+
+  if (!ok || steps <= (int64_t)prefix_len || pc >= node_count()) {
+    cvector_free(prefix);
+    free(stack);
+    return false;
+  }
+
+  node.op = INS_JMPI;
+  node.args[0] = (int64_t)pc;
+  cvector_push_back(prefix, node);
+
+  for (size_t i = prefix_len; i-- > 0;)
+    insert_node(0, prefix[i], true);
+
+  cvector_free(prefix);
+  free(stack);
+
+  return true;
+}
+
+/* the jump that is taken exactly when op is not, -1 if there is none: with
+ * no flags set, as after fvm_init, neither jg nor jle is taken. */
+static int64_t inverted(int64_t op) {
+  switch (op) {
+  case INS_JEI:
+    return INS_JNEI;
+  case INS_JNEI:
+    return INS_JEI;
+  case INS_JE3:
+    return INS_JNE3;
+  case INS_JNE3:
+    return INS_JE3;
+  case INS_JG3:
+    return INS_JLE3;
+  case INS_JLE3:
+    return INS_JG3;
+  case INS_JL3:
+    return INS_JGE3;
+  case INS_JGE3:
+    return INS_JL3;
+  case INS_JE3I:
+    return INS_JNE3I;
+  case INS_JNE3I:
+    return INS_JE3I;
+  case INS_JG3I:
+    return INS_JLE3I;
+  case INS_JLE3I:
+    return INS_JG3I;
+  case INS_JL3I:
+    return INS_JGE3I;
+  case INS_JGE3I:
+    return INS_JL3I;
+  default:
+    return -1;
+  }
+}
+
+static bool falls_through(int64_t op) {
+  return op != INS_HALT && op != INS_JMPI && op != INS_RET;
+}
+
+typedef struct Edge {
+  size_t from;
+  size_t to;
+  int64_t weight;
+} Edge;
+
+static int compare_edges(const void* a, const void* b) {
+  const Edge* left = a;
+  const Edge* right = b;
+
+  if (left->weight != right->weight)
+    return left->weight < right->weight ? 1 : -1;
+
+  /* without a difference in the profile, source order wins. */
+  bool left_next = left->to == left->from + 1;
+  bool right_next = right->to == right->from + 1;
+
+  if (left_next != right_next)
+    return left_next ? -1 : 1;
+
+  return (left->from > right->from) - (left->from < right->from);
+}
+
+typedef struct Chain {
+  size_t head;
+  int64_t weight;
+} Chain;
+
+static int compare_chains(const void* a, const void* b) {
+  const Chain* left = a;
+  const Chain* right = b;
+
+  if (left->weight != right->weight)
+    return left->weight < right->weight ? 1 : -1;
+
+  return (left->head > right->head) - (left->head < right->head);
+}
+
+static int64_t profile_count(const int64_t* counts, const FVMBlockProfile* profile, const Node* node) {
+  return node->address >= 0 && (size_t)node->address < profile->length ? counts[node->address] : 0;
+}
+
+/* orders the blocks after the profile: the most frequent successor of a
+ * block is laid out right after it, so the hot path falls through, and
+ * blocks that never ran move to the end. a conditional jump whose target
+ * ends up next is inverted, a block whose fallthrough ends up elsewhere
+ * gets a jump. the block after a call stays where it is, the return lands
+ * there. */
+static void layout_blocks(const FVMBlockProfile* profile) {
+  size_t blocks = cvector_size(g_blocks);
+
+  if (blocks < 2)
+    return;
+
+  int64_t* weights = calloc(blocks, sizeof(int64_t));
+  size_t* next = malloc(sizeof(size_t) * blocks);
+  size_t* head = malloc(sizeof(size_t) * blocks);
+  int64_t* new_index = malloc(sizeof(int64_t) * (node_count() + 1));
+
+  if (!weights || !next || !head || !new_index) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  /* moved and hoisted nodes keep the address they came from, so a block
+   * is as hot as its hottest node. */
+  for (size_t b = 0; b < blocks; b++) {
+    for (size_t i = g_blocks[b].first; i <= g_blocks[b].last; i++) {
+      int64_t count = g_nodes[i].removed ? 0 : profile_count(profile->executed, profile, &g_nodes[i]);
+
+      if (count > weights[b])
+        weights[b] = count;
+    }
+
+    next[b] = blocks;
+    head[b] = b;
+  }
+
+  cvector_vector_type(Edge) edges = NULL;
+
+  for (size_t b = 0; b < blocks; b++) {
+    Node* last = &g_nodes[g_blocks[b].last];
+    size_t fallthrough = next_live(g_blocks[b].last + 1);
+    Edge edge;
+    edge.from = b;
+
+    if (last->op == INS_CALLI && b + 1 < blocks) {
+      next[b] = b + 1;
+      head[b + 1] = head[b];
+      continue;
+    }
+
+    if (is_conditional(last->op)) {
+      int64_t taken = profile_count(profile->taken, profile, last);
+      size_t target = next_live((size_t)last->args[target_arg(last->op)]);
+
+      /* the target can only come next if the jump can be inverted. */
+      if (target < node_count() && inverted(last->op) != -1) {
+        edge.to = g_block_of[target];
+        edge.weight = taken;
+        cvector_push_back(edges, edge);
+      }
+
+      edge.weight = profile_count(profile->executed, profile, last) - taken;
+    } else if (last->op == INS_JTAB) {
+      /* the table's entries are jumps wherever they end up, only the
+       * default case can fall through. */
+      edge.weight = profile_count(profile->executed, profile, last) - profile_count(profile->taken, profile, last);
+    } else if (last->op == INS_JMPI) {
+      fallthrough = next_live((size_t)last->args[0]);
+      edge.weight = weights[b];
+    } else {
+      edge.weight = weights[b];
+    }
+
+    if (!falls_through(last->op) && last->op != INS_JMPI)
+      continue;
+
+    if (fallthrough < node_count()) {
+      edge.to = g_block_of[fallthrough];
+      cvector_push_back(edges, edge);
+    }
+  }
+
+  if (edges)
+    qsort(edges, cvector_size(edges), sizeof(Edge), compare_edges);
+
+  /* chains of blocks that fall through to each other. the program starts
+   * at block 0, so nothing goes in front of it. */
+  for (Edge* it = cvector_begin(edges); it != cvector_end(edges); ++it) {
+    if (next[it->from] != blocks || head[it->to] != it->to || it->to == 0 || head[it->from] == it->to)
+      continue;
+
+    size_t first = head[it->from];
+    next[it->from] = it->to;
+
+    for (size_t b = it->to; b != blocks; b = next[b])
+      head[b] = first;
+  }
+
+  /* block 0's chain, then the others from hottest to coldest. */
+  cvector_vector_type(Chain) chains = NULL;
+
+  for (size_t b = 1; b < blocks; b++) {
+    if (head[b] != b)
+      continue;
+
+    Chain chain;
+    chain.head = b;
+    chain.weight = 0;
+
+    for (size_t c = b; c != blocks; c = next[c])
+      chain.weight = weights[c] > chain.weight ? weights[c] : chain.weight;
+
+    cvector_push_back(chains, chain);
+  }
+
+  if (chains)
+    qsort(chains, cvector_size(chains), sizeof(Chain), compare_chains);
+
+  cvector_vector_type(size_t) order = NULL;
+  cvector_push_back(order, (size_t)0);
+
+  for (Chain* it = cvector_begin(chains); it != cvector_end(chains); ++it)
+    cvector_push_back(order, it->head);
+
+  cvector_vector_type(Node) nodes = NULL;
+
+  for (size_t* chain = cvector_begin(order); chain != cvector_end(order); ++chain) {
+    for (size_t b = *chain; b != blocks; b = next[b]) {
+      /* removed nodes before a block go with it, jumps to them land on it. */
+      size_t start = b ? g_blocks[b - 1].last + 1 : 0;
+
+      for (size_t i = start; i <= g_blocks[b].last; i++) {
+        new_index[i] = (int64_t)cvector_size(nodes);
+        cvector_push_back(nodes, g_nodes[i]);
+      }
+
+      Node* last = &nodes[cvector_size(nodes) - 1];
+
+      if (!falls_through(last->op))
+        continue;
+
+      size_t fallthrough = next_live(g_blocks[b].last + 1);
+      size_t following = next[b] != blocks ? next[b] : (chain + 1 != cvector_end(order) ? chain[1] : blocks);
+
+      if (following != blocks && g_blocks[following].first == fallthrough)
+        continue;
+
+      if (is_conditional(last->op) && inverted(last->op) != -1 && following != blocks &&
+          next_live((size_t)last->args[target_arg(last->op)]) == g_blocks[following].first) {
+        last->op = inverted(last->op);
+        last->args[target_arg(last->op)] = (int64_t)fallthrough;
+        continue;
+      }
+
+      Node jump;
+      memset(&jump, 0, sizeof(jump));
+      jump.op = INS_JMPI;
+      jump.args[0] = (int64_t)fallthrough;
+      jump.address = -1;
+      cvector_push_back(nodes, jump);
+    }
+  }
+
+  /* removed nodes at the very end. */
+  for (size_t i = g_blocks[blocks - 1].last + 1; i < node_count(); i++) {
+    new_index[i] = (int64_t)cvector_size(nodes);
+    cvector_push_back(nodes, g_nodes[i]);
+  }
+
+  new_index[node_count()] = (int64_t)cvector_size(nodes);
+
+  for (Node* it = cvector_begin(nodes); it != cvector_end(nodes); ++it) {
+    for (size_t j = 0; j < target_count(it); j++)
+      *target_at(it, j) = new_index[*target_at(it, j)];
+  }
+
+  cvector_free(g_nodes);
+  g_nodes = nodes;
+
+  cvector_free(order);
+  cvector_free(chains);
+  cvector_free(edges);
+  free(weights);
+  free(next);
+  free(head);
+  free(new_index);
+}
+
+static void relocate_labels(cvector_vector_type(ParsedLabel) labels, const int64_t* addresses) {
+  for (ParsedLabel* label = cvector_begin(labels); label != cvector_end(labels); ++label) {
+    for (size_t i = 0; i < node_count(); i++) {
+      if (g_nodes[i].address == label->address) {
+        label->address = addresses[next_live(i)];
+        break;
+      }
+    }
+  }
+}
+
+cvector_vector_type(int64_t) fvm_optimize(const int64_t* instructions, size_t length,
+                                          cvector_vector_type(ParsedLabel) labels, bool fresh, bool evaluate,
+                                          const FVMBlockProfile* profile) {
+  g_nodes = NULL;
+  g_blocks = NULL;
+  g_block_of = NULL;
+  g_fresh = fresh;
+
+  if (!decode(instructions, length)) {
+    free_nodes();
+    return NULL;
+  }
+
+  if (fresh && evaluate)
+    evaluate_prefix();
+
+  for (int round = 0; round < MAX_ROUNDS; round++) {
+    bool changed = false;
+
+    build_blocks();
+    changed |= fold_constants();
+    build_blocks();
+    changed |= propagate_copies();
+    changed |= eliminate_dead_code();
+    changed |= simplify_jumps();
+    build_blocks();
+    changed |= hoist_invariants();
+    build_blocks();
+    changed |= fuse_compares();
+    build_blocks();
+    changed |= simplify_loops();
+
+    if (!changed)
+      break;
+  }
+
+  if (profile) {
+    build_blocks();
+    layout_blocks(profile);
+    simplify_jumps();
+  }
+
+  /* lay out what is left and point the jumps at the new addresses. */
+  int64_t* addresses = malloc(sizeof(int64_t) * (node_count() + 1));
+
+  if (!addresses) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  int64_t address = 0;
+
+  for (size_t i = 0; i < node_count(); i++) {
+    addresses[i] = address;
+
+    if (!g_nodes[i].removed)
+      address += (int64_t)node_length(&g_nodes[i]);
+  }
+
+  addresses[node_count()] = address;
+
+  cvector_vector_type(int64_t) optimized = NULL;
+
+  for (Node* it = cvector_begin(g_nodes); it != cvector_end(g_nodes); ++it) {
+    if (it->removed)
+      continue;
+
+    const InstructionInfo* info = info_of(it);
+    cvector_push_back(optimized, it->op);
+
+    for (size_t i = 0; info->operands[i]; i++) {
+      if (info->operands[i] == 't')
+        cvector_push_back(optimized, addresses[next_live((size_t)it->args[i])]);
+      else
+        cvector_push_back(optimized, it->args[i]);
+    }
+
+    for (int64_t* entry = cvector_begin(it->table); entry != cvector_end(it->table); ++entry)
+      cvector_push_back(optimized, addresses[next_live((size_t)*entry)]);
+  }
+
+  relocate_labels(labels, addresses);
+
+  free(addresses);
+  free_blocks();
+  cvector_free(g_block_of);
+  free_nodes();
+
+  return optimized;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "fvm_parser.h"
+#include "fvm_profile.h"
+
+/* returns an optimized copy of the program, or NULL when the program can't
+ * be analyzed: it reads or writes IP or jumps or calls through a register.
+ * the entries of a jump table are branch targets like any other.
+ *
+ * the program is split into basic blocks and run through constant and copy
+ * propagation, branch folding, dead and unreachable code removal, jump
+ * threading and loop-invariant hoisting. cmp followed by a flag jump becomes
+ * one compare and branch when nothing reads the flags afterwards. a loop
+ * that is a single block counting a register from a known start towards a
+ * constant has its trip count worked out: if all it leaves behind are its
+ * counters it is replaced by their final values, otherwise it is unrolled
+ * by a factor that divides the trip count. when fresh is set the program is
+ * assumed to start from the state fvm_init leaves behind, with every
+ * register and stack cell zero.
+ *
+ * evaluate, which needs fresh, goes further: everything the program computes
+ * from constants before the first input is run right away (counted loops
+ * included) and replaced by code that sets up the result. the passes above
+ * don't need it, it only pays off for programs that do their work before
+ * reading anything.
+ *
+ * labels, if given, are moved to the new addresses of the code they name.
+ *
+ * with a profile of the same program, recorded by fvm_block_profile_run,
+ * the blocks are laid out last so that the hot path falls through and the
+ * code that never ran ends up at the end. */
+cvector_vector_type(int64_t) fvm_optimize(const int64_t* instructions, size_t length,
+                                          cvector_vector_type(ParsedLabel) labels, bool fresh, bool evaluate,
+                                          const FVMBlockProfile* profile);
@@ -1,8 +1,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "fvm_native.h"
 #include "fvm_parser.h"
 #include "fvm_scanner.h"
+#include "fvm_trap.h"
+
+static size_t table_length(const ParsedInstruction* pi) {
+  return pi->instruction == INS_JTAB ? cvector_size(pi->table) : 0;
+}
+
+/* the cell after the opcode numbered argument, counting on into the table. */
+static int64_t* argument_at(ParsedInstruction* pi, size_t argument) {
+  if (argument < pi->arguments_len)
+    return &pi->arguments[argument];
+
+  return &pi->table[argument - pi->arguments_len];
+}
 
 cvector_vector_type(int64_t) instructions_codegen(cvector_vector_type(ParsedInstruction) pis) {
   cvector_vector_type(int64_t) instructions = NULL;
@@ -10,18 +24,32 @@ cvector_vector_type(int64_t) instructions_codegen(cvector_vector_type(ParsedInst
   for (ParsedInstruction* it = cvector_begin(pis); it != cvector_end(pis); ++it) {
     cvector_push_back(instructions, it->instruction);
 
-    for (size_t i = 0; i < it->arguments_len; i++)
-      cvector_push_back(instructions, it->arguments[i]);
+    for (size_t i = 0; i < it->arguments_len + table_length(it); i++)
+      cvector_push_back(instructions, *argument_at(it, i));
   }
 
   return instructions;
 }
 
+void parsed_instructions_free(cvector_vector_type(ParsedInstruction) pis) {
+  for (ParsedInstruction* it = cvector_begin(pis); it != cvector_end(pis); ++it) {
+    if (it->instruction == INS_JTAB)
+      cvector_free(it->table);
+  }
+
+  cvector_free(pis);
+}
+
 typedef struct Symbol {
   Span span;
   int64_t address;
 } Symbol;
 
+/* errors end the program unless a trap is armed, see fvm_trap.h. */
+static _Noreturn void fail_at(const char* message, Span span) {
+  fvm_failf("%s: %.*s", message, (int)span.length, span.start);
+}
+
 static Symbol symbol_new(Span span, int64_t address) {
   Symbol symbol;
   symbol.span = span;
@@ -31,44 +59,27 @@ static Symbol symbol_new(Span span, int64_t address) {
 }
 
 static bool is_register(TokenType type) {
-  switch (type) {
-  case TOK_REG_A:
-  case TOK_REG_B:
-  case TOK_REG_C:
-  case TOK_REG_D:
-  case TOK_REG_E:
-  case TOK_REG_F:
-  case TOK_REG_IP:
-  case TOK_REG_SP:
-    return true;
-  default:
-    return false;
-  }
+  return type == TOK_REGISTER;
+}
+
+static int64_t from_register(Token token) {
+  int64_t reg = register_from_name(token.span.start, token.span.length);
+
+  if (token.type != TOK_REGISTER || reg == -1)
+    fvm_fail("trying to convert non register!");
 
+  return reg;
 }
 
-static int64_t from_register(TokenType type) {
-  switch (type) {
-  case TOK_REG_A:
-    return 0;
-  case TOK_REG_B:
-    return 1;
-  case TOK_REG_C:
-    return 2;
-  case TOK_REG_D:
-    return 3;
-  case TOK_REG_E:
-    return 4;
-  case TOK_REG_F:
-    return 5;
-  case TOK_REG_IP:
-    return 6;
-  case TOK_REG_SP:
-    return 7;
-  default:
-    fprintf(stderr, "ERROR: trying to convert non register!\n");
-    exit(1);
-  }
+static bool is_vector_register(TokenType type) {
+  return type >= TOK_VREG_0 && type <= TOK_VREG_7;
+}
+
+static int64_t from_vector_register(TokenType type) {
+  if (!is_vector_register(type))
+    fvm_fail("trying to convert non vector register!");
+
+  return type - TOK_VREG_0;
 }
 
 static bool is_immediate(TokenType type) {
@@ -101,17 +112,13 @@ static int64_t parse_immediate(Token token) {
         return (int64_t)'\\';
         break;
       default:
-        fprintf(stderr, "ERROR: unknown escape character: ");
-        span_print(stderr, token.span);
-        fprintf(stderr, "\n");
-        exit(1);
+        fail_at("unknown escape character", token.span);
       }
     }
 
     return (int64_t)(*token.span.start);
   default:
-    fprintf(stderr, "ERROR: trying to parse non immediate!\n");
-    exit(1);
+    fvm_fail("trying to parse non immediate!");
   }
 }
 
@@ -122,6 +129,22 @@ static Symbol* g_symtable;
 static Token g_current;
 static int64_t g_address;
 
+typedef struct Fixup {
+  Span span;
+  size_t instruction;
+  size_t argument;
+} Fixup;
+
+static cvector_vector_type(Fixup) g_fixups;
+
+/* the labels named by global directives. */
+static cvector_vector_type(Span) g_globals;
+
+/* the instructions parsed so far and the source they come from, kept here
+ * so assemble_abort can free them after an error. */
+static cvector_vector_type(ParsedInstruction) g_parsed;
+static char* g_source;
+
 static void symtable_insert(Symbol symbol) {
   if (g_symtable_len >= g_symtable_cap) {
     g_symtable_cap += 10;
@@ -146,13 +169,30 @@ static int symtable_find(Span span) {
   return -1;
 }
 
-static void symtable_print() {
-  printf("===============================\n");
-  for (size_t i = 0; i < g_symtable_len; i++) {
-    span_print(stdout, g_symtable[i].span);
-    printf(": %ld\n", g_symtable[i].address);
+/* labels may be used before they are defined, so every use is patched
+ * once the whole input has been parsed; an object keeps them as
+ * relocations. */
+static int64_t resolve_label(size_t instruction, size_t argument) {
+  Fixup fixup;
+  fixup.span = g_current.span;
+  fixup.instruction = instruction;
+  fixup.argument = argument;
+  cvector_push_back(g_fixups, fixup);
+
+  return 0;
+}
+
+static void apply_fixups(cvector_vector_type(ParsedInstruction) instructions) {
+  for (Fixup* it = cvector_begin(g_fixups); it != cvector_end(g_fixups); ++it) {
+    int index = symtable_find(it->span);
+
+    if (index == -1)
+      fail_at("cannot find lable", it->span);
+
+    *argument_at(&instructions[it->instruction], it->argument) = g_symtable[index].address;
   }
-  printf("===============================\n");
+
+  cvector_clear(g_fixups);
 }
 
 static bool expect(TokenType type) {
@@ -170,15 +210,170 @@ static void advance(bool is_advance_addr) {
 }
 
 static void match(TokenType type) {
-  if (!expect(type)) {
-    fprintf(stderr, "ERROR: syntax error!\n");
-    exit(1);
+  if (!expect(type))
+    fvm_fail("syntax error!");
+}
+
+static void expect_vector_register() {
+  if (!is_vector_register(g_current.type))
+    fail_at("expected vector register but got", g_current.span);
+}
+
+/* vadd, vsub, vmul and vcmp all take two vector registers. */
+static ParsedInstruction parse_vector_pair(Instruction instruction) {
+  advance(true);
+
+  expect_vector_register();
+  int64_t vreg_a = from_vector_register(g_current.type);
+  advance(true);
+
+  match(TOK_COMMA);
+  advance(false);
+
+  expect_vector_register();
+
+  ParsedInstruction pair;
+  pair.instruction = instruction;
+  pair.arguments[0] = vreg_a;
+  pair.arguments[1] = from_vector_register(g_current.type);
+  pair.arguments_len = 2;
+
+  advance(true);
+
+  return pair;
+}
+
+static void expect_register() {
+  if (!is_register(g_current.type))
+    fail_at("expected register but got", g_current.span);
+}
+
+/* for instructions that take nothing but count registers, like send or
+ * mcopy. */
+static ParsedInstruction parse_registers(Instruction instruction, size_t count) {
+  ParsedInstruction registers;
+  registers.instruction = instruction;
+  registers.arguments_len = count;
+
+  advance(true);
+
+  for (size_t i = 0; i < count; i++) {
+    if (i > 0) {
+      match(TOK_COMMA);
+      advance(false);
+    }
+
+    expect_register();
+    registers.arguments[i] = from_register(g_current);
+    advance(true);
   }
+
+  return registers;
 }
 
-cvector_vector_type(ParsedInstruction) parser_parse() {
-  cvector_vector_type(ParsedInstruction) instructions = NULL;
+/* add A, B, C and add A, B, 5, and the same for sub, mul and div. g_current
+ * is the comma after B. */
+static ParsedInstruction parse_third_operand(Instruction registers, Instruction immediate, int64_t reg_a,
+                                             int64_t reg_b) {
+  advance(false);
+
+  ParsedInstruction three;
+  three.arguments[0] = reg_a;
+  three.arguments[1] = reg_b;
+  three.arguments_len = 3;
+
+  if (is_immediate(g_current.type)) {
+    three.instruction = immediate;
+    three.arguments[2] = parse_immediate(g_current);
+  } else {
+    expect_register();
+    three.instruction = registers;
+    three.arguments[2] = from_register(g_current);
+  }
 
+  advance(true);
+
+  return three;
+}
+
+/* je A, B, label and je A, 5, label compare and jump in one, and so do the
+ * other conditional jumps. g_current is the comma after A, index the
+ * instruction's index for the label fixup. */
+static ParsedInstruction parse_fused_branch(Instruction registers, Instruction immediate, int64_t reg_a,
+                                            size_t index) {
+  advance(false);
+
+  ParsedInstruction branch;
+  branch.arguments[0] = reg_a;
+  branch.arguments_len = 3;
+
+  if (is_immediate(g_current.type)) {
+    branch.instruction = immediate;
+    branch.arguments[1] = parse_immediate(g_current);
+  } else {
+    expect_register();
+    branch.instruction = registers;
+    branch.arguments[1] = from_register(g_current);
+  }
+
+  advance(true);
+
+  match(TOK_COMMA);
+  advance(false);
+
+  if (expect(TOK_IDENTIFIER)) {
+    branch.arguments[2] = resolve_label(index, 2);
+  } else if (is_immediate(g_current.type)) {
+    branch.arguments[2] = parse_immediate(g_current);
+  } else {
+    fail_at("expected label but got", g_current.span);
+  }
+
+  advance(true);
+
+  return branch;
+}
+
+/* jtab A, l0, l1, ... with any number of labels. g_current is jtab, index
+ * the instruction's index for the label fixups. the count of labels goes
+ * between the register and the table. */
+static ParsedInstruction parse_jump_table(size_t index) {
+  advance(true);
+
+  expect_register();
+
+  ParsedInstruction jtab;
+  jtab.instruction = INS_JTAB;
+  jtab.arguments[0] = from_register(g_current);
+  jtab.arguments_len = 2;
+  jtab.table = NULL;
+
+  advance(true);
+  g_address += 1;
+
+  while (expect(TOK_COMMA)) {
+    advance(false);
+
+    if (expect(TOK_IDENTIFIER)) {
+      cvector_push_back(jtab.table, resolve_label(index, jtab.arguments_len + cvector_size(jtab.table)));
+    } else if (is_immediate(g_current.type)) {
+      cvector_push_back(jtab.table, parse_immediate(g_current));
+    } else {
+      fail_at("expected label but got", g_current.span);
+    }
+
+    advance(true);
+  }
+
+  if (cvector_empty(jtab.table))
+    fvm_fail("jtab without labels!");
+
+  jtab.arguments[1] = (int64_t)cvector_size(jtab.table);
+
+  return jtab;
+}
+
+static void parse_instructions() {
   while (!expect(TOK_EOF)) {
     if (expect(TOK_LABLE)) {
       symtable_insert(symbol_new(g_current.span, g_address));
@@ -186,13 +381,23 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       continue;
     }
 
+    if (expect(TOK_GLOBAL)) {
+      advance(false);
+
+      match(TOK_IDENTIFIER);
+      cvector_push_back(g_globals, g_current.span);
+
+      advance(false);
+      continue;
+    }
+
     if (expect(TOK_HALT)) {
       advance(true);
 
       ParsedInstruction halt;
       halt.instruction = INS_HALT;
       halt.arguments_len = 0;
-      cvector_push_back(instructions, halt);
+      cvector_push_back(g_parsed, halt);
 
       continue;
     }
@@ -205,24 +410,20 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         pushi.instruction = INS_PUSHI;
         pushi.arguments[0] = parse_immediate(g_current);
         pushi.arguments_len = 1;
-        cvector_push_back(instructions, pushi);
+        cvector_push_back(g_parsed, pushi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
       ParsedInstruction push;
       push.instruction = INS_PUSH;
-      push.arguments[0] = from_register(g_current.type);
+      push.arguments[0] = from_register(g_current);
       push.arguments_len = 1;
-      cvector_push_back(instructions, push);
+      cvector_push_back(g_parsed, push);
 
       advance(true);
       continue;
@@ -231,18 +432,14 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
     if (expect(TOK_POP)) {
       advance(true);
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
       ParsedInstruction pop;
-      pop.instruction = INS_PUSH;
-      pop.arguments[0] = from_register(g_current.type);
+      pop.instruction = INS_POP;
+      pop.arguments[0] = from_register(g_current);
       pop.arguments_len = 1;
-      cvector_push_back(instructions, pop);
+      cvector_push_back(g_parsed, pop);
 
       advance(true);
       continue;
@@ -251,14 +448,10 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
     if (expect(TOK_MOV)) {
       advance(true);
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
-      int64_t reg_a = from_register(g_current.type);
+      int64_t reg_a = from_register(g_current);
       advance(true);
 
       match(TOK_COMMA);
@@ -270,25 +463,21 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         movi.arguments[0] = reg_a;
         movi.arguments[1] = parse_immediate(g_current);
         movi.arguments_len = 2;
-        cvector_push_back(instructions, movi);
+        cvector_push_back(g_parsed, movi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
       ParsedInstruction mov;
       mov.instruction = INS_MOV;
       mov.arguments[0] = reg_a;
-      mov.arguments[1] = from_register(g_current.type);
+      mov.arguments[1] = from_register(g_current);
       mov.arguments_len = 2;
-      cvector_push_back(instructions, mov);
+      cvector_push_back(g_parsed, mov);
 
       advance(true);
       continue;
@@ -297,14 +486,10 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
     if (expect(TOK_ADD)) {
       advance(true);
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
-      int64_t reg_a = from_register(g_current.type);
+      int64_t reg_a = from_register(g_current);
       advance(true);
 
       match(TOK_COMMA);
@@ -316,41 +501,39 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         addi.arguments[0] = reg_a;
         addi.arguments[1] = parse_immediate(g_current);
         addi.arguments_len = 2;
-        cvector_push_back(instructions, addi);
+        cvector_push_back(g_parsed, addi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_b = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_third_operand(INS_ADD3, INS_ADD3I, reg_a, reg_b));
+        continue;
       }
 
       ParsedInstruction add;
       add.instruction = INS_ADD;
       add.arguments[0] = reg_a;
-      add.arguments[1] = from_register(g_current.type);
+      add.arguments[1] = reg_b;
       add.arguments_len = 2;
-      cvector_push_back(instructions, add);
-
-      advance(true);
+      cvector_push_back(g_parsed, add);
       continue;
     }
 
     if (expect(TOK_SUB)) {
       advance(true);
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
-      int64_t reg_a = from_register(g_current.type);
+      int64_t reg_a = from_register(g_current);
       advance(true);
 
       match(TOK_COMMA);
@@ -362,41 +545,39 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         subi.arguments[0] = reg_a;
         subi.arguments[1] = parse_immediate(g_current);
         subi.arguments_len = 2;
-        cvector_push_back(instructions, subi);
+        cvector_push_back(g_parsed, subi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_b = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_third_operand(INS_SUB3, INS_SUB3I, reg_a, reg_b));
+        continue;
       }
 
       ParsedInstruction sub;
       sub.instruction = INS_SUB;
       sub.arguments[0] = reg_a;
-      sub.arguments[1] = from_register(g_current.type);
+      sub.arguments[1] = reg_b;
       sub.arguments_len = 2;
-      cvector_push_back(instructions, sub);
-
-      advance(true);
+      cvector_push_back(g_parsed, sub);
       continue;
     }
 
     if (expect(TOK_MUL)) {
       advance(true);
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
-      int64_t reg_a = from_register(g_current.type);
+      int64_t reg_a = from_register(g_current);
       advance(true);
 
       match(TOK_COMMA);
@@ -408,41 +589,39 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         muli.arguments[0] = reg_a;
         muli.arguments[1] = parse_immediate(g_current);
         muli.arguments_len = 2;
-        cvector_push_back(instructions, muli);
+        cvector_push_back(g_parsed, muli);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_b = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_third_operand(INS_MUL3, INS_MUL3I, reg_a, reg_b));
+        continue;
       }
 
       ParsedInstruction mul;
       mul.instruction = INS_MUL;
       mul.arguments[0] = reg_a;
-      mul.arguments[1] = from_register(g_current.type);
+      mul.arguments[1] = reg_b;
       mul.arguments_len = 2;
-      cvector_push_back(instructions, mul);
-
-      advance(true);
+      cvector_push_back(g_parsed, mul);
       continue;
     }
 
     if (expect(TOK_DIV)) {
       advance(true);
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
-      int64_t reg_a = from_register(g_current.type);
+      int64_t reg_a = from_register(g_current);
       advance(true);
 
       match(TOK_COMMA);
@@ -454,41 +633,39 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         divi.arguments[0] = reg_a;
         divi.arguments[1] = parse_immediate(g_current);
         divi.arguments_len = 2;
-        cvector_push_back(instructions, divi);
+        cvector_push_back(g_parsed, divi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_b = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_third_operand(INS_DIV3, INS_DIV3I, reg_a, reg_b));
+        continue;
       }
 
       ParsedInstruction div;
       div.instruction = INS_DIV;
       div.arguments[0] = reg_a;
-      div.arguments[1] = from_register(g_current.type);
+      div.arguments[1] = reg_b;
       div.arguments_len = 2;
-      cvector_push_back(instructions, div);
-
-      advance(true);
+      cvector_push_back(g_parsed, div);
       continue;
     }
 
     if (expect(TOK_CMP)) {
       advance(true);
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
-      int64_t reg_a = from_register(g_current.type);
+      int64_t reg_a = from_register(g_current);
       advance(true);
 
       match(TOK_COMMA);
@@ -500,25 +677,21 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         cmpi.arguments[0] = reg_a;
         cmpi.arguments[1] = parse_immediate(g_current);
         cmpi.arguments_len = 2;
-        cvector_push_back(instructions, cmpi);
+        cvector_push_back(g_parsed, cmpi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
       ParsedInstruction cmp;
       cmp.instruction = INS_CMP;
       cmp.arguments[0] = reg_a;
-      cmp.arguments[1] = from_register(g_current.type);
+      cmp.arguments[1] = from_register(g_current);
       cmp.arguments_len = 2;
-      cvector_push_back(instructions, cmp);
+      cvector_push_back(g_parsed, cmp);
 
       advance(true);
       continue;
@@ -528,20 +701,11 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       advance(true);
 
       if (expect(TOK_IDENTIFIER)) {
-        int index = symtable_find(g_current.span);
-
-        if (index == -1) {
-          fprintf(stderr, "ERROR: cannot find lable: ");
-          span_print(stderr, g_current.span);
-          fprintf(stderr, "\n");
-          exit(1);
-        }
-
         ParsedInstruction jmpi;
         jmpi.instruction = INS_JMPI;
-        jmpi.arguments[0] = g_symtable[index].address;
+        jmpi.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
         jmpi.arguments_len = 1;
-        cvector_push_back(instructions, jmpi);
+        cvector_push_back(g_parsed, jmpi);
 
         advance(true);
         continue;
@@ -552,24 +716,20 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         jmpi.instruction = INS_JMPI;
         jmpi.arguments[0] = parse_immediate(g_current);
         jmpi.arguments_len = 1;
-        cvector_push_back(instructions, jmpi);
+        cvector_push_back(g_parsed, jmpi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
-      }
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
 
       ParsedInstruction jmp;
       jmp.instruction = INS_JMP;
-      jmp.arguments[0] = from_register(g_current.type);
+      jmp.arguments[0] = from_register(g_current);
       jmp.arguments_len = 1;
-      cvector_push_back(instructions, jmp);
+      cvector_push_back(g_parsed, jmp);
 
       advance(true);
       continue;
@@ -579,20 +739,11 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       advance(true);
 
       if (expect(TOK_IDENTIFIER)) {
-        int index = symtable_find(g_current.span);
-
-        if (index == -1) {
-          fprintf(stderr, "ERROR: cannot find lable: ");
-          span_print(stderr, g_current.span);
-          fprintf(stderr, "\n");
-          exit(1);
-        }
-
         ParsedInstruction jei;
         jei.instruction = INS_JEI;
-        jei.arguments[0] = g_symtable[index].address;
+        jei.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
         jei.arguments_len = 1;
-        cvector_push_back(instructions, jei);
+        cvector_push_back(g_parsed, jei);
 
         advance(true);
         continue;
@@ -603,26 +754,28 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         jei.instruction = INS_JEI;
         jei.arguments[0] = parse_immediate(g_current);
         jei.arguments_len = 1;
-        cvector_push_back(instructions, jei);
+        cvector_push_back(g_parsed, jei);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_fused_branch(INS_JE3, INS_JE3I, reg_a, cvector_size(g_parsed)));
+        continue;
       }
 
       ParsedInstruction je;
       je.instruction = INS_JE;
-      je.arguments[0] = from_register(g_current.type);
+      je.arguments[0] = reg_a;
       je.arguments_len = 1;
-      cvector_push_back(instructions, je);
-
-      advance(true);
+      cvector_push_back(g_parsed, je);
       continue;
     }
 
@@ -630,20 +783,11 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       advance(true);
 
       if (expect(TOK_IDENTIFIER)) {
-        int index = symtable_find(g_current.span);
-
-        if (index == -1) {
-          fprintf(stderr, "ERROR: cannot find lable: ");
-          span_print(stderr, g_current.span);
-          fprintf(stderr, "\n");
-          exit(1);
-        }
-
         ParsedInstruction jnei;
         jnei.instruction = INS_JNEI;
-        jnei.arguments[0] = g_symtable[index].address;
+        jnei.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
         jnei.arguments_len = 1;
-        cvector_push_back(instructions, jnei);
+        cvector_push_back(g_parsed, jnei);
 
         advance(true);
         continue;
@@ -654,26 +798,28 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         jnei.instruction = INS_JNEI;
         jnei.arguments[0] = parse_immediate(g_current);
         jnei.arguments_len = 1;
-        cvector_push_back(instructions, jnei);
+        cvector_push_back(g_parsed, jnei);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_fused_branch(INS_JNE3, INS_JNE3I, reg_a, cvector_size(g_parsed)));
+        continue;
       }
 
       ParsedInstruction jne;
       jne.instruction = INS_JNE;
-      jne.arguments[0] = from_register(g_current.type);
+      jne.arguments[0] = reg_a;
       jne.arguments_len = 1;
-      cvector_push_back(instructions, jne);
-
-      advance(true);
+      cvector_push_back(g_parsed, jne);
       continue;
     }
 
@@ -681,20 +827,11 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       advance(true);
 
       if (expect(TOK_IDENTIFIER)) {
-        int index = symtable_find(g_current.span);
-
-        if (index == -1) {
-          fprintf(stderr, "ERROR: cannot find lable: ");
-          span_print(stderr, g_current.span);
-          fprintf(stderr, "\n");
-          exit(1);
-        }
-
         ParsedInstruction jgi;
         jgi.instruction = INS_JGI;
-        jgi.arguments[0] = g_symtable[index].address;
+        jgi.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
         jgi.arguments_len = 1;
-        cvector_push_back(instructions, jgi);
+        cvector_push_back(g_parsed, jgi);
 
         advance(true);
         continue;
@@ -705,26 +842,28 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         jgi.instruction = INS_JGI;
         jgi.arguments[0] = parse_immediate(g_current);
         jgi.arguments_len = 1;
-        cvector_push_back(instructions, jgi);
+        cvector_push_back(g_parsed, jgi);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_fused_branch(INS_JG3, INS_JG3I, reg_a, cvector_size(g_parsed)));
+        continue;
       }
 
       ParsedInstruction jg;
       jg.instruction = INS_JG;
-      jg.arguments[0] = from_register(g_current.type);
+      jg.arguments[0] = reg_a;
       jg.arguments_len = 1;
-      cvector_push_back(instructions, jg);
-
-      advance(true);
+      cvector_push_back(g_parsed, jg);
       continue;
     }
 
@@ -732,20 +871,11 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       advance(true);
 
       if (expect(TOK_IDENTIFIER)) {
-        int index = symtable_find(g_current.span);
-
-        if (index == -1) {
-          fprintf(stderr, "ERROR: cannot find lable: ");
-          span_print(stderr, g_current.span);
-          fprintf(stderr, "\n");
-          exit(1);
-        }
-
         ParsedInstruction jli;
         jli.instruction = INS_JLI;
-        jli.arguments[0] = g_symtable[index].address;
+        jli.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
         jli.arguments_len = 1;
-        cvector_push_back(instructions, jli);
+        cvector_push_back(g_parsed, jli);
 
         advance(true);
         continue;
@@ -756,26 +886,28 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         jli.instruction = INS_JLI;
         jli.arguments[0] = parse_immediate(g_current);
         jli.arguments_len = 1;
-        cvector_push_back(instructions, jli);
+        cvector_push_back(g_parsed, jli);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_fused_branch(INS_JL3, INS_JL3I, reg_a, cvector_size(g_parsed)));
+        continue;
       }
 
       ParsedInstruction jl;
       jl.instruction = INS_JL;
-      jl.arguments[0] = from_register(g_current.type);
+      jl.arguments[0] = reg_a;
       jl.arguments_len = 1;
-      cvector_push_back(instructions, jl);
-
-      advance(true);
+      cvector_push_back(g_parsed, jl);
       continue;
     }
 
@@ -783,20 +915,11 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       advance(true);
 
       if (expect(TOK_IDENTIFIER)) {
-        int index = symtable_find(g_current.span);
-
-        if (index == -1) {
-          fprintf(stderr, "ERROR: cannot find lable: ");
-          span_print(stderr, g_current.span);
-          fprintf(stderr, "\n");
-          exit(1);
-        }
-
         ParsedInstruction jgei;
         jgei.instruction = INS_JGEI;
-        jgei.arguments[0] = g_symtable[index].address;
+        jgei.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
         jgei.arguments_len = 1;
-        cvector_push_back(instructions, jgei);
+        cvector_push_back(g_parsed, jgei);
 
         advance(true);
         continue;
@@ -807,26 +930,28 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         jgei.instruction = INS_JGEI;
         jgei.arguments[0] = parse_immediate(g_current);
         jgei.arguments_len = 1;
-        cvector_push_back(instructions, jgei);
+        cvector_push_back(g_parsed, jgei);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_fused_branch(INS_JGE3, INS_JGE3I, reg_a, cvector_size(g_parsed)));
+        continue;
       }
 
       ParsedInstruction jge;
       jge.instruction = INS_JGE;
-      jge.arguments[0] = from_register(g_current.type);
+      jge.arguments[0] = reg_a;
       jge.arguments_len = 1;
-      cvector_push_back(instructions, jge);
-
-      advance(true);
+      cvector_push_back(g_parsed, jge);
       continue;
     }
 
@@ -834,20 +959,11 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
       advance(true);
 
       if (expect(TOK_IDENTIFIER)) {
-        int index = symtable_find(g_current.span);
-
-        if (index == -1) {
-          fprintf(stderr, "ERROR: cannot find lable: ");
-          span_print(stderr, g_current.span);
-          fprintf(stderr, "\n");
-          exit(1);
-        }
-
         ParsedInstruction jlei;
         jlei.instruction = INS_JLEI;
-        jlei.arguments[0] = g_symtable[index].address;
+        jlei.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
         jlei.arguments_len = 1;
-        cvector_push_back(instructions, jlei);
+        cvector_push_back(g_parsed, jlei);
 
         advance(true);
         continue;
@@ -858,49 +974,805 @@ cvector_vector_type(ParsedInstruction) parser_parse() {
         jlei.instruction = INS_JLEI;
         jlei.arguments[0] = parse_immediate(g_current);
         jlei.arguments_len = 1;
-        cvector_push_back(instructions, jlei);
+        cvector_push_back(g_parsed, jlei);
 
         advance(true);
         continue;
       }
 
-      if (!is_register(g_current.type)) {
-        fprintf(stderr, "ERROR: expected register but got: ");
-        span_print(stderr, g_current.span);
-        fprintf(stderr, "\n");
-        exit(1);
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      if (expect(TOK_COMMA)) {
+        cvector_push_back(g_parsed, parse_fused_branch(INS_JLE3, INS_JLE3I, reg_a, cvector_size(g_parsed)));
+        continue;
       }
 
       ParsedInstruction jle;
       jle.instruction = INS_JLE;
-      jle.arguments[0] = from_register(g_current.type);
+      jle.arguments[0] = reg_a;
       jle.arguments_len = 1;
-      cvector_push_back(instructions, jle);
+      cvector_push_back(g_parsed, jle);
+      continue;
+    }
+
+    if (expect(TOK_CALL)) {
+      advance(true);
+
+      if (expect(TOK_IDENTIFIER)) {
+        ParsedInstruction calli;
+        calli.instruction = INS_CALLI;
+        calli.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
+        calli.arguments_len = 1;
+        cvector_push_back(g_parsed, calli);
+
+        advance(true);
+        continue;
+      }
+
+      if (is_immediate(g_current.type)) {
+        ParsedInstruction calli;
+        calli.instruction = INS_CALLI;
+        calli.arguments[0] = parse_immediate(g_current);
+        calli.arguments_len = 1;
+        cvector_push_back(g_parsed, calli);
+
+        advance(true);
+        continue;
+      }
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      ParsedInstruction call;
+      call.instruction = INS_CALL;
+      call.arguments[0] = from_register(g_current);
+      call.arguments_len = 1;
+      cvector_push_back(g_parsed, call);
 
       advance(true);
       continue;
     }
-  }
 
-  return instructions;
-}
+    if (expect(TOK_RET)) {
+      advance(true);
 
-void parser_init(const char* input) {
-  scanner_init(input);
+      ParsedInstruction ret;
+      ret.instruction = INS_RET;
+      ret.arguments_len = 0;
+      cvector_push_back(g_parsed, ret);
 
-  g_symtable_len = 0;
-  g_symtable_cap = 10;
-  g_symtable = malloc(sizeof(Symbol) * g_symtable_cap);
+      continue;
+    }
 
-  if (!g_symtable) {
-    fprintf(stderr, "ERROR: failed to allocate memory!\n");
-    exit(1);
-  }
+    if (expect(TOK_ENTER)) {
+      advance(true);
 
-  g_current = scanner_get_token();
-  g_address = 0;
-}
+      if (!is_immediate(g_current.type))
+        fail_at("expected immediate but got", g_current.span);
 
-void parser_deinit() {
-  free(g_symtable);
+      ParsedInstruction enter;
+      enter.instruction = INS_ENTER;
+      enter.arguments[0] = parse_immediate(g_current);
+      enter.arguments_len = 1;
+      cvector_push_back(g_parsed, enter);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_LEAVE)) {
+      advance(true);
+
+      ParsedInstruction leave;
+      leave.instruction = INS_LEAVE;
+      leave.arguments_len = 0;
+      cvector_push_back(g_parsed, leave);
+
+      continue;
+    }
+
+    if (expect(TOK_LOAD)) {
+      advance(true);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      if (!is_immediate(g_current.type))
+        fail_at("expected immediate but got", g_current.span);
+
+      ParsedInstruction load;
+      load.instruction = INS_LOAD;
+      load.arguments[0] = reg_a;
+      load.arguments[1] = parse_immediate(g_current);
+      load.arguments_len = 2;
+      cvector_push_back(g_parsed, load);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_STORE)) {
+      advance(true);
+
+      if (!is_immediate(g_current.type))
+        fail_at("expected immediate but got", g_current.span);
+
+      int64_t offset = parse_immediate(g_current);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      ParsedInstruction store;
+      store.instruction = INS_STORE;
+      store.arguments[0] = offset;
+      store.arguments[1] = from_register(g_current);
+      store.arguments_len = 2;
+      cvector_push_back(g_parsed, store);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_PUTC)) {
+      advance(true);
+
+      if (is_immediate(g_current.type)) {
+        ParsedInstruction putci;
+        putci.instruction = INS_PUTCI;
+        putci.arguments[0] = parse_immediate(g_current);
+        putci.arguments_len = 1;
+        cvector_push_back(g_parsed, putci);
+
+        advance(true);
+        continue;
+      }
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      ParsedInstruction putc;
+      putc.instruction = INS_PUTC;
+      putc.arguments[0] = from_register(g_current);
+      putc.arguments_len = 1;
+      cvector_push_back(g_parsed, putc);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_PUTI)) {
+      advance(true);
+
+      if (is_immediate(g_current.type)) {
+        ParsedInstruction putii;
+        putii.instruction = INS_PUTII;
+        putii.arguments[0] = parse_immediate(g_current);
+        putii.arguments_len = 1;
+        cvector_push_back(g_parsed, putii);
+
+        advance(true);
+        continue;
+      }
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      ParsedInstruction puti;
+      puti.instruction = INS_PUTI;
+      puti.arguments[0] = from_register(g_current);
+      puti.arguments_len = 1;
+      cvector_push_back(g_parsed, puti);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_WRITE)) {
+      advance(true);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg_a = from_register(g_current);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      ParsedInstruction write;
+      write.instruction = INS_WRITE;
+      write.arguments[0] = reg_a;
+      write.arguments[1] = from_register(g_current);
+      write.arguments_len = 2;
+      cvector_push_back(g_parsed, write);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_READ)) {
+      advance(true);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      ParsedInstruction read;
+      read.instruction = INS_READ;
+      read.arguments[0] = from_register(g_current);
+      read.arguments_len = 1;
+      cvector_push_back(g_parsed, read);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_NATIVE)) {
+      advance(true);
+
+      match(TOK_IDENTIFIER);
+
+      int64_t index = fvm_native_find(g_current.span.start, g_current.span.length);
+
+      if (index == -1)
+        fail_at("unknown native function", g_current.span);
+
+      ParsedInstruction native;
+      native.instruction = INS_NATIVE;
+      native.arguments[0] = index;
+      native.arguments_len = 1;
+      cvector_push_back(g_parsed, native);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_VLOAD)) {
+      advance(true);
+
+      expect_vector_register();
+      int64_t vreg = from_vector_register(g_current.type);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      ParsedInstruction vload;
+      vload.instruction = INS_VLOAD;
+      vload.arguments[0] = vreg;
+      vload.arguments[1] = from_register(g_current);
+      vload.arguments_len = 2;
+      cvector_push_back(g_parsed, vload);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_VSTORE)) {
+      advance(true);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg = from_register(g_current);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      expect_vector_register();
+
+      ParsedInstruction vstore;
+      vstore.instruction = INS_VSTORE;
+      vstore.arguments[0] = reg;
+      vstore.arguments[1] = from_vector_register(g_current.type);
+      vstore.arguments_len = 2;
+      cvector_push_back(g_parsed, vstore);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_VADD)) {
+      cvector_push_back(g_parsed, parse_vector_pair(INS_VADD));
+      continue;
+    }
+
+    if (expect(TOK_VSUB)) {
+      cvector_push_back(g_parsed, parse_vector_pair(INS_VSUB));
+      continue;
+    }
+
+    if (expect(TOK_VMUL)) {
+      cvector_push_back(g_parsed, parse_vector_pair(INS_VMUL));
+      continue;
+    }
+
+    if (expect(TOK_VCMP)) {
+      cvector_push_back(g_parsed, parse_vector_pair(INS_VCMP));
+      continue;
+    }
+
+    if (expect(TOK_VSUM)) {
+      advance(true);
+
+      if (!is_register(g_current.type))
+        fail_at("expected register but got", g_current.span);
+
+      int64_t reg = from_register(g_current);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      expect_vector_register();
+
+      ParsedInstruction vsum;
+      vsum.instruction = INS_VSUM;
+      vsum.arguments[0] = reg;
+      vsum.arguments[1] = from_vector_register(g_current.type);
+      vsum.arguments_len = 2;
+      cvector_push_back(g_parsed, vsum);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_MCOPY)) {
+      cvector_push_back(g_parsed, parse_registers(INS_MCOPY, 3));
+      continue;
+    }
+
+    if (expect(TOK_MFILL)) {
+      cvector_push_back(g_parsed, parse_registers(INS_MFILL, 3));
+      continue;
+    }
+
+    if (expect(TOK_MCMP)) {
+      cvector_push_back(g_parsed, parse_registers(INS_MCMP, 3));
+      continue;
+    }
+
+    if (expect(TOK_SPAWN)) {
+      advance(true);
+
+      if (!expect(TOK_IDENTIFIER))
+        fail_at("expected label but got", g_current.span);
+
+      ParsedInstruction spawn;
+      spawn.instruction = INS_SPAWN;
+      spawn.arguments[0] = resolve_label(cvector_size(g_parsed), 0);
+      spawn.arguments_len = 1;
+      cvector_push_back(g_parsed, spawn);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_YIELD)) {
+      advance(true);
+
+      ParsedInstruction yield;
+      yield.instruction = INS_YIELD;
+      yield.arguments_len = 0;
+      cvector_push_back(g_parsed, yield);
+
+      continue;
+    }
+
+    if (expect(TOK_JOIN)) {
+      advance(true);
+      expect_register();
+
+      ParsedInstruction join;
+      join.instruction = INS_JOIN;
+      join.arguments[0] = from_register(g_current);
+      join.arguments_len = 1;
+      cvector_push_back(g_parsed, join);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_CHAN)) {
+      advance(true);
+      expect_register();
+
+      int64_t reg = from_register(g_current);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      if (!is_immediate(g_current.type))
+        fail_at("expected capacity but got", g_current.span);
+
+      ParsedInstruction chan;
+      chan.instruction = INS_CHAN;
+      chan.arguments[0] = reg;
+      chan.arguments[1] = parse_immediate(g_current);
+      chan.arguments_len = 2;
+      cvector_push_back(g_parsed, chan);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_SEND)) {
+      cvector_push_back(g_parsed, parse_registers(INS_SEND, 2));
+      continue;
+    }
+
+    if (expect(TOK_RECV)) {
+      cvector_push_back(g_parsed, parse_registers(INS_RECV, 2));
+      continue;
+    }
+
+    if (expect(TOK_SLOAD)) {
+      cvector_push_back(g_parsed, parse_registers(INS_SLOAD, 2));
+      continue;
+    }
+
+    if (expect(TOK_SSTORE)) {
+      cvector_push_back(g_parsed, parse_registers(INS_SSTORE, 2));
+      continue;
+    }
+
+    if (expect(TOK_XADD)) {
+      cvector_push_back(g_parsed, parse_registers(INS_XADD, 2));
+      continue;
+    }
+
+    if (expect(TOK_XCHG)) {
+      cvector_push_back(g_parsed, parse_registers(INS_XCHG, 2));
+      continue;
+    }
+
+    if (expect(TOK_CAS)) {
+      cvector_push_back(g_parsed, parse_registers(INS_CAS, 3));
+      continue;
+    }
+
+    if (expect(TOK_FENCE)) {
+      advance(true);
+
+      ParsedInstruction fence;
+      fence.instruction = INS_FENCE;
+      fence.arguments_len = 0;
+      cvector_push_back(g_parsed, fence);
+
+      continue;
+    }
+
+    if (expect(TOK_ALLOC)) {
+      advance(true);
+      expect_register();
+
+      int64_t reg = from_register(g_current);
+      advance(true);
+
+      match(TOK_COMMA);
+      advance(false);
+
+      ParsedInstruction alloc;
+      alloc.arguments[0] = reg;
+      alloc.arguments_len = 2;
+
+      if (is_immediate(g_current.type)) {
+        alloc.instruction = INS_ALLOCI;
+        alloc.arguments[1] = parse_immediate(g_current);
+      } else {
+        expect_register();
+        alloc.instruction = INS_ALLOC;
+        alloc.arguments[1] = from_register(g_current);
+      }
+
+      cvector_push_back(g_parsed, alloc);
+
+      advance(true);
+      continue;
+    }
+
+    if (expect(TOK_FREE)) {
+      cvector_push_back(g_parsed, parse_registers(INS_FREE, 1));
+      continue;
+    }
+
+    if (expect(TOK_HLOAD)) {
+      cvector_push_back(g_parsed, parse_registers(INS_HLOAD, 2));
+      continue;
+    }
+
+    if (expect(TOK_HSTORE)) {
+      cvector_push_back(g_parsed, parse_registers(INS_HSTORE, 2));
+      continue;
+    }
+
+    if (expect(TOK_HRESET)) {
+      advance(true);
+
+      ParsedInstruction hreset;
+      hreset.instruction = INS_HRESET;
+      hreset.arguments_len = 0;
+      cvector_push_back(g_parsed, hreset);
+
+      continue;
+    }
+
+    if (expect(TOK_JTAB)) {
+      cvector_push_back(g_parsed, parse_jump_table(cvector_size(g_parsed)));
+      continue;
+    }
+
+    fail_at("unexpected token", g_current.span);
+  }
+}
+
+cvector_vector_type(ParsedInstruction) parser_parse() {
+  parse_instructions();
+  apply_fixups(g_parsed);
+
+  cvector_vector_type(ParsedInstruction) instructions = g_parsed;
+  g_parsed = NULL;
+
+  return instructions;
+}
+
+void parser_init(const char* input) {
+  scanner_init(input);
+
+  g_symtable_len = 0;
+  g_symtable_cap = 10;
+  g_symtable = malloc(sizeof(Symbol) * g_symtable_cap);
+
+  if (!g_symtable) {
+    fprintf(stderr, "ERROR: failed to allocate memory!\n");
+    exit(1);
+  }
+
+  g_current = scanner_get_token();
+  g_address = 0;
+}
+
+void parser_deinit() {
+  free(g_symtable);
+  g_symtable = NULL;
+  g_symtable_len = 0;
+  g_symtable_cap = 0;
+  cvector_free(g_fixups);
+  g_fixups = NULL;
+  cvector_free(g_globals);
+  g_globals = NULL;
+}
+
+cvector_vector_type(ParsedLabel) parser_labels() {
+  cvector_vector_type(ParsedLabel) labels = NULL;
+
+  for (size_t i = 0; i < g_symtable_len; i++) {
+    ParsedLabel label;
+    label.name = strndup(g_symtable[i].span.start, g_symtable[i].span.length);
+    label.address = g_symtable[i].address;
+
+    if (!label.name) {
+      fprintf(stderr, "ERROR: failed to allocate memory!\n");
+      exit(1);
+    }
+
+    cvector_push_back(labels, label);
+  }
+
+  return labels;
+}
+
+void labels_free(cvector_vector_type(ParsedLabel) labels) {
+  for (ParsedLabel* it = cvector_begin(labels); it != cvector_end(labels); ++it)
+    free(it->name);
+
+  cvector_free(labels);
+}
+
+static char* read_source(const char* path) {
+  FILE* file = fopen(path, "r");
+
+  if (!file)
+    fvm_failf("cannot open: '%s'", path);
+
+  fseek(file, 0, SEEK_END);
+  size_t length = ftell(file);
+  fseek(file, 0, SEEK_SET);
+
+  char* buffer = malloc(sizeof(char) * (length + 1));
+
+  if (!buffer) {
+    fprintf(stderr, "ERROR: failed to allocate memory!\n");
+    exit(1);
+  }
+
+  length = fread(buffer, 1, length, file);
+  buffer[length] = 0;
+  fclose(file);
+
+  return buffer;
+}
+
+/* a module fvm-ld linked is linked once more on its own, which fails if
+ * it still imports anything. */
+static cvector_vector_type(int64_t) load_module(const char* path, cvector_vector_type(ParsedLabel)* labels) {
+  FVMObject object;
+
+  if (!fvm_object_read(&object, path))
+    fvm_failf("cannot load module: '%s'", path);
+
+  FVMObject linked;
+  fvm_object_link(&object, 1, &linked);
+  fvm_object_free(&object);
+
+  if (labels) {
+    *labels = NULL;
+
+    for (FVMSymbol* it = cvector_begin(linked.symbols); it != cvector_end(linked.symbols); ++it) {
+      ParsedLabel label;
+      label.name = strdup(it->name);
+      label.address = it->address;
+
+      if (!label.name) {
+        fprintf(stderr, "ERROR: failed to allocate memory!\n");
+        exit(1);
+      }
+
+      cvector_push_back(*labels, label);
+    }
+  }
+
+  cvector_vector_type(int64_t) instructions = linked.code;
+  linked.code = NULL;
+  fvm_object_free(&linked);
+
+  return instructions;
+}
+
+cvector_vector_type(int64_t) assemble_file(const char* path, cvector_vector_type(ParsedLabel)* labels) {
+  if (fvm_object_file(path))
+    return load_module(path, labels);
+
+  g_source = read_source(path);
+
+  parser_init(g_source);
+
+  cvector_vector_type(ParsedInstruction) parsed_instructions = parser_parse();
+
+  if (labels)
+    *labels = parser_labels();
+
+  parser_deinit();
+  free(g_source);
+  g_source = NULL;
+
+  cvector_vector_type(int64_t) instructions = instructions_codegen(parsed_instructions);
+  parsed_instructions_free(parsed_instructions);
+
+  return instructions;
+}
+
+void assemble_abort(void) {
+  parsed_instructions_free(g_parsed);
+  g_parsed = NULL;
+  parser_deinit();
+  free(g_source);
+  g_source = NULL;
+}
+
+static bool is_global(Span span) {
+  for (Span* it = cvector_begin(g_globals); it != cvector_end(g_globals); ++it) {
+    if (span_equals(*it, span))
+      return true;
+  }
+
+  return false;
+}
+
+static int64_t find_import(const FVMObject* object, Span span) {
+  for (size_t i = g_symtable_len; i < cvector_size(object->symbols); i++) {
+    const char* name = object->symbols[i].name;
+
+    if (strlen(name) == span.length && strncmp(name, span.start, span.length) == 0)
+      return (int64_t)i;
+  }
+
+  return -1;
+}
+
+void assemble_object(const char* path, FVMObject* object) {
+  char* buffer = read_source(path);
+
+  parser_init(buffer);
+
+  parse_instructions();
+
+  cvector_vector_type(ParsedInstruction) parsed_instructions = g_parsed;
+  g_parsed = NULL;
+
+  object->symbols = NULL;
+  object->relocations = NULL;
+
+  for (Span* it = cvector_begin(g_globals); it != cvector_end(g_globals); ++it) {
+    if (symtable_find(*it) == -1)
+      fail_at("cannot find global lable", *it);
+  }
+
+  /* the symbols start out as the symtable, so they share its indices. */
+  for (size_t i = 0; i < g_symtable_len; i++) {
+    FVMSymbol symbol;
+    symbol.name = strndup(g_symtable[i].span.start, g_symtable[i].span.length);
+    symbol.kind = is_global(g_symtable[i].span) ? FVM_SYMBOL_GLOBAL : FVM_SYMBOL_LOCAL;
+    symbol.address = g_symtable[i].address;
+
+    if (!symbol.name) {
+      fprintf(stderr, "ERROR: failed to allocate memory!\n");
+      exit(1);
+    }
+
+    cvector_push_back(object->symbols, symbol);
+  }
+
+  /* where each instruction starts. */
+  cvector_vector_type(int64_t) offsets = NULL;
+  int64_t offset = 0;
+
+  for (ParsedInstruction* it = cvector_begin(parsed_instructions); it != cvector_end(parsed_instructions); ++it) {
+    cvector_push_back(offsets, offset);
+    offset += 1 + (int64_t)(it->arguments_len + table_length(it));
+  }
+
+  object->code = instructions_codegen(parsed_instructions);
+
+  for (Fixup* it = cvector_begin(g_fixups); it != cvector_end(g_fixups); ++it) {
+    int index = symtable_find(it->span);
+
+    FVMRelocation relocation;
+    relocation.offset = offsets[it->instruction] + 1 + (int64_t)it->argument;
+    relocation.symbol = index != -1 ? index : find_import(object, it->span);
+
+    if (relocation.symbol == -1) {
+      FVMSymbol symbol;
+      symbol.name = strndup(it->span.start, it->span.length);
+      symbol.kind = FVM_SYMBOL_IMPORT;
+      symbol.address = 0;
+
+      if (!symbol.name) {
+        fprintf(stderr, "ERROR: failed to allocate memory!\n");
+        exit(1);
+      }
+
+      relocation.symbol = (int64_t)cvector_size(object->symbols);
+      cvector_push_back(object->symbols, symbol);
+    }
+
+    object->code[relocation.offset] = index != -1 ? g_symtable[index].address : 0;
+    cvector_push_back(object->relocations, relocation);
+  }
+
+  parser_deinit();
+  free(buffer);
+  cvector_free(offsets);
+  parsed_instructions_free(parsed_instructions);
 }
@@ -3,16 +3,43 @@
 #include <string.h>
 
 #include "fvm_cpu.h"
+#include "fvm_object.h"
 #include "cvector.h"
 
 typedef struct ParsedInstruction {
   Instruction instruction;
   int64_t arguments[5];
   size_t arguments_len;
+  /* the targets of a jtab, which follow its arguments. only jtab sets it. */
+  cvector_vector_type(int64_t) table;
 } ParsedInstruction;
 
+typedef struct ParsedLabel {
+  char* name;
+  int64_t address;
+} ParsedLabel;
+
 cvector_vector_type(int64_t) instructions_codegen(cvector_vector_type(ParsedInstruction) pis);
+void parsed_instructions_free(cvector_vector_type(ParsedInstruction) pis);
 
 void parser_init(const char* input);
 void parser_deinit();
 cvector_vector_type(ParsedInstruction) parser_parse();
+
+/* a copy of the labels seen by parser_parse, take it before parser_deinit. */
+cvector_vector_type(ParsedLabel) parser_labels();
+void labels_free(cvector_vector_type(ParsedLabel) labels);
+
+/* reads, parses and assembles a whole file, exiting on errors. labels gets
+ * the file's labels unless it is NULL. a module linked by fvm-ld is loaded
+ * as it is. */
+cvector_vector_type(int64_t) assemble_file(const char* path, cvector_vector_type(ParsedLabel)* labels);
+
+/* with a trap armed (see fvm_trap.h) the errors of assemble_file come back
+ * through it instead; this then frees what the parser was holding. the
+ * parser keeps global state, so only one thread may assemble at a time. */
+void assemble_abort(void);
+
+/* assembles a file into a relocatable object, turning the labels it uses
+ * but does not define into imports. exits on errors. */
+void assemble_object(const char* path, FVMObject* object);
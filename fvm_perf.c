@@ -0,0 +1,112 @@
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "fvm_perf.h"
+
+typedef struct Counter {
+  const char* name;
+  uint32_t type;
+  uint64_t config;
+} Counter;
+
+static const Counter g_counters[FVM_PERF_COUNTERS] = {
+  [FVM_PERF_TASK_CLOCK]    = { "task-clock (ns)",       PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+  [FVM_PERF_CYCLES]        = { "cycles",                PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+  [FVM_PERF_INSTRUCTIONS]  = { "instructions",          PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+  [FVM_PERF_BRANCH_MISSES] = { "branch-misses",         PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+  [FVM_PERF_L1D_MISSES]    = { "L1-dcache-load-misses", PERF_TYPE_HW_CACHE,
+                               PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+};
+
+/* what read gives back with the format set below. */
+typedef struct Reading {
+  uint64_t value;
+  uint64_t time_enabled;
+  uint64_t time_running;
+} Reading;
+
+bool fvm_perf_open(FVMPerf* perf) {
+  bool any = false;
+
+  for (int i = 0; i < FVM_PERF_COUNTERS; i++) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = g_counters[i].type;
+    attr.config = g_counters[i].config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    perf->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    perf->values[i] = 0;
+
+    if (perf->fds[i] != -1)
+      any = true;
+  }
+
+  return any;
+}
+
+void fvm_perf_close(FVMPerf* perf) {
+  for (int i = 0; i < FVM_PERF_COUNTERS; i++) {
+    if (perf->fds[i] != -1)
+      close(perf->fds[i]);
+
+    perf->fds[i] = -1;
+  }
+}
+
+void fvm_perf_start(FVMPerf* perf) {
+  for (int i = 0; i < FVM_PERF_COUNTERS; i++) {
+    if (perf->fds[i] == -1)
+      continue;
+
+    ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+    ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void fvm_perf_stop(FVMPerf* perf) {
+  for (int i = 0; i < FVM_PERF_COUNTERS; i++) {
+    if (perf->fds[i] == -1)
+      continue;
+
+    ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+    Reading reading;
+
+    if (read(perf->fds[i], &reading, sizeof(reading)) != sizeof(reading) || reading.time_running == 0) {
+      perf->values[i] = 0;
+      continue;
+    }
+
+    perf->values[i] = (double)reading.value * ((double)reading.time_enabled / (double)reading.time_running);
+  }
+}
+
+void fvm_perf_print(const FVMPerf* perf, double count, const char* unit) {
+  if (count > 0)
+    fprintf(stderr, "PERF: per %s (%.0f of them)\n", unit, count);
+  else
+    fprintf(stderr, "PERF:\n");
+
+  for (int i = 0; i < FVM_PERF_COUNTERS; i++) {
+    if (perf->fds[i] == -1)
+      fprintf(stderr, "  %-22s unavailable\n", g_counters[i].name);
+    else if (count > 0)
+      fprintf(stderr, "  %-22s %12.3f\n", g_counters[i].name, perf->values[i] / count);
+    else
+      fprintf(stderr, "  %-22s %12.0f\n", g_counters[i].name, perf->values[i]);
+  }
+
+  if (perf->fds[FVM_PERF_CYCLES] != -1 && perf->fds[FVM_PERF_INSTRUCTIONS] != -1 && perf->values[FVM_PERF_CYCLES] > 0)
+    fprintf(stderr, "  %-22s %12.3f\n", "IPC", perf->values[FVM_PERF_INSTRUCTIONS] / perf->values[FVM_PERF_CYCLES]);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* hardware counters from perf_event_open, for a look at what the dispatch
+ * loop costs the cpu rather than only how long it takes. the counters
+ * follow the calling thread and the threads it starts while they are
+ * running, user space only. each one is opened on its own, so whatever the
+ * kernel, the cpu or a container refuses is left out and the rest still
+ * works; the task clock is a software counter that is nearly always there. */
+typedef enum FVMPerfCounter {
+  FVM_PERF_TASK_CLOCK,
+  FVM_PERF_CYCLES,
+  FVM_PERF_INSTRUCTIONS,
+  FVM_PERF_BRANCH_MISSES,
+  FVM_PERF_L1D_MISSES,
+  FVM_PERF_COUNTERS,
+} FVMPerfCounter;
+
+typedef struct FVMPerf {
+  /* -1 for a counter that could not be opened. */
+  int fds[FVM_PERF_COUNTERS];
+  /* the counts between start and stop, scaled up when the kernel had to
+   * share the hardware between more counters than it has. */
+  double values[FVM_PERF_COUNTERS];
+} FVMPerf;
+
+/* false when not a single counter could be opened. */
+bool fvm_perf_open(FVMPerf* perf);
+void fvm_perf_close(FVMPerf* perf);
+
+void fvm_perf_start(FVMPerf* perf);
+void fvm_perf_stop(FVMPerf* perf);
+
+/* prints the counters to stderr, divided by count, the number of whatever
+ * unit names: "vm instruction", "message". a count of 0 prints the totals. */
+void fvm_perf_print(const FVMPerf* perf, double count, const char* unit);
@@ -0,0 +1,76 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fvm_pool.h"
+
+/* a free context holds the link to the next free one in place of its state. */
+typedef union PoolContext {
+  FVM vm;
+  union PoolContext* next;
+} PoolContext;
+
+struct FVMPoolSlab {
+  FVMPoolSlab* next;
+  PoolContext contexts[POOL_SLAB_SIZE];
+};
+
+static void add_slab(FVMPool* pool) {
+  FVMPoolSlab* slab = malloc(sizeof(FVMPoolSlab));
+
+  if (!slab) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  slab->next = pool->slabs;
+  pool->slabs = slab;
+
+  /* threaded back to front so contexts are handed out in address order. */
+  for (size_t i = POOL_SLAB_SIZE; i-- > 0;) {
+    slab->contexts[i].next = (PoolContext*)pool->free;
+    pool->free = &slab->contexts[i].vm;
+  }
+}
+
+void fvm_pool_init(FVMPool* pool) {
+  pool->slabs = NULL;
+  pool->free = NULL;
+  pool->live = 0;
+}
+
+void fvm_pool_deinit(FVMPool* pool) {
+  if (pool->live) {
+    fprintf(stderr, "ERROR: %zu vms are still in use!\n", pool->live);
+    exit(1);
+  }
+
+  while (pool->slabs) {
+    FVMPoolSlab* next = pool->slabs->next;
+    free(pool->slabs);
+    pool->slabs = next;
+  }
+
+  pool->free = NULL;
+}
+
+FVM* fvm_pool_new(FVMPool* pool, const FVMProgram* program, size_t stack_size) {
+  if (!pool->free)
+    add_slab(pool);
+
+  PoolContext* context = (PoolContext*)pool->free;
+  pool->free = (FVM*)context->next;
+  pool->live += 1;
+
+  fvm_init(&context->vm, program, stack_size);
+
+  return &context->vm;
+}
+
+void fvm_pool_delete(FVMPool* pool, FVM* vm) {
+  fvm_deinit(vm);
+
+  PoolContext* context = (PoolContext*)vm;
+  context->next = (PoolContext*)pool->free;
+  pool->free = &context->vm;
+  pool->live -= 1;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stddef.h>
+
+#include "fvm.h"
+
+#define POOL_SLAB_SIZE 4096
+
+typedef struct FVMPoolSlab FVMPoolSlab;
+
+/* hands out vm contexts from slabs of POOL_SLAB_SIZE, so creating and
+ * destroying a vm is a free list push or pop instead of a malloc. freed
+ * contexts are reused, slabs are only returned by fvm_pool_deinit. a pool
+ * is not thread safe, give each thread its own. */
+typedef struct FVMPool {
+  FVMPoolSlab* slabs;
+  FVM* free;
+  size_t live;
+} FVMPool;
+
+void fvm_pool_init(FVMPool* pool);
+
+/* every vm taken from the pool has to be deleted before this. */
+void fvm_pool_deinit(FVMPool* pool);
+
+/* an initialized vm, as if by fvm_init. */
+FVM* fvm_pool_new(FVMPool* pool, const FVMProgram* program, size_t stack_size);
+
+/* deinitializes vm and puts it back. */
+void fvm_pool_delete(FVMPool* pool, FVM* vm);
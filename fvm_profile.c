@@ -0,0 +1,305 @@
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "fvm_profile.h"
+
+typedef struct Entry {
+  const char* name;
+  int64_t samples;
+} Entry;
+
+/* counts[address], the last one for samples that found no vm running or
+ * one that had jumped out of the program. */
+static _Atomic int64_t* g_counts;
+static size_t g_length;
+static int64_t g_hz;
+static _Thread_local const volatile int64_t* t_ip;
+
+static void on_sample(int signal) {
+  (void)signal;
+
+  const volatile int64_t* ip = t_ip;
+  uint64_t address = ip ? (uint64_t)*ip : g_length;
+
+  if (address > g_length)
+    address = g_length;
+
+  atomic_fetch_add_explicit(&g_counts[address], 1, memory_order_relaxed);
+}
+
+void fvm_profile_start(size_t length, int64_t hz) {
+  if (hz < 1 || hz > 1000000) {
+    fprintf(stderr, "ERROR: cannot sample %ld times per second!\n", hz);
+    exit(1);
+  }
+
+  g_length = length;
+  g_hz = hz;
+  g_counts = calloc(length + 1, sizeof(*g_counts));
+
+  if (!g_counts) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = on_sample;
+  /* a vm waiting in read shouldn't see the samples. */
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+
+  if (sigaction(SIGPROF, &action, NULL) != 0) {
+    fprintf(stderr, "ERROR: cannot install the profiler!\n");
+    exit(1);
+  }
+
+  struct itimerval timer;
+  timer.it_interval.tv_sec = 0;
+  timer.it_interval.tv_usec = 1000000 / hz;
+  timer.it_value = timer.it_interval;
+
+  if (setitimer(ITIMER_PROF, &timer, NULL) != 0) {
+    fprintf(stderr, "ERROR: cannot start the profiler!\n");
+    exit(1);
+  }
+}
+
+void fvm_profile_stop(void) {
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  setitimer(ITIMER_PROF, &timer, NULL);
+
+  /* a sample may still be pending, it must not kill the process. */
+  signal(SIGPROF, SIG_IGN);
+}
+
+void fvm_profile_activate(const FVM* vm) {
+  t_ip = vm ? &vm->registers[REG_IP] : NULL;
+}
+
+static int compare_labels(const void* a, const void* b) {
+  const ParsedLabel* left = a;
+  const ParsedLabel* right = b;
+
+  return (left->address > right->address) - (left->address < right->address);
+}
+
+static int compare_entries(const void* a, const void* b) {
+  const Entry* left = a;
+  const Entry* right = b;
+
+  return (left->samples < right->samples) - (left->samples > right->samples);
+}
+
+void fvm_profile_report(cvector_vector_type(ParsedLabel) labels) {
+  size_t labels_len = cvector_size(labels);
+  ParsedLabel* sorted = malloc(sizeof(ParsedLabel) * (labels_len + 1));
+  /* one per label, then code before the first label and outside the vm. */
+  Entry* entries = calloc(labels_len + 2, sizeof(Entry));
+
+  if (!sorted || !entries) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  if (labels_len)
+    memcpy(sorted, labels, sizeof(ParsedLabel) * labels_len);
+
+  qsort(sorted, labels_len, sizeof(ParsedLabel), compare_labels);
+
+  for (size_t i = 0; i < labels_len; i++)
+    entries[i].name = sorted[i].name;
+
+  entries[labels_len].name = "(before the first label)";
+  entries[labels_len + 1].name = "(outside the vm)";
+
+  int64_t total = 0;
+  /* the first label past address. */
+  size_t next = 0;
+
+  for (size_t address = 0; address < g_length; address++) {
+    while (next < labels_len && sorted[next].address <= (int64_t)address)
+      next++;
+
+    int64_t samples = atomic_load(&g_counts[address]);
+    entries[next ? next - 1 : labels_len].samples += samples;
+    total += samples;
+  }
+
+  entries[labels_len + 1].samples = atomic_load(&g_counts[g_length]);
+  total += entries[labels_len + 1].samples;
+
+  qsort(entries, labels_len + 2, sizeof(Entry), compare_entries);
+
+  fprintf(stderr, "PROFILE: %ld samples at %ld Hz\n", total, g_hz);
+
+  for (size_t i = 0; i < labels_len + 2 && entries[i].samples; i++)
+    fprintf(stderr, "  %5.1f%% %8ld  %s\n", 100.0 * (double)entries[i].samples / (double)total, entries[i].samples,
+            entries[i].name);
+
+  free(sorted);
+  free(entries);
+  free(g_counts);
+  g_counts = NULL;
+}
+
+void fvm_block_profile_init(FVMBlockProfile* profile, size_t length) {
+  profile->length = length;
+  profile->executed = calloc(length + 1, sizeof(int64_t));
+  profile->taken = calloc(length + 1, sizeof(int64_t));
+
+  if (!profile->executed || !profile->taken) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+}
+
+void fvm_block_profile_free(FVMBlockProfile* profile) {
+  free(profile->executed);
+  free(profile->taken);
+  profile->executed = NULL;
+  profile->taken = NULL;
+}
+
+static int64_t next_address(const FVMProgram* program, int64_t address) {
+  const InstructionInfo* info = instruction_info(program->instructions[address]);
+  size_t available = program->length - (size_t)address;
+
+  return address + (info ? (int64_t)instruction_length(info, &program->instructions[address], available) : 1);
+}
+
+/* the address of the branch that ends the run starting at address. */
+static int64_t run_end(const FVMProgram* program, int64_t address) {
+  int64_t cost = program->run_costs[address];
+
+  for (int64_t i = 1; i < cost; i++)
+    address = next_address(program, address);
+
+  return address;
+}
+
+int64_t fvm_block_profile_run(FVM* vm, FVMBlockProfile* profile) {
+  const FVMProgram* program = vm->program;
+  int64_t length = (int64_t)program->length;
+  /* per address, how many runs started there, and the end of those runs
+   * once known. */
+  int64_t* starts = calloc(length + 1, sizeof(int64_t));
+  int64_t* ends = malloc(sizeof(int64_t) * (length + 1));
+  int64_t executed = 0;
+
+  if (!starts || !ends) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (int64_t i = 0; i <= length; i++)
+    ends[i] = -1;
+
+  /* fvm_run_for stops after the branch that ends a run when the budget is
+   * exactly what the run costs. */
+  while (vm->running) {
+    int64_t ip = vm->registers[REG_IP];
+
+    if (ip < 0 || ip >= length) {
+      fvm_run_for(vm, 1);
+      continue;
+    }
+
+    int64_t cost = program->run_costs[ip];
+
+    if (ends[ip] == -1)
+      ends[ip] = run_end(program, ip);
+
+    fvm_run_for(vm, cost);
+
+    starts[ip] += 1;
+    executed += cost;
+
+    if (vm->running && vm->registers[REG_IP] != next_address(program, ends[ip]))
+      profile->taken[ends[ip]] += 1;
+  }
+
+  for (int64_t ip = 0; ip < length; ip++) {
+    if (!starts[ip])
+      continue;
+
+    for (int64_t address = ip;; address = next_address(program, address)) {
+      profile->executed[address] += starts[ip];
+
+      if (address == ends[ip])
+        break;
+    }
+  }
+
+  free(starts);
+  free(ends);
+
+  return executed;
+}
+
+bool fvm_block_profile_write(const FVMBlockProfile* profile, const char* path) {
+  FILE* file = fopen(path, "w");
+
+  if (!file) {
+    fprintf(stderr, "ERROR: cannot open: '%s'\n", path);
+    return false;
+  }
+
+  fprintf(file, "%zu\n", profile->length);
+
+  for (size_t address = 0; address < profile->length; address++) {
+    if (profile->executed[address])
+      fprintf(file, "%zu %ld %ld\n", address, profile->executed[address], profile->taken[address]);
+  }
+
+  if (fclose(file) != 0) {
+    fprintf(stderr, "ERROR: cannot write profile: '%s'\n", path);
+    return false;
+  }
+
+  return true;
+}
+
+bool fvm_block_profile_read(FVMBlockProfile* profile, const char* path) {
+  FILE* file = fopen(path, "r");
+
+  if (!file) {
+    fprintf(stderr, "ERROR: cannot open: '%s'\n", path);
+    return false;
+  }
+
+  size_t length;
+
+  if (fscanf(file, "%zu", &length) != 1) {
+    fprintf(stderr, "ERROR: not a valid profile: '%s'\n", path);
+    fclose(file);
+    return false;
+  }
+
+  fvm_block_profile_init(profile, length);
+
+  size_t address;
+  int64_t executed;
+  int64_t taken;
+  int fields;
+
+  while ((fields = fscanf(file, "%zu %ld %ld", &address, &executed, &taken)) == 3 && address < length) {
+    profile->executed[address] = executed;
+    profile->taken[address] = taken;
+  }
+
+  fclose(file);
+
+  if (fields != EOF) {
+    fprintf(stderr, "ERROR: not a valid profile: '%s'\n", path);
+    fvm_block_profile_free(profile);
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fvm.h"
+#include "fvm_parser.h"
+
+/* a sampling profiler. a SIGPROF timer, running on the cpu time of the
+ * process, interrupts whichever thread is busy and the handler counts the
+ * instruction its vm is at. nothing is added to the dispatch loop: the vm
+ * keeps IP in its registers array anyway, fvm_execute and fvm_run_for only
+ * tell the handler whose registers to look at. the counters, one per
+ * address, are allocated up front and the handler just increments one, so
+ * sampling at 1000 Hz costs well under a percent. */
+
+/* samples a program of length cells hz times per second of cpu time. */
+void fvm_profile_start(size_t length, int64_t hz);
+void fvm_profile_stop(void);
+
+/* the vm the calling thread runs from now on, NULL when it stops running
+ * one. */
+void fvm_profile_activate(const FVM* vm);
+
+/* prints the samples per label, the closest one at or before the address,
+ * most samples first, to stderr. */
+void fvm_profile_report(cvector_vector_type(ParsedLabel) labels);
+
+/* exact counts for the block layout pass of fvm_optimize, recorded on a
+ * run of the program as it was assembled. per address, how often the
+ * instruction there ran and, for a branch, how often it did not fall
+ * through to the next instruction. */
+typedef struct FVMBlockProfile {
+  size_t length;
+  int64_t* executed;
+  int64_t* taken;
+} FVMBlockProfile;
+
+void fvm_block_profile_init(FVMBlockProfile* profile, size_t length);
+void fvm_block_profile_free(FVMBlockProfile* profile);
+
+/* runs a vm that is not a fiber to the end, like fvm_execute, but one
+ * stretch of straight-line code at a time, and counts into profile.
+ * returns the number of instructions executed. */
+int64_t fvm_block_profile_run(FVM* vm, FVMBlockProfile* profile);
+
+/* a text file with the program's length on the first line, then the
+ * address, execution count and taken count of every instruction that ran. */
+bool fvm_block_profile_write(const FVMBlockProfile* profile, const char* path);
+bool fvm_block_profile_read(FVMBlockProfile* profile, const char* path);
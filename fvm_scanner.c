@@ -1,7 +1,9 @@
 #include <ctype.h>
 #include <stdlib.h>
 
+#include "fvm_cpu.h"
 #include "fvm_scanner.h"
+#include "fvm_trap.h"
 
 Span span_new(const char* start, size_t length) {
   Span span;
@@ -101,22 +103,25 @@ Token scanner_get_token() {
       return token_new(TOK_LABLE, span);
     }
 
-    if (span_equals(span, span_from("A"))) {
-      return token_new(TOK_REG_A, span);
-    } else if (span_equals(span, span_from("B"))) {
-      return token_new(TOK_REG_B, span);
-    } else if (span_equals(span, span_from("C"))) {
-      return token_new(TOK_REG_C, span);
-    } else if (span_equals(span, span_from("D"))) {
-      return token_new(TOK_REG_D, span);
-    } else if (span_equals(span, span_from("E"))) {
-      return token_new(TOK_REG_E, span);
-    } else if (span_equals(span, span_from("F"))) {
-      return token_new(TOK_REG_F, span);
-    } else if (span_equals(span, span_from("IP"))) {
-      return token_new(TOK_REG_IP, span);
-    } else if (span_equals(span, span_from("SP"))) {
-      return token_new(TOK_REG_IP, span);
+    if (register_from_name(span.start, span.length) != -1)
+      return token_new(TOK_REGISTER, span);
+
+    if (span_equals(span, span_from("V0"))) {
+      return token_new(TOK_VREG_0, span);
+    } else if (span_equals(span, span_from("V1"))) {
+      return token_new(TOK_VREG_1, span);
+    } else if (span_equals(span, span_from("V2"))) {
+      return token_new(TOK_VREG_2, span);
+    } else if (span_equals(span, span_from("V3"))) {
+      return token_new(TOK_VREG_3, span);
+    } else if (span_equals(span, span_from("V4"))) {
+      return token_new(TOK_VREG_4, span);
+    } else if (span_equals(span, span_from("V5"))) {
+      return token_new(TOK_VREG_5, span);
+    } else if (span_equals(span, span_from("V6"))) {
+      return token_new(TOK_VREG_6, span);
+    } else if (span_equals(span, span_from("V7"))) {
+      return token_new(TOK_VREG_7, span);
     }
 
     if (span_equals(span, span_from("halt"))) {
@@ -151,12 +156,92 @@ Token scanner_get_token() {
       return token_new(TOK_JGE, span);
     } else if (span_equals(span, span_from("jle"))) {
       return token_new(TOK_JLE, span);
+    } else if (span_equals(span, span_from("call"))) {
+      return token_new(TOK_CALL, span);
+    } else if (span_equals(span, span_from("ret"))) {
+      return token_new(TOK_RET, span);
+    } else if (span_equals(span, span_from("enter"))) {
+      return token_new(TOK_ENTER, span);
+    } else if (span_equals(span, span_from("leave"))) {
+      return token_new(TOK_LEAVE, span);
+    } else if (span_equals(span, span_from("load"))) {
+      return token_new(TOK_LOAD, span);
+    } else if (span_equals(span, span_from("store"))) {
+      return token_new(TOK_STORE, span);
+    } else if (span_equals(span, span_from("putc"))) {
+      return token_new(TOK_PUTC, span);
+    } else if (span_equals(span, span_from("puti"))) {
+      return token_new(TOK_PUTI, span);
+    } else if (span_equals(span, span_from("write"))) {
+      return token_new(TOK_WRITE, span);
+    } else if (span_equals(span, span_from("read"))) {
+      return token_new(TOK_READ, span);
+    } else if (span_equals(span, span_from("native"))) {
+      return token_new(TOK_NATIVE, span);
+    } else if (span_equals(span, span_from("vload"))) {
+      return token_new(TOK_VLOAD, span);
+    } else if (span_equals(span, span_from("vstore"))) {
+      return token_new(TOK_VSTORE, span);
+    } else if (span_equals(span, span_from("vadd"))) {
+      return token_new(TOK_VADD, span);
+    } else if (span_equals(span, span_from("vsub"))) {
+      return token_new(TOK_VSUB, span);
+    } else if (span_equals(span, span_from("vmul"))) {
+      return token_new(TOK_VMUL, span);
+    } else if (span_equals(span, span_from("vcmp"))) {
+      return token_new(TOK_VCMP, span);
+    } else if (span_equals(span, span_from("vsum"))) {
+      return token_new(TOK_VSUM, span);
+    } else if (span_equals(span, span_from("mcopy"))) {
+      return token_new(TOK_MCOPY, span);
+    } else if (span_equals(span, span_from("mfill"))) {
+      return token_new(TOK_MFILL, span);
+    } else if (span_equals(span, span_from("mcmp"))) {
+      return token_new(TOK_MCMP, span);
+    } else if (span_equals(span, span_from("spawn"))) {
+      return token_new(TOK_SPAWN, span);
+    } else if (span_equals(span, span_from("yield"))) {
+      return token_new(TOK_YIELD, span);
+    } else if (span_equals(span, span_from("join"))) {
+      return token_new(TOK_JOIN, span);
+    } else if (span_equals(span, span_from("chan"))) {
+      return token_new(TOK_CHAN, span);
+    } else if (span_equals(span, span_from("send"))) {
+      return token_new(TOK_SEND, span);
+    } else if (span_equals(span, span_from("recv"))) {
+      return token_new(TOK_RECV, span);
+    } else if (span_equals(span, span_from("sload"))) {
+      return token_new(TOK_SLOAD, span);
+    } else if (span_equals(span, span_from("sstore"))) {
+      return token_new(TOK_SSTORE, span);
+    } else if (span_equals(span, span_from("xadd"))) {
+      return token_new(TOK_XADD, span);
+    } else if (span_equals(span, span_from("xchg"))) {
+      return token_new(TOK_XCHG, span);
+    } else if (span_equals(span, span_from("cas"))) {
+      return token_new(TOK_CAS, span);
+    } else if (span_equals(span, span_from("fence"))) {
+      return token_new(TOK_FENCE, span);
+    } else if (span_equals(span, span_from("alloc"))) {
+      return token_new(TOK_ALLOC, span);
+    } else if (span_equals(span, span_from("free"))) {
+      return token_new(TOK_FREE, span);
+    } else if (span_equals(span, span_from("hload"))) {
+      return token_new(TOK_HLOAD, span);
+    } else if (span_equals(span, span_from("hstore"))) {
+      return token_new(TOK_HSTORE, span);
+    } else if (span_equals(span, span_from("hreset"))) {
+      return token_new(TOK_HRESET, span);
+    } else if (span_equals(span, span_from("jtab"))) {
+      return token_new(TOK_JTAB, span);
+    } else if (span_equals(span, span_from("global"))) {
+      return token_new(TOK_GLOBAL, span);
     }
 
     return token_new(TOK_IDENTIFIER, span);
   }
 
-  if (isdigit(current())) {
+  if (isdigit(current()) || (current() == '-' && isdigit(g_input[1]))) {
     size_t length = 0;
 
     do {
@@ -182,8 +267,7 @@ Token scanner_get_token() {
     }
 
     if (current() != '\'') {
-      fprintf(stderr, "ERROR: unclosed char literal!\n");
-      exit(1);
+      fvm_fail("unclosed char literal!");
     }
 
     advance();
@@ -195,8 +279,7 @@ Token scanner_get_token() {
     }
   }
 
-  fprintf(stderr, "ERROR: found garbage token: '%c'\n", *start);
-  exit(1);
+  fvm_failf("found garbage token: '%c'", *start);
 }
 
 void scanner_init(const char* input) {
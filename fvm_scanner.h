@@ -22,6 +22,9 @@ typedef enum TokenType {
 
   TOK_COMMA,
 
+  /* global label, exports a label from an object. */
+  TOK_GLOBAL,
+
   TOK_HALT,
   TOK_PUSH,
   TOK_POP,
@@ -38,15 +41,57 @@ typedef enum TokenType {
   TOK_JL,   
   TOK_JGE,  
   TOK_JLE,  
+  TOK_CALL,
+  TOK_RET,
+  TOK_ENTER,
+  TOK_LEAVE,
+  TOK_LOAD,
+  TOK_STORE,
+  TOK_PUTC,
+  TOK_PUTI,
+  TOK_WRITE,
+  TOK_READ,
+  TOK_NATIVE,
+  TOK_VLOAD,
+  TOK_VSTORE,
+  TOK_VADD,
+  TOK_VSUB,
+  TOK_VMUL,
+  TOK_VCMP,
+  TOK_VSUM,
+  TOK_MCOPY,
+  TOK_MFILL,
+  TOK_MCMP,
+  TOK_SPAWN,
+  TOK_YIELD,
+  TOK_JOIN,
+  TOK_CHAN,
+  TOK_SEND,
+  TOK_RECV,
+  TOK_SLOAD,
+  TOK_SSTORE,
+  TOK_XADD,
+  TOK_XCHG,
+  TOK_CAS,
+  TOK_FENCE,
+  TOK_ALLOC,
+  TOK_FREE,
+  TOK_HLOAD,
+  TOK_HSTORE,
+  TOK_HRESET,
+  TOK_JTAB,
+
+  /* A to F, R0 to R31, IP, SP and FP. */
+  TOK_REGISTER,
 
-  TOK_REG_A,
-  TOK_REG_B,
-  TOK_REG_C,
-  TOK_REG_D,
-  TOK_REG_E,
-  TOK_REG_F,
-  TOK_REG_IP,
-  TOK_REG_SP,
+  TOK_VREG_0,
+  TOK_VREG_1,
+  TOK_VREG_2,
+  TOK_VREG_3,
+  TOK_VREG_4,
+  TOK_VREG_5,
+  TOK_VREG_6,
+  TOK_VREG_7,
 
   TOK_EOF,
 } TokenType;
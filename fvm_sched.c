@@ -0,0 +1,434 @@
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fvm_channel.h"
+#include "fvm_sched.h"
+#include "fvm_shared.h"
+#include "fvm_trap.h"
+
+#define JOIN_LOCKS 64
+
+/* a fiber's record stays after it halted so it can still be joined. */
+typedef struct Fiber {
+  FVM* vm;
+  FVM own;
+  int64_t result;
+  bool done;
+  /* fibers blocked in join on this one, linked through next_waiter. */
+  struct Fiber* waiters;
+  struct Fiber* next_waiter;
+} Fiber;
+
+/* the owner pushes and pops new fibers at the bottom, preempted ones go to
+ * the top where thieves take from. */
+typedef struct RunQueue {
+  pthread_mutex_t lock;
+  Fiber** items;
+  size_t head;
+  size_t len;
+  size_t capacity;
+} RunQueue;
+
+typedef struct Worker {
+  FVMScheduler* scheduler;
+  pthread_t thread;
+  RunQueue queue;
+  uint64_t seed;
+} Worker;
+
+struct FVMScheduler {
+  Worker* workers;
+  size_t threads;
+  /* fiber records by id, in chunks that never move. */
+  pthread_mutex_t table_lock;
+  _Atomic(Fiber*) chunks[FIBER_CHUNKS];
+  atomic_int_fast64_t fibers;
+  atomic_int_fast64_t live;
+  /* live fibers parked in join or on a channel. */
+  atomic_int_fast64_t waiting;
+  atomic_size_t queued;
+  atomic_size_t sleeping;
+  atomic_bool finished;
+  pthread_mutex_t idle_lock;
+  pthread_cond_t idle;
+  /* guard done, result, waiters and the vm pointer of the fibers hashed to them. */
+  pthread_mutex_t join_locks[JOIN_LOCKS];
+};
+
+static _Thread_local Worker* t_worker;
+
+static void* checked(void* pointer) {
+  if (!pointer) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  return pointer;
+}
+
+static void queue_grow(RunQueue* queue) {
+  size_t capacity = queue->capacity ? queue->capacity * 2 : 64;
+  Fiber** items = checked(malloc(sizeof(Fiber*) * capacity));
+
+  for (size_t i = 0; i < queue->len; i++)
+    items[i] = queue->items[(queue->head + i) % queue->capacity];
+
+  free(queue->items);
+  queue->items = items;
+  queue->head = 0;
+  queue->capacity = capacity;
+}
+
+static void queue_push(RunQueue* queue, Fiber* fiber, bool top) {
+  pthread_mutex_lock(&queue->lock);
+
+  if (queue->len == queue->capacity)
+    queue_grow(queue);
+
+  if (top) {
+    queue->head = (queue->head + queue->capacity - 1) % queue->capacity;
+    queue->items[queue->head] = fiber;
+  } else {
+    queue->items[(queue->head + queue->len) % queue->capacity] = fiber;
+  }
+
+  queue->len += 1;
+
+  pthread_mutex_unlock(&queue->lock);
+}
+
+static Fiber* queue_pop(RunQueue* queue, bool top) {
+  Fiber* fiber = NULL;
+
+  pthread_mutex_lock(&queue->lock);
+
+  if (queue->len > 0) {
+    queue->len -= 1;
+
+    if (top) {
+      fiber = queue->items[queue->head];
+      queue->head = (queue->head + 1) % queue->capacity;
+    } else {
+      fiber = queue->items[(queue->head + queue->len) % queue->capacity];
+    }
+  }
+
+  pthread_mutex_unlock(&queue->lock);
+
+  return fiber;
+}
+
+static Fiber* fiber_at(FVMScheduler* scheduler, int64_t id) {
+  Fiber* chunk = atomic_load(&scheduler->chunks[id / FIBER_CHUNK]);
+  return chunk ? &chunk[id % FIBER_CHUNK] : NULL;
+}
+
+static Fiber* fiber_new(FVMScheduler* scheduler, int64_t id) {
+  if (id >= (int64_t)FIBER_CHUNK * FIBER_CHUNKS)
+    fvm_fail("too many fibers!");
+
+  _Atomic(Fiber*)* slot = &scheduler->chunks[id / FIBER_CHUNK];
+
+  if (!atomic_load(slot)) {
+    pthread_mutex_lock(&scheduler->table_lock);
+
+    if (!atomic_load(slot))
+      atomic_store(slot, checked(calloc(FIBER_CHUNK, sizeof(Fiber))));
+
+    pthread_mutex_unlock(&scheduler->table_lock);
+  }
+
+  return fiber_at(scheduler, id);
+}
+
+static pthread_mutex_t* join_lock(FVMScheduler* scheduler, int64_t id) {
+  return &scheduler->join_locks[id % JOIN_LOCKS];
+}
+
+/* new and woken fibers run next on this thread, preempted ones last. */
+static void enqueue(FVMScheduler* scheduler, Worker* worker, Fiber* fiber, bool last) {
+  /* counted first, so queued never drops below what the queues hold. */
+  atomic_fetch_add(&scheduler->queued, 1);
+  queue_push(&worker->queue, fiber, last);
+
+  if (atomic_load(&scheduler->sleeping) > 0) {
+    pthread_mutex_lock(&scheduler->idle_lock);
+    pthread_cond_signal(&scheduler->idle);
+    pthread_mutex_unlock(&scheduler->idle_lock);
+  }
+}
+
+static Fiber* take(FVMScheduler* scheduler, Worker* worker) {
+  Fiber* fiber = queue_pop(&worker->queue, false);
+
+  if (!fiber) {
+    /* xorshift picks where to start looking. */
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 7;
+    worker->seed ^= worker->seed << 17;
+
+    size_t start = worker->seed % scheduler->threads;
+
+    for (size_t i = 0; i < scheduler->threads && !fiber; i++) {
+      Worker* victim = &scheduler->workers[(start + i) % scheduler->threads];
+
+      if (victim != worker)
+        fiber = queue_pop(&victim->queue, true);
+    }
+  }
+
+  if (fiber)
+    atomic_fetch_sub(&scheduler->queued, 1);
+
+  return fiber;
+}
+
+static void wait_for_work(FVMScheduler* scheduler) {
+  pthread_mutex_lock(&scheduler->idle_lock);
+  atomic_fetch_add(&scheduler->sleeping, 1);
+
+  /* nobody runs and nothing is queued, yet some fiber has not halted. */
+  if (atomic_load(&scheduler->sleeping) == scheduler->threads && atomic_load(&scheduler->queued) == 0 &&
+      !atomic_load(&scheduler->finished) && atomic_load(&scheduler->waiting) == atomic_load(&scheduler->live))
+    fvm_fail("deadlock: every fiber is waiting in join or on a channel!");
+
+  while (!atomic_load(&scheduler->finished) && atomic_load(&scheduler->queued) == 0)
+    pthread_cond_wait(&scheduler->idle, &scheduler->idle_lock);
+
+  atomic_fetch_sub(&scheduler->sleeping, 1);
+  pthread_mutex_unlock(&scheduler->idle_lock);
+}
+
+/* a blocked fiber is only put on the waiter list once its thread is done
+ * with it, so whoever wakes it can't start running it too early. */
+static void park(FVMScheduler* scheduler, Worker* worker, Fiber* fiber) {
+  /* counted before it can be woken, the wakeup takes it off again. */
+  atomic_fetch_add(&scheduler->waiting, 1);
+
+  if (fiber->vm->channel) {
+    if (!fvm_channel_park(fiber->vm)) {
+      atomic_fetch_sub(&scheduler->waiting, 1);
+      enqueue(scheduler, worker, fiber, false);
+    }
+
+    return;
+  }
+
+  int64_t id = fiber->vm->joining;
+  Fiber* target = fiber_at(scheduler, id);
+  pthread_mutex_t* lock = join_lock(scheduler, id);
+
+  pthread_mutex_lock(lock);
+  bool done = target->done;
+
+  if (!done) {
+    fiber->next_waiter = target->waiters;
+    target->waiters = fiber;
+  }
+
+  pthread_mutex_unlock(lock);
+
+  if (done) {
+    atomic_fetch_sub(&scheduler->waiting, 1);
+    enqueue(scheduler, worker, fiber, false);
+  }
+}
+
+static void finish(FVMScheduler* scheduler, Worker* worker, Fiber* fiber) {
+  pthread_mutex_t* lock = join_lock(scheduler, fiber->vm->fiber);
+
+  pthread_mutex_lock(lock);
+  fiber->done = true;
+  fiber->result = fiber->vm->registers[REG_A];
+  Fiber* waiters = fiber->waiters;
+  fiber->waiters = NULL;
+  pthread_mutex_unlock(lock);
+
+  while (waiters) {
+    Fiber* next = waiters->next_waiter;
+    atomic_fetch_sub(&scheduler->waiting, 1);
+    enqueue(scheduler, worker, waiters, false);
+    waiters = next;
+  }
+
+  /* fiber 0 belongs to the caller, the others give back their stacks. */
+  if (fiber->vm == &fiber->own)
+    fvm_deinit(&fiber->own);
+
+  if (atomic_fetch_sub(&scheduler->live, 1) == 1) {
+    pthread_mutex_lock(&scheduler->idle_lock);
+    atomic_store(&scheduler->finished, true);
+    pthread_cond_broadcast(&scheduler->idle);
+    pthread_mutex_unlock(&scheduler->idle_lock);
+  }
+}
+
+static void* work(void* arg) {
+  Worker* worker = arg;
+  FVMScheduler* scheduler = worker->scheduler;
+  t_worker = worker;
+
+  while (!atomic_load(&scheduler->finished)) {
+    Fiber* fiber = take(scheduler, worker);
+
+    if (!fiber) {
+      wait_for_work(scheduler);
+      continue;
+    }
+
+    switch (fvm_run_for(fiber->vm, FIBER_QUANTUM)) {
+    case FVM_PREEMPTED:
+      fvm_stack_park(&fiber->vm->stack, FIBER_PARK_LIMIT);
+      enqueue(scheduler, worker, fiber, true);
+      break;
+    case FVM_BLOCKED:
+      fvm_stack_park(&fiber->vm->stack, FIBER_PARK_LIMIT);
+      park(scheduler, worker, fiber);
+      break;
+    case FVM_HALTED:
+      finish(scheduler, worker, fiber);
+      break;
+    }
+  }
+
+  t_worker = NULL;
+
+  return NULL;
+}
+
+int64_t fvm_sched_spawn(FVM* parent, int64_t address) {
+  FVMScheduler* scheduler = parent->scheduler;
+  int64_t id = atomic_fetch_add(&scheduler->fibers, 1);
+  Fiber* fiber = fiber_new(scheduler, id);
+  FVM* vm = &fiber->own;
+
+  fvm_init(vm, parent->program, parent->stack.reserved / sizeof(int64_t));
+
+  if (parent->input.fd != STDIN_FILENO || parent->output.fd != STDOUT_FILENO)
+    fvm_redirect(vm, parent->input.fd, parent->output.fd);
+
+  for (int reg = REG_A; reg <= REG_F; reg++)
+    vm->registers[reg] = parent->registers[reg];
+
+  fvm_shared_attach(vm, parent->shared);
+  fvm_channels_attach(vm, fvm_channels(parent));
+
+  vm->registers[REG_IP] = address;
+  vm->scheduler = scheduler;
+  vm->fiber = id;
+
+  /* joinable from here on. */
+  pthread_mutex_lock(join_lock(scheduler, id));
+  fiber->vm = vm;
+  pthread_mutex_unlock(join_lock(scheduler, id));
+
+  atomic_fetch_add(&scheduler->live, 1);
+  enqueue(scheduler, t_worker, fiber, false);
+
+  return id;
+}
+
+void fvm_sched_wake(FVM* vm) {
+  FVMScheduler* scheduler = vm->scheduler;
+  Worker* worker = t_worker && t_worker->scheduler == scheduler ? t_worker : &scheduler->workers[0];
+
+  atomic_fetch_sub(&scheduler->waiting, 1);
+  enqueue(scheduler, worker, fiber_at(scheduler, vm->fiber), false);
+}
+
+bool fvm_sched_joinable(FVM* vm, int64_t fiber) {
+  FVMScheduler* scheduler = vm->scheduler;
+
+  if (fiber < 0 || fiber >= atomic_load(&scheduler->fibers) || fiber == vm->fiber)
+    return false;
+
+  Fiber* target = fiber_at(scheduler, fiber);
+
+  if (!target)
+    return false;
+
+  pthread_mutex_lock(join_lock(scheduler, fiber));
+  bool joinable = target->vm != NULL;
+  pthread_mutex_unlock(join_lock(scheduler, fiber));
+
+  return joinable;
+}
+
+bool fvm_sched_result(FVM* vm, int64_t fiber, int64_t* result) {
+  FVMScheduler* scheduler = vm->scheduler;
+  Fiber* target = fiber_at(scheduler, fiber);
+
+  pthread_mutex_lock(join_lock(scheduler, fiber));
+  bool done = target->done;
+  *result = target->result;
+  pthread_mutex_unlock(join_lock(scheduler, fiber));
+
+  return done;
+}
+
+void fvm_schedule(FVM* vm, size_t threads) {
+  if (!threads) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (size_t)cpus : 1;
+  }
+
+  FVMScheduler* scheduler = checked(calloc(1, sizeof(FVMScheduler)));
+  scheduler->threads = threads;
+  scheduler->workers = checked(calloc(threads, sizeof(Worker)));
+  pthread_mutex_init(&scheduler->table_lock, NULL);
+  pthread_mutex_init(&scheduler->idle_lock, NULL);
+  pthread_cond_init(&scheduler->idle, NULL);
+
+  for (size_t i = 0; i < JOIN_LOCKS; i++)
+    pthread_mutex_init(&scheduler->join_locks[i], NULL);
+
+  for (size_t i = 0; i < threads; i++) {
+    scheduler->workers[i].scheduler = scheduler;
+    scheduler->workers[i].seed = 0x9e3779b97f4a7c15ull * (i + 1);
+    pthread_mutex_init(&scheduler->workers[i].queue.lock, NULL);
+  }
+
+  Fiber* main = fiber_new(scheduler, 0);
+  main->vm = vm;
+  vm->scheduler = scheduler;
+  vm->fiber = 0;
+
+  atomic_store(&scheduler->fibers, 1);
+  atomic_store(&scheduler->live, 1);
+  enqueue(scheduler, &scheduler->workers[0], main, false);
+
+  for (size_t i = 1; i < threads; i++) {
+    if (pthread_create(&scheduler->workers[i].thread, NULL, work, &scheduler->workers[i]) != 0) {
+      fprintf(stderr, "ERROR: cannot start a scheduler thread!\n");
+      exit(1);
+    }
+  }
+
+  work(&scheduler->workers[0]);
+
+  for (size_t i = 1; i < threads; i++)
+    pthread_join(scheduler->workers[i].thread, NULL);
+
+  for (size_t i = 0; i < FIBER_CHUNKS; i++)
+    free(atomic_load(&scheduler->chunks[i]));
+
+  for (size_t i = 0; i < threads; i++) {
+    free(scheduler->workers[i].queue.items);
+    pthread_mutex_destroy(&scheduler->workers[i].queue.lock);
+  }
+
+  for (size_t i = 0; i < JOIN_LOCKS; i++)
+    pthread_mutex_destroy(&scheduler->join_locks[i]);
+
+  pthread_cond_destroy(&scheduler->idle);
+  pthread_mutex_destroy(&scheduler->idle_lock);
+  pthread_mutex_destroy(&scheduler->table_lock);
+  free(scheduler->workers);
+  free(scheduler);
+
+  vm->scheduler = NULL;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fvm.h"
+
+/* fibers are vms that share one program, each with its own registers and
+ * stack. they are multiplexed over a pool of threads: every thread keeps a
+ * run queue of fibers, runs the newest one for FIBER_QUANTUM instructions
+ * and steals the oldest from another thread's queue when its own is empty.
+ * switching fibers is switching which FVM the thread evaluates, plus
+ * copying the stack of the fiber that stopped out of its mapping.
+ *
+ *   spawn label   starts a fiber at label with A to F and the shared
+ *                 region copied from the spawner, its id is returned in A
+ *   yield         lets the thread run another fiber
+ *   join R        waits for the fiber with id R to halt, R gets its A
+ *
+ * fibers waiting in join or on a channel, see fvm_channel.h, take no thread.
+ * fibers are expected to wake each other: once all of them wait, that is a
+ * deadlock, even if some other thread could still send on a channel.
+ */
+#define FIBER_QUANTUM 10000
+/* a fiber that is not running keeps its stack in a buffer of at most this
+ * many bytes instead of a mapping, larger ones stay mapped. */
+#define FIBER_PARK_LIMIT 65536
+#define FIBER_CHUNK 4096
+#define FIBER_CHUNKS 4096
+
+/* runs vm as fiber 0 on threads threads, 0 picks one per cpu, until every
+ * fiber has halted. the calling thread is one of them. */
+void fvm_schedule(FVM* vm, size_t threads);
+
+/* for eval: starts a fiber at address and returns its id. */
+int64_t fvm_sched_spawn(FVM* parent, int64_t address);
+
+/* for channels: runs a fiber that parked on one again. */
+void fvm_sched_wake(FVM* vm);
+
+/* for eval: whether fiber is an id vm may wait for. */
+bool fvm_sched_joinable(FVM* vm, int64_t fiber);
+
+/* for eval: false while fiber is running, its A once it halted. */
+bool fvm_sched_result(FVM* vm, int64_t fiber, int64_t* result);
@@ -0,0 +1,629 @@
+#define _GNU_SOURCE
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "fvm.h"
+#include "fvm_opt.h"
+#include "fvm_parser.h"
+#include "fvm_profile.h"
+#include "fvm_serve.h"
+#include "fvm_trap.h"
+
+#define REQUEST_SIZE 4096
+#define MESSAGE_SIZE 256
+#define CONNECTION_QUEUE 128
+#define LATENCY_SAMPLES 65536
+
+/* a program assembled from path. entries sit on a list in least recently
+ * used order; evicted ones stay alive until their last run is done. */
+typedef struct CacheEntry {
+  char* path;
+  uint64_t hash;
+  struct timespec mtime;
+  off_t size;
+  cvector_vector_type(int64_t) instructions;
+  FVMProgram program;
+  size_t users;
+  bool evicted;
+  struct CacheEntry* prev;
+  struct CacheEntry* next;
+} CacheEntry;
+
+typedef struct Server {
+  FVMServeOptions options;
+
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_ready;
+  pthread_cond_t queue_space;
+  int queue[CONNECTION_QUEUE];
+  size_t queue_head;
+  size_t queue_len;
+
+  pthread_mutex_t assemble_lock;
+
+  pthread_mutex_t cache_lock;
+  CacheEntry* newest;
+  CacheEntry* oldest;
+  size_t cached;
+
+  pthread_mutex_t stats_lock;
+  uint64_t runs;
+  uint64_t errors;
+  uint64_t hits;
+  uint64_t misses;
+  /* the latest run times in microseconds, a ring of LATENCY_SAMPLES. */
+  double* latencies;
+  uint64_t latency_count;
+} Server;
+
+static Server g_server;
+
+static bool write_all(int fd, const void* data, size_t size) {
+  const char* it = data;
+
+  while (size > 0) {
+    ssize_t n = write(fd, it, size);
+
+    if (n <= 0)
+      return false;
+
+    it += n;
+    size -= (size_t)n;
+  }
+
+  return true;
+}
+
+/* the assembler and the optimizer keep global state, so one worker
+ * assembles at a time. their errors come back through the trap. */
+static cvector_vector_type(int64_t) assemble(const char* path, char* error) {
+  char message[MESSAGE_SIZE];
+  sigjmp_buf trap;
+
+  pthread_mutex_lock(&g_server.assemble_lock);
+
+  if (sigsetjmp(trap, 1) != 0) {
+    assemble_abort();
+    pthread_mutex_unlock(&g_server.assemble_lock);
+    /* both bounded, so the reply fits and ends in the reason. */
+    snprintf(error, MESSAGE_SIZE, "cannot assemble '%.80s': %.150s", path, message);
+    return NULL;
+  }
+
+  /* set past sigsetjmp only, so the trap never sees a clobbered local. */
+  fvm_trap_arm(&trap, message, sizeof(message));
+  cvector_vector_type(int64_t) instructions = assemble_file(path, NULL);
+  fvm_trap_disarm();
+
+  /* runs may start from any registers, so nothing is evaluated ahead. */
+  cvector_vector_type(int64_t) optimized = fvm_optimize(instructions, cvector_size(instructions), NULL, false, false, NULL);
+
+  if (optimized) {
+    cvector_free(instructions);
+    instructions = optimized;
+  }
+
+  pthread_mutex_unlock(&g_server.assemble_lock);
+
+  return instructions;
+}
+
+static void entry_free(CacheEntry* entry) {
+  fvm_program_deinit(&entry->program);
+  cvector_free(entry->instructions);
+  free(entry->path);
+  free(entry);
+}
+
+static void cache_unlink(CacheEntry* entry) {
+  if (entry->prev)
+    entry->prev->next = entry->next;
+  else
+    g_server.newest = entry->next;
+
+  if (entry->next)
+    entry->next->prev = entry->prev;
+  else
+    g_server.oldest = entry->prev;
+
+  entry->prev = NULL;
+  entry->next = NULL;
+}
+
+static void cache_push(CacheEntry* entry) {
+  entry->next = g_server.newest;
+
+  if (g_server.newest)
+    g_server.newest->prev = entry;
+  else
+    g_server.oldest = entry;
+
+  g_server.newest = entry;
+}
+
+static void cache_evict(CacheEntry* entry) {
+  cache_unlink(entry);
+  g_server.cached -= 1;
+  entry->evicted = true;
+
+  if (entry->users == 0)
+    entry_free(entry);
+}
+
+/* the cache is small, a walk down the list is cheaper than keeping an index. */
+static CacheEntry* cache_find(const char* path, uint64_t hash) {
+  for (CacheEntry* it = g_server.newest; it; it = it->next) {
+    if (path ? strcmp(it->path, path) == 0 : it->hash == hash)
+      return it;
+  }
+
+  return NULL;
+}
+
+static CacheEntry* cache_use(CacheEntry* entry) {
+  entry->users += 1;
+  cache_unlink(entry);
+  cache_push(entry);
+
+  return entry;
+}
+
+static bool is_current(const CacheEntry* entry, const struct stat* info) {
+  return entry->size == info->st_size && entry->mtime.tv_sec == info->st_mtim.tv_sec &&
+         entry->mtime.tv_nsec == info->st_mtim.tv_nsec;
+}
+
+static CacheEntry* cache_acquire(const char* reference, bool* hit, char* error) {
+  *hit = false;
+
+  if (reference[0] == '#') {
+    uint64_t hash = strtoull(reference + 1, NULL, 16);
+
+    pthread_mutex_lock(&g_server.cache_lock);
+    CacheEntry* entry = cache_find(NULL, hash);
+
+    if (entry) {
+      *hit = true;
+      cache_use(entry);
+    }
+
+    pthread_mutex_unlock(&g_server.cache_lock);
+
+    if (!entry)
+      snprintf(error, MESSAGE_SIZE, "unknown program: %s", reference);
+
+    return entry;
+  }
+
+  struct stat info;
+
+  if (stat(reference, &info) != 0) {
+    snprintf(error, MESSAGE_SIZE, "cannot open: '%s'", reference);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&g_server.cache_lock);
+  CacheEntry* entry = cache_find(reference, 0);
+
+  if (entry && is_current(entry, &info)) {
+    *hit = true;
+    cache_use(entry);
+    pthread_mutex_unlock(&g_server.cache_lock);
+    return entry;
+  }
+
+  if (entry)
+    cache_evict(entry);
+
+  pthread_mutex_unlock(&g_server.cache_lock);
+
+  /* assembled without the lock, a miss shouldn't stall the other workers. */
+  cvector_vector_type(int64_t) instructions = assemble(reference, error);
+
+  if (!instructions)
+    return NULL;
+
+  CacheEntry* fresh = calloc(1, sizeof(CacheEntry));
+
+  if (!fresh || !(fresh->path = strdup(reference))) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  fresh->mtime = info.st_mtim;
+  fresh->size = info.st_size;
+  fresh->instructions = instructions;
+  fvm_program_init(&fresh->program, instructions, cvector_size(instructions));
+  fresh->hash = fresh->program.hash;
+
+  pthread_mutex_lock(&g_server.cache_lock);
+  entry = cache_find(reference, 0);
+
+  /* another worker got here first. */
+  if (entry && is_current(entry, &info)) {
+    cache_use(entry);
+    pthread_mutex_unlock(&g_server.cache_lock);
+    entry_free(fresh);
+    return entry;
+  }
+
+  if (entry)
+    cache_evict(entry);
+
+  cache_push(fresh);
+  g_server.cached += 1;
+  fresh->users = 1;
+
+  while (g_server.cached > g_server.options.cache_size && g_server.oldest != fresh)
+    cache_evict(g_server.oldest);
+
+  pthread_mutex_unlock(&g_server.cache_lock);
+
+  return fresh;
+}
+
+static void cache_release(CacheEntry* entry) {
+  pthread_mutex_lock(&g_server.cache_lock);
+  entry->users -= 1;
+
+  if (entry->evicted && entry->users == 0)
+    entry_free(entry);
+
+  pthread_mutex_unlock(&g_server.cache_lock);
+}
+
+static void record(double micros, bool ok, bool hit) {
+  pthread_mutex_lock(&g_server.stats_lock);
+
+  g_server.runs += 1;
+  g_server.errors += !ok;
+  g_server.hits += hit;
+  g_server.misses += !hit;
+  g_server.latencies[g_server.latency_count % LATENCY_SAMPLES] = micros;
+  g_server.latency_count += 1;
+
+  pthread_mutex_unlock(&g_server.stats_lock);
+}
+
+static double elapsed_micros(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  return (double)(now.tv_sec - start->tv_sec) * 1e6 + (double)(now.tv_nsec - start->tv_nsec) / 1e3;
+}
+
+static bool reply_error(int fd, const char* message) {
+  char line[MESSAGE_SIZE + 16];
+  int length = snprintf(line, sizeof(line), "error %s\n", message);
+
+  return write_all(fd, line, (size_t)length);
+}
+
+/* runs the program with its output going to the worker's memfd. errors in
+ * the program come back through the trap instead of ending the server. */
+static bool run(CacheEntry* entry, const int64_t* initial, const bool* given, int64_t* registers, int output,
+                char* error) {
+  FVM vm;
+  sigjmp_buf trap;
+  volatile bool ok = true;
+
+  fvm_init(&vm, &entry->program, g_server.options.stack_size);
+  fvm_redirect(&vm, -1, output);
+
+  for (int i = 0; i < REG_SIZE; i++) {
+    if (given[i])
+      vm.registers[i] = initial[i];
+  }
+
+  if (sigsetjmp(trap, 1) == 0) {
+    fvm_trap_arm(&trap, error, MESSAGE_SIZE);
+
+    if (fvm_run_for(&vm, g_server.options.budget) == FVM_PREEMPTED) {
+      snprintf(error, MESSAGE_SIZE, "instruction budget exceeded");
+      ok = false;
+    }
+
+    fvm_trap_disarm();
+  } else {
+    /* the run jumped out before it could put these back. */
+    fvm_profile_activate(NULL);
+    fvm_stack_activate(NULL);
+    ok = false;
+  }
+
+  memcpy(registers, vm.registers, sizeof(vm.registers));
+  fvm_deinit(&vm);
+
+  return ok;
+}
+
+static bool handle_run(int fd, int output, char* arguments) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  char error[MESSAGE_SIZE];
+  char* state;
+  char* reference = strtok_r(arguments, " ", &state);
+  int64_t initial[REG_SIZE] = { 0 };
+  bool given[REG_SIZE] = { false };
+
+  if (!reference)
+    return reply_error(fd, "usage: run <path|#hash> [REG=value ...]");
+
+  for (char* it = strtok_r(NULL, " ", &state); it; it = strtok_r(NULL, " ", &state)) {
+    char* value = strchr(it, '=');
+    int reg = -1;
+
+    if (value) {
+      *value++ = '\0';
+
+      reg = (int)register_from_name(it, strlen(it));
+
+      /* the vm trusts where IP, SP and FP point, a run starts them fresh. */
+      if (reg == REG_IP || reg == REG_SP || reg == REG_FP)
+        reg = -1;
+    }
+
+    if (reg == -1) {
+      snprintf(error, sizeof(error), "invalid register assignment: '%s'", it);
+      return reply_error(fd, error);
+    }
+
+    initial[reg] = strtoll(value, NULL, 10);
+    given[reg] = true;
+  }
+
+  bool hit;
+  CacheEntry* entry = cache_acquire(reference, &hit, error);
+
+  if (!entry) {
+    record(elapsed_micros(&start), false, false);
+    return reply_error(fd, error);
+  }
+
+  int64_t registers[REG_SIZE];
+  bool ok = run(entry, initial, given, registers, output, error);
+  uint64_t hash = entry->hash;
+  cache_release(entry);
+
+  off_t size = lseek(output, 0, SEEK_CUR);
+  char* text = malloc(size > 0 ? (size_t)size : 1);
+
+  if (!text || (size > 0 && pread(output, text, (size_t)size, 0) != size)) {
+    fprintf(stderr, "ERROR: cannot read the output of a run!\n");
+    exit(1);
+  }
+
+  if (ftruncate(output, 0) != 0 || lseek(output, 0, SEEK_SET) != 0) {
+    fprintf(stderr, "ERROR: cannot reset the output of a run!\n");
+    exit(1);
+  }
+
+  record(elapsed_micros(&start), ok, hit);
+
+  bool sent;
+
+  if (ok) {
+    char header[1024];
+    int length = snprintf(header, sizeof(header), "ok %lld %016" PRIx64, (long long)size, hash);
+
+    for (int i = 0; i < REG_SIZE; i++)
+      length += snprintf(header + length, sizeof(header) - (size_t)length, " %s=%" PRId64, register_name(i), registers[i]);
+
+    header[length++] = '\n';
+    sent = write_all(fd, header, (size_t)length) && write_all(fd, text, (size_t)size);
+  } else {
+    sent = reply_error(fd, error);
+  }
+
+  free(text);
+
+  return sent;
+}
+
+static int compare_doubles(const void* lhs, const void* rhs) {
+  double a = *(const double*)lhs;
+  double b = *(const double*)rhs;
+
+  return (a > b) - (a < b);
+}
+
+static bool handle_stats(int fd) {
+  pthread_mutex_lock(&g_server.stats_lock);
+
+  uint64_t runs = g_server.runs;
+  uint64_t errors = g_server.errors;
+  uint64_t hits = g_server.hits;
+  uint64_t misses = g_server.misses;
+  size_t samples = g_server.latency_count < LATENCY_SAMPLES ? g_server.latency_count : LATENCY_SAMPLES;
+  double* sorted = malloc(sizeof(double) * (samples ? samples : 1));
+
+  if (!sorted) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  memcpy(sorted, g_server.latencies, sizeof(double) * samples);
+
+  pthread_mutex_unlock(&g_server.stats_lock);
+
+  qsort(sorted, samples, sizeof(double), compare_doubles);
+
+  double p50 = samples ? sorted[(samples - 1) * 50 / 100] : 0;
+  double p99 = samples ? sorted[(samples - 1) * 99 / 100] : 0;
+  double hit_rate = hits + misses ? (double)hits / (double)(hits + misses) : 0;
+
+  free(sorted);
+
+  char line[512];
+  int length = snprintf(line, sizeof(line),
+                        "ok 0 runs=%" PRIu64 " errors=%" PRIu64 " hits=%" PRIu64 " misses=%" PRIu64
+                        " hit_rate=%.3f p50_us=%.1f p99_us=%.1f\n",
+                        runs, errors, hits, misses, hit_rate, p50, p99);
+
+  return write_all(fd, line, (size_t)length);
+}
+
+static bool handle_request(int fd, int output, char* line) {
+  if (strncmp(line, "run ", 4) == 0)
+    return handle_run(fd, output, line + 4);
+
+  if (strcmp(line, "stats") == 0)
+    return handle_stats(fd);
+
+  return reply_error(fd, "unknown request");
+}
+
+static void serve_connection(int fd, int output) {
+  char buffer[REQUEST_SIZE];
+  size_t used = 0;
+
+  for (;;) {
+    char* newline = memchr(buffer, '\n', used);
+
+    if (!newline) {
+      if (used == sizeof(buffer)) {
+        reply_error(fd, "request too long");
+        return;
+      }
+
+      ssize_t n = read(fd, buffer + used, sizeof(buffer) - used);
+
+      if (n <= 0)
+        return;
+
+      used += (size_t)n;
+      continue;
+    }
+
+    *newline = '\0';
+
+    if (newline > buffer && newline[-1] == '\r')
+      newline[-1] = '\0';
+
+    if (!handle_request(fd, output, buffer))
+      return;
+
+    size_t consumed = (size_t)(newline + 1 - buffer);
+    memmove(buffer, newline + 1, used - consumed);
+    used -= consumed;
+  }
+}
+
+static void* worker(void* arg) {
+  (void)arg;
+
+  int output = memfd_create("fvm-output", MFD_CLOEXEC);
+
+  if (output == -1) {
+    fprintf(stderr, "ERROR: cannot create the output buffer!\n");
+    exit(1);
+  }
+
+  for (;;) {
+    pthread_mutex_lock(&g_server.queue_lock);
+
+    while (g_server.queue_len == 0)
+      pthread_cond_wait(&g_server.queue_ready, &g_server.queue_lock);
+
+    int fd = g_server.queue[g_server.queue_head];
+    g_server.queue_head = (g_server.queue_head + 1) % CONNECTION_QUEUE;
+    g_server.queue_len -= 1;
+
+    pthread_cond_signal(&g_server.queue_space);
+    pthread_mutex_unlock(&g_server.queue_lock);
+
+    serve_connection(fd, output);
+    close(fd);
+  }
+
+  return NULL;
+}
+
+int fvm_serve(const char* path, const FVMServeOptions* options) {
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "ERROR: socket path too long: '%s'\n", path);
+    return 1;
+  }
+
+  strcpy(address.sun_path, path);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  unlink(path);
+
+  if (listener == -1 || bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+      listen(listener, CONNECTION_QUEUE) != 0) {
+    fprintf(stderr, "ERROR: cannot listen on: '%s'\n", path);
+    return 1;
+  }
+
+  /* clients that hang up early must not take the server with them. */
+  signal(SIGPIPE, SIG_IGN);
+
+  g_server.options = *options;
+
+  if (!g_server.options.workers)
+    g_server.options.workers = (size_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (!g_server.options.cache_size)
+    g_server.options.cache_size = 1;
+
+  g_server.latencies = calloc(LATENCY_SAMPLES, sizeof(double));
+
+  if (!g_server.latencies) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  pthread_mutex_init(&g_server.queue_lock, NULL);
+  pthread_cond_init(&g_server.queue_ready, NULL);
+  pthread_cond_init(&g_server.queue_space, NULL);
+  pthread_mutex_init(&g_server.assemble_lock, NULL);
+  pthread_mutex_init(&g_server.cache_lock, NULL);
+  pthread_mutex_init(&g_server.stats_lock, NULL);
+
+  for (size_t i = 0; i < g_server.options.workers; i++) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, worker, NULL) != 0) {
+      fprintf(stderr, "ERROR: cannot start a worker!\n");
+      exit(1);
+    }
+
+    pthread_detach(thread);
+  }
+
+  for (;;) {
+    int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+
+    if (fd == -1)
+      continue;
+
+    pthread_mutex_lock(&g_server.queue_lock);
+
+    while (g_server.queue_len == CONNECTION_QUEUE)
+      pthread_cond_wait(&g_server.queue_space, &g_server.queue_lock);
+
+    g_server.queue[(g_server.queue_head + g_server.queue_len) % CONNECTION_QUEUE] = fd;
+    g_server.queue_len += 1;
+
+    pthread_cond_signal(&g_server.queue_ready);
+    pthread_mutex_unlock(&g_server.queue_lock);
+  }
+}
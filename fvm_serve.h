@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct FVMServeOptions {
+  /* worker threads, 0 picks one per cpu. */
+  size_t workers;
+  /* how many assembled programs are kept around. */
+  size_t cache_size;
+  /* the most instructions a single run may execute. */
+  int64_t budget;
+  /* maximum stack size of each run in cells, 0 picks STACK_SIZE. */
+  size_t stack_size;
+} FVMServeOptions;
+
+/* listens on a unix socket at path and serves requests until the process is
+ * killed, returns only when the socket can't be set up. each connection is
+ * handled by one worker at a time and may send any number of requests, one
+ * per line:
+ *
+ *   run <path> [A=1 B=2 ...]   assemble (once) and run a program with the
+ *   run #<hash> [A=1 ...]      given initial registers, by path or by the
+ *                              hash an earlier run reported; IP, SP
+ *                              and FP always start out fresh
+ *   stats                      runs, errors, cache hits and latencies
+ *
+ * replies are "ok <n> <fields>\n" followed by n bytes of output, or
+ * "error <message>\n". a run replies with the program's hash and its final
+ * registers as fields, and its output as the payload. */
+int fvm_serve(const char* path, const FVMServeOptions* options);
@@ -0,0 +1,53 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "fvm_shared.h"
+
+/* regions start on their own cache line, counters in the first cells don't
+ * share one with anything else. */
+#define CACHE_LINE 64
+
+FVMShared* fvm_shared_new(size_t size) {
+  /* aligned_alloc wants a multiple of the alignment. */
+  size_t bytes = (size * sizeof(int64_t) + CACHE_LINE) & ~(size_t)(CACHE_LINE - 1);
+  FVMShared* shared = malloc(sizeof(FVMShared));
+
+  if (!shared || size > SIZE_MAX / sizeof(int64_t) / 2) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  shared->cells = aligned_alloc(CACHE_LINE, bytes);
+
+  if (!shared->cells) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t i = 0; i < size; i++)
+    atomic_init(&shared->cells[i], 0);
+
+  shared->size = size;
+  atomic_init(&shared->references, 1);
+
+  return shared;
+}
+
+void fvm_shared_attach(FVM* vm, FVMShared* shared) {
+  if (shared)
+    atomic_fetch_add_explicit(&shared->references, 1, memory_order_relaxed);
+
+  if (vm->shared)
+    fvm_shared_release(vm->shared);
+
+  vm->shared = shared;
+}
+
+void fvm_shared_release(FVMShared* shared) {
+  /* whatever the other vms stored happens before the region goes away. */
+  if (atomic_fetch_sub_explicit(&shared->references, 1, memory_order_acq_rel) != 1)
+    return;
+
+  free((void*)shared->cells);
+  free(shared);
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fvm.h"
+
+/* a block of int64 cells several vms work on at once, on whatever threads
+ * they run. cells are only ever accessed atomically:
+ *
+ *   sload R, S     R = cell S, acquire
+ *   sstore R, S    cell R = S, release
+ *   xadd R, S      adds S to cell R, S gets the old value
+ *   xchg R, S      swaps cell R and S
+ *   cas R, S, T    sets cell R to T if it is S. S gets the value the cell
+ *                  had, the flags compare it to the S it replaced, so je
+ *                  is taken when the swap happened
+ *   fence          orders everything before it against everything after
+ *
+ * xadd, xchg and cas are acquire-release, fence is sequentially
+ * consistent. a region lives until the last vm and the host let go of it. */
+typedef struct FVMShared {
+  _Atomic int64_t* cells;
+  size_t size;
+  atomic_size_t references;
+} FVMShared;
+
+/* a zeroed region of size cells, referenced once by the caller. */
+FVMShared* fvm_shared_new(size_t size);
+
+/* gives vm access to shared, or none for NULL, and lets go of the region
+ * it had before. */
+void fvm_shared_attach(FVM* vm, FVMShared* shared);
+
+void fvm_shared_release(FVMShared* shared);
@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fvm_channel.h"
+#include "fvm_shared.h"
+#include "fvm_snapshot.h"
+
+#define SNAPSHOT_MAGIC 0x534d5646 /* "FVMS" */
+#define SNAPSHOT_VERSION 5
+
+typedef struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t registers;
+  uint32_t flags;
+  uint32_t vectors;
+  uint32_t lanes;
+  uint64_t program;
+  int64_t running;
+  int64_t call_sp;
+  int64_t stack_len;
+  int64_t heap_len;
+} SnapshotHeader;
+
+/* mfill, mcopy, vstore and store write past SP as well, so everything up
+ * to the last nonzero cell is saved. cells that were never committed were
+ * never touched, and a parked stack is saved from its copy. */
+static const int64_t* stack_cells(const FVM* vm, int64_t* len) {
+  const int64_t* cells = vm->stack.base ? vm->stack.base : vm->stack.saved;
+  *len = (int64_t)((vm->stack.base ? vm->stack.committed : vm->stack.saved_size) / sizeof(int64_t));
+
+  while (*len > 0 && cells[*len - 1] == 0)
+    *len -= 1;
+
+  return cells;
+}
+
+/* the addresses an instruction starts at, which is where IP and the return
+ * addresses on the call stack may point. */
+static bool* instruction_starts(const FVMProgram* program) {
+  bool* starts = calloc(program->length + 1, sizeof(bool));
+
+  if (!starts) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t address = 0; address < program->length;) {
+    const InstructionInfo* info = instruction_info(program->instructions[address]);
+
+    if (!info)
+      break;
+
+    starts[address] = true;
+    address += instruction_length(info, &program->instructions[address], program->length - address);
+  }
+
+  return starts;
+}
+
+static bool is_start(const FVMProgram* program, const bool* starts, int64_t address) {
+  return address >= 0 && (size_t)address < program->length && starts[address];
+}
+
+bool fvm_snapshot(const FVM* vm, const char* path) {
+  FILE* file = fopen(path, "wb");
+
+  if (!file) {
+    fprintf(stderr, "ERROR: cannot open: '%s'\n", path);
+    return false;
+  }
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = SNAPSHOT_MAGIC;
+  header.version = SNAPSHOT_VERSION;
+  header.registers = REG_SIZE;
+  header.flags = FLAG_SIZE;
+  header.vectors = VREG_SIZE;
+  header.lanes = VECTOR_LANES;
+  header.program = vm->program->hash;
+  header.running = vm->running;
+  header.call_sp = vm->call_sp;
+
+  const int64_t* cells = stack_cells(vm, &header.stack_len);
+  header.heap_len = vm->heap ? vm->heap->top : 0;
+
+  /* the flags are bytes in the vm but stay cells in the file, and a vm
+   * that never used its vector registers or heap saves them as zeros. */
+  int64_t flags[FLAG_SIZE];
+  FVMVector vectors[VREG_SIZE];
+  int64_t heap_free[HEAP_CLASSES];
+
+  for (int i = 0; i < FLAG_SIZE; i++)
+    flags[i] = vm->flags[i];
+
+  if (vm->vectors)
+    memcpy(vectors, vm->vectors, sizeof(vectors));
+  else
+    memset(vectors, 0, sizeof(vectors));
+
+  for (int i = 0; i < HEAP_CLASSES; i++)
+    heap_free[i] = vm->heap ? vm->heap->free[i] : -1;
+
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(vm->registers, sizeof(int64_t), REG_SIZE, file) == REG_SIZE &&
+            fwrite(flags, sizeof(int64_t), FLAG_SIZE, file) == FLAG_SIZE &&
+            fwrite(vectors, sizeof(vectors), 1, file) == 1 &&
+            fwrite(vm->call_stack, sizeof(int64_t), vm->call_sp + 1, file) == (size_t)(vm->call_sp + 1) &&
+            fwrite(cells, sizeof(int64_t), header.stack_len, file) == (size_t)header.stack_len &&
+            fwrite(heap_free, sizeof(int64_t), HEAP_CLASSES, file) == HEAP_CLASSES &&
+            (!header.heap_len ||
+             (fwrite(vm->heap->cells, sizeof(int64_t), header.heap_len, file) == (size_t)header.heap_len &&
+              fwrite(vm->heap->starts, 1, header.heap_len, file) == (size_t)header.heap_len));
+
+  if (fclose(file) != 0)
+    ok = false;
+
+  if (!ok)
+    fprintf(stderr, "ERROR: cannot write snapshot: '%s'\n", path);
+
+  return ok;
+}
+
+bool fvm_restore(FVM* vm, const char* path) {
+  FILE* file = fopen(path, "rb");
+
+  if (!file) {
+    fprintf(stderr, "ERROR: cannot open: '%s'\n", path);
+    return false;
+  }
+
+  SnapshotHeader header;
+  int64_t cells = (int64_t)(vm->stack.reserved / sizeof(int64_t));
+
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != SNAPSHOT_MAGIC || header.version != SNAPSHOT_VERSION ||
+      header.registers != REG_SIZE || header.flags != FLAG_SIZE ||
+      header.vectors != VREG_SIZE || header.lanes != VECTOR_LANES ||
+      header.call_sp < -1 || header.call_sp >= CALL_STACK_SIZE ||
+      header.stack_len < 0 || header.stack_len > cells ||
+      header.heap_len < 0 || header.heap_len > HEAP_SIZE) {
+    fprintf(stderr, "ERROR: not a valid snapshot: '%s'\n", path);
+    fclose(file);
+    return false;
+  }
+
+  if (header.program != vm->program->hash) {
+    fprintf(stderr, "ERROR: snapshot of a different program: '%s'\n", path);
+    fclose(file);
+    return false;
+  }
+
+  fvm_stack_commit(&vm->stack, (size_t)header.stack_len);
+  fvm_reserve_calls(vm, header.call_sp + 1);
+
+  FVMHeap* heap = vm->heap;
+
+  if (header.heap_len) {
+    heap = fvm_heap(vm);
+    fvm_heap_reserve(heap, header.heap_len);
+  }
+
+  /* whatever the heap held past the snapshot's end is gone. */
+  if (heap && heap->top > header.heap_len)
+    memset(heap->starts + header.heap_len, 0, (size_t)(heap->top - header.heap_len));
+
+  if (heap)
+    heap->top = header.heap_len;
+
+  int64_t registers[REG_SIZE];
+  int64_t flags[FLAG_SIZE];
+  int64_t heap_free[HEAP_CLASSES];
+
+  bool ok = fread(registers, sizeof(int64_t), REG_SIZE, file) == REG_SIZE &&
+            fread(flags, sizeof(int64_t), FLAG_SIZE, file) == FLAG_SIZE &&
+            fread(fvm_vectors(vm), sizeof(FVMVector), VREG_SIZE, file) == VREG_SIZE &&
+            fread(vm->call_stack, sizeof(int64_t), header.call_sp + 1, file) == (size_t)(header.call_sp + 1) &&
+            fread(vm->stack.base, sizeof(int64_t), header.stack_len, file) == (size_t)header.stack_len &&
+            fread(heap_free, sizeof(int64_t), HEAP_CLASSES, file) == HEAP_CLASSES &&
+            (!header.heap_len ||
+             (fread(heap->cells, sizeof(int64_t), header.heap_len, file) == (size_t)header.heap_len &&
+              fread(heap->starts, 1, header.heap_len, file) == (size_t)header.heap_len));
+
+  fclose(file);
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: truncated snapshot: '%s'\n", path);
+    return false;
+  }
+
+  /* whatever the stack held past the snapshot's end is gone too. */
+  memset(vm->stack.base + header.stack_len, 0, vm->stack.committed - sizeof(int64_t) * header.stack_len);
+
+  /* a verified program runs without checks, so whatever it trusts has to
+   * hold: IP is on an instruction, SP and FP are in the stack, and every
+   * call stack entry is a return address or a saved FP. */
+  bool* starts = instruction_starts(vm->program);
+
+  ok = is_start(vm->program, starts, registers[REG_IP]) &&
+       registers[REG_SP] >= -1 && registers[REG_SP] < cells &&
+       registers[REG_FP] >= -1 && registers[REG_FP] < cells;
+
+  for (int64_t i = 0; ok && i <= header.call_sp; i++) {
+    int64_t entry = vm->call_stack[i];
+
+    ok = is_start(vm->program, starts, entry) || (entry >= -1 && entry < cells);
+  }
+
+  free(starts);
+
+  if (!ok) {
+    fprintf(stderr, "ERROR: not a valid snapshot: '%s'\n", path);
+    return false;
+  }
+
+  /* free trusts where the blocks start and alloc the heads of the free
+   * lists. */
+  for (int64_t i = 0; i < header.heap_len; i++) {
+    int64_t class = heap->starts[i] > 0 ? heap->starts[i] - 1 : -1 - heap->starts[i];
+
+    if (heap->starts[i] && (i == 0 || class >= HEAP_CLASSES || i + ((int64_t)1 << class) > header.heap_len)) {
+      fprintf(stderr, "ERROR: not a valid snapshot: '%s'\n", path);
+      return false;
+    }
+  }
+
+  for (int i = 0; i < HEAP_CLASSES; i++) {
+    if (heap_free[i] != -1 &&
+        (heap_free[i] < 1 || heap_free[i] >= header.heap_len || heap->starts[heap_free[i]] != -1 - i)) {
+      fprintf(stderr, "ERROR: not a valid snapshot: '%s'\n", path);
+      return false;
+    }
+  }
+
+  memcpy(vm->registers, registers, sizeof(registers));
+
+  for (int i = 0; i < FLAG_SIZE; i++)
+    vm->flags[i] = flags[i] != 0;
+
+  if (heap)
+    memcpy(heap->free, heap_free, sizeof(heap_free));
+
+  vm->running = header.running;
+  vm->call_sp = header.call_sp;
+
+  return true;
+}
+
+void fvm_fork(FVM* child, FVM* parent) {
+  child->running = parent->running;
+  child->program = parent->program;
+  child->instructions = parent->instructions;
+  child->budget = 0;
+  memcpy(child->registers, parent->registers, sizeof(child->registers));
+  memcpy(child->flags, parent->flags, sizeof(child->flags));
+  child->vectors = NULL;
+
+  if (parent->vectors)
+    memcpy(fvm_vectors(child), parent->vectors, sizeof(FVMVector) * VREG_SIZE);
+
+  child->call_sp = parent->call_sp;
+  child->call_capacity = 0;
+  child->call_stack = NULL;
+  fvm_reserve_calls(child, parent->call_sp + 1);
+
+  if (parent->call_sp >= 0)
+    memcpy(child->call_stack, parent->call_stack, sizeof(int64_t) * (parent->call_sp + 1));
+
+  child->heap = NULL;
+
+  if (parent->heap) {
+    FVMHeap* heap = fvm_heap(child);
+    *heap = *parent->heap;
+    heap->cells = NULL;
+    heap->starts = NULL;
+    heap->capacity = 0;
+    fvm_heap_reserve(heap, parent->heap->top);
+
+    if (parent->heap->top) {
+      memcpy(heap->cells, parent->heap->cells, sizeof(int64_t) * parent->heap->top);
+      memcpy(heap->starts, parent->heap->starts, (size_t)parent->heap->top);
+    }
+  }
+
+  child->shared = NULL;
+  fvm_shared_attach(child, parent->shared);
+  child->channels = NULL;
+  fvm_channels_attach(child, parent->channels);
+  child->scheduler = NULL;
+  child->fiber = 0;
+  child->joining = -1;
+  child->channel = NULL;
+  child->sending = false;
+  child->blocked = false;
+  child->next_waiter = NULL;
+
+  fvm_stack_fork(&child->stack, &parent->stack);
+
+  /* pending output stays with the parent. */
+  fvm_output_init(&child->output, parent->output.fd);
+  fvm_input_init(&child->input, parent->input.fd);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "fvm.h"
+
+/* a snapshot holds the registers, vector registers, flags, call stack, the
+ * stack up to its last nonzero cell and the heap. the program itself is only
+ * saved as its hash, restoring into a vm initialized with other instructions
+ * fails, and so does a snapshot whose IP, SP, FP or call stack point
+ * somewhere the program could not have left them. */
+bool fvm_snapshot(const FVM* vm, const char* path);
+bool fvm_restore(FVM* vm, const char* path);
+
+/* child must not be initialized; it shares the parent's instructions and
+ * shared region and gets a copy-on-write clone of its stack. it is not a
+ * fiber, even if the parent is. free it with fvm_deinit. */
+void fvm_fork(FVM* child, FVM* parent);
@@ -0,0 +1,379 @@
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fvm_cpu.h"
+#include "fvm_stack.h"
+#include "fvm_trap.h"
+
+/* retired stacks kept around for the next vm instead of being unmapped. */
+#define STACK_POOL_SIZE 64
+
+typedef struct PooledStack {
+  int64_t* base;
+  size_t reserved;
+} PooledStack;
+
+static size_t g_page_size;
+static pthread_mutex_t g_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static PooledStack g_pool[STACK_POOL_SIZE];
+static size_t g_pool_len;
+static pthread_once_t g_handler_once = PTHREAD_ONCE_INIT;
+static struct sigaction g_previous_handler;
+static _Thread_local FVMStack* t_active;
+
+static size_t round_to_page(size_t bytes) {
+  return (bytes + g_page_size - 1) & ~(g_page_size - 1);
+}
+
+static void die(const char* message) {
+  write(STDERR_FILENO, message, strlen(message));
+  _exit(1);
+}
+
+static void on_fault(int signal, siginfo_t* info, void* context) {
+  (void)signal;
+  (void)context;
+
+  FVMStack* stack = t_active;
+  char* address = info->si_addr;
+
+  if (stack && stack->base) {
+    char* base = (char*)stack->base;
+
+    if (address >= base + stack->committed && address < base + stack->reserved) {
+      size_t needed = round_to_page((size_t)(address - base) + 1);
+      size_t committed = stack->committed * 2;
+
+      if (committed < needed)
+        committed = needed;
+
+      if (committed > stack->reserved)
+        committed = stack->reserved;
+
+      if (mprotect(base + stack->committed, committed - stack->committed, PROT_READ | PROT_WRITE) != 0)
+        die("ERROR: failed to grow the stack!\n");
+
+      stack->committed = committed;
+      return;
+    }
+
+    /* a trapped vm gets its error back, anything else exits right here. */
+    if (address >= base + stack->reserved && address < base + stack->reserved + g_page_size) {
+      if (fvm_trap_armed())
+        fvm_fail("stack overflow!");
+
+      die("ERROR: stack overflow!\n");
+    }
+
+    if (address >= base - g_page_size && address < base) {
+      if (fvm_trap_armed())
+        fvm_fail("stack underflow!");
+
+      die("ERROR: stack underflow!\n");
+    }
+  }
+
+  /* not ours: put the old handler back and let the access fault again. */
+  sigaction(SIGSEGV, &g_previous_handler, NULL);
+}
+
+static void install_handler() {
+  g_page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = on_fault;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+
+  if (sigaction(SIGSEGV, &action, &g_previous_handler) != 0) {
+    fprintf(stderr, "ERROR: cannot install the stack fault handler!\n");
+    exit(1);
+  }
+}
+
+static int64_t* reserve(size_t reserved) {
+  /* one guard page below the stack and one above it. */
+  char* mapping = mmap(NULL, reserved + 2 * g_page_size, PROT_NONE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+
+  if (mapping == MAP_FAILED) {
+    fprintf(stderr, "ERROR: cannot map the stack!\n");
+    exit(1);
+  }
+
+  return (int64_t*)(mapping + g_page_size);
+}
+
+static void map_file(FVMStack* stack, int flags) {
+  if (mmap(stack->base, stack->reserved, PROT_NONE, flags | MAP_FIXED | MAP_NORESERVE, stack->fd, 0) == MAP_FAILED ||
+      mprotect(stack->base, stack->committed, PROT_READ | PROT_WRITE) != 0) {
+    fprintf(stderr, "ERROR: cannot map the stack!\n");
+    exit(1);
+  }
+
+  stack->shared = flags == MAP_SHARED;
+}
+
+static int new_file(size_t size) {
+  int fd = memfd_create("fvm-stack", MFD_CLOEXEC);
+
+  if (fd == -1 || ftruncate(fd, (off_t)size) != 0) {
+    fprintf(stderr, "ERROR: cannot create the stack!\n");
+    exit(1);
+  }
+
+  return fd;
+}
+
+static size_t initial_size(const FVMStack* stack) {
+  size_t committed = round_to_page(STACK_INITIAL_SIZE * sizeof(int64_t));
+  return committed < stack->reserved ? committed : stack->reserved;
+}
+
+static bool take_pooled(FVMStack* stack) {
+  bool found = false;
+
+  pthread_mutex_lock(&g_pool_lock);
+
+  for (size_t i = g_pool_len; i-- > 0;) {
+    if (g_pool[i].reserved == stack->reserved) {
+      stack->base = g_pool[i].base;
+      g_pool[i] = g_pool[--g_pool_len];
+      found = true;
+      break;
+    }
+  }
+
+  pthread_mutex_unlock(&g_pool_lock);
+
+  return found;
+}
+
+/* drops the contents of a stack, nonzero in its first dirty bytes at most,
+ * and shrinks it back to its initial size; false when the pool is full and
+ * the caller has to unmap it. */
+static bool give_pooled(FVMStack* stack, size_t dirty) {
+  size_t initial = initial_size(stack);
+  char* base = (char*)stack->base;
+
+  /* a few cells are cheaper to clear than to fault back in. */
+  if (dirty <= initial)
+    memset(base, 0, dirty);
+  else if (madvise(base, dirty, MADV_DONTNEED) != 0)
+    return false;
+
+  if (stack->committed > initial &&
+      (madvise(base + initial, stack->committed - initial, MADV_DONTNEED) != 0 ||
+       mprotect(base + initial, stack->committed - initial, PROT_NONE) != 0))
+    return false;
+
+  bool given = false;
+
+  pthread_mutex_lock(&g_pool_lock);
+
+  if (g_pool_len < STACK_POOL_SIZE) {
+    g_pool[g_pool_len].base = stack->base;
+    g_pool[g_pool_len].reserved = stack->reserved;
+    g_pool_len += 1;
+    given = true;
+  }
+
+  pthread_mutex_unlock(&g_pool_lock);
+
+  return given;
+}
+
+/* the mapping is only set up once the stack is used, so a vm that is
+ * created and never run costs no mapping. it starts out anonymous, only
+ * fvm_stack_fork moves it into a memfd, so running vms don't hold a file
+ * descriptor each. */
+static void materialize(FVMStack* stack) {
+  stack->committed = initial_size(stack);
+  stack->fd = -1;
+  stack->shared = false;
+
+  if (!take_pooled(stack)) {
+    stack->base = reserve(stack->reserved);
+
+    if (mprotect(stack->base, stack->committed, PROT_READ | PROT_WRITE) != 0) {
+      fprintf(stderr, "ERROR: cannot map the stack!\n");
+      exit(1);
+    }
+  }
+
+  if (stack->saved) {
+    fvm_stack_commit(stack, stack->saved_size / sizeof(int64_t));
+    memcpy(stack->base, stack->saved, stack->saved_size);
+    free(stack->saved);
+    stack->saved = NULL;
+    stack->saved_size = 0;
+  }
+}
+
+void fvm_stack_init(FVMStack* stack, size_t size) {
+  /* vms may be set up from several threads at once. */
+  pthread_once(&g_handler_once, install_handler);
+
+  if (!size)
+    size = STACK_SIZE;
+
+  stack->base = NULL;
+  stack->committed = 0;
+  stack->reserved = round_to_page(size * sizeof(int64_t));
+  stack->fd = -1;
+  stack->shared = false;
+  stack->saved = NULL;
+  stack->saved_size = 0;
+}
+
+void fvm_stack_deinit(FVMStack* stack) {
+  free(stack->saved);
+  stack->saved = NULL;
+  stack->saved_size = 0;
+
+  if (!stack->base)
+    return;
+
+  if (t_active == stack)
+    t_active = NULL;
+
+  /* a stack in a memfd has been forked and can't be reused. */
+  if (stack->fd != -1 || !give_pooled(stack, stack->committed)) {
+    munmap((char*)stack->base - g_page_size, stack->reserved + 2 * g_page_size);
+
+    if (stack->fd != -1)
+      close(stack->fd);
+  }
+
+  stack->base = NULL;
+  stack->committed = 0;
+}
+
+void fvm_stack_commit(FVMStack* stack, size_t size) {
+  size_t committed = round_to_page(size * sizeof(int64_t));
+
+  if (committed > stack->reserved)
+    fvm_fail("stack overflow!");
+
+  if (!stack->base)
+    materialize(stack);
+
+  if (committed <= stack->committed)
+    return;
+
+  if (mprotect((char*)stack->base + stack->committed, committed - stack->committed, PROT_READ | PROT_WRITE) != 0) {
+    fprintf(stderr, "ERROR: failed to grow the stack!\n");
+    exit(1);
+  }
+
+  stack->committed = committed;
+}
+
+void fvm_stack_fork(FVMStack* child, FVMStack* parent) {
+  /* freeze the parent's contents into a file nobody writes to anymore and
+   * map it privately into both stacks. a parent that is still anonymous or
+   * already runs on a private mapping has its committed pages copied into a
+   * fresh file first.
+   * a parent that never ran has nothing to share yet. */
+  if (!parent->base && parent->saved)
+    materialize(parent);
+
+  if (!parent->base) {
+    child->base = NULL;
+    child->committed = 0;
+    child->reserved = parent->reserved;
+    child->fd = -1;
+    child->shared = false;
+    child->saved = NULL;
+    child->saved_size = 0;
+    return;
+  }
+
+  if (!parent->shared) {
+    int fd = new_file(parent->reserved);
+
+    if (pwrite(fd, parent->base, parent->committed, 0) != (ssize_t)parent->committed) {
+      fprintf(stderr, "ERROR: cannot fork the stack!\n");
+      exit(1);
+    }
+
+    if (parent->fd != -1)
+      close(parent->fd);
+
+    parent->fd = fd;
+  }
+
+  map_file(parent, MAP_PRIVATE);
+
+  child->reserved = parent->reserved;
+  child->committed = parent->committed;
+  child->saved = NULL;
+  child->saved_size = 0;
+  child->base = reserve(child->reserved);
+  child->fd = dup(parent->fd);
+
+  if (child->fd == -1) {
+    fprintf(stderr, "ERROR: cannot fork the stack!\n");
+    exit(1);
+  }
+
+  map_file(child, MAP_PRIVATE);
+}
+
+void fvm_stack_activate(FVMStack* stack) {
+  if (stack && !stack->base)
+    materialize(stack);
+
+  t_active = stack;
+}
+
+bool fvm_stack_park(FVMStack* stack, size_t limit) {
+  /* only anonymous stacks go back to the pool. */
+  if (!stack->base || stack->fd != -1)
+    return !stack->base;
+
+  size_t used = stack->committed / sizeof(int64_t);
+
+  while (used > 0 && stack->base[used - 1] == 0)
+    used -= 1;
+
+  size_t size = used * sizeof(int64_t);
+
+  if (size > limit)
+    return false;
+
+  int64_t* saved = NULL;
+
+  if (size) {
+    saved = malloc(size);
+
+    if (!saved) {
+      fprintf(stderr, "ERROR: cannot allocate memory!\n");
+      exit(1);
+    }
+
+    memcpy(saved, stack->base, size);
+  }
+
+  if (t_active == stack)
+    t_active = NULL;
+
+  if (!give_pooled(stack, size))
+    munmap((char*)stack->base - g_page_size, stack->reserved + 2 * g_page_size);
+
+  stack->base = NULL;
+  stack->committed = 0;
+  stack->saved = saved;
+  stack->saved_size = size;
+
+  return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* the VM stack lives in its own mapping: a PROT_NONE reservation of the
+ * maximum size with only the first few pages committed. touching the next
+ * uncommitted page grows the stack from a SIGSEGV handler, and the guard
+ * pages on either side turn overflow and underflow into a clean error, so
+ * push/pop never have to check bounds themselves. nothing is mapped until the
+ * stack is first activated or committed, and deinit hands the mapping to a
+ * small pool for the next stack of the same size. */
+typedef struct FVMStack {
+  int64_t* base;
+  size_t committed;
+  size_t reserved;
+  int fd;
+  bool shared;
+  /* the contents of a parked stack, up to its last nonzero cell. */
+  int64_t* saved;
+  size_t saved_size;
+} FVMStack;
+
+void fvm_stack_init(FVMStack* stack, size_t size);
+void fvm_stack_deinit(FVMStack* stack);
+
+/* makes sure the first size cells are mapped, for writes from outside the vm. */
+void fvm_stack_commit(FVMStack* stack, size_t size);
+
+/* child becomes a copy-on-write clone of parent. */
+void fvm_stack_fork(FVMStack* child, FVMStack* parent);
+
+/* the fault handler only grows the stack that is active on the faulting
+ * thread. activating a stack maps it if it isn't yet. */
+void fvm_stack_activate(FVMStack* stack);
+
+/* copies the contents out and hands the mapping back, if they fit in limit
+ * bytes. a vm waiting for its turn then holds no mapping, so there can be
+ * more of them than the kernel allows mappings. the stack is brought back
+ * by fvm_stack_activate or fvm_stack_commit, base is NULL until then. */
+bool fvm_stack_park(FVMStack* stack, size_t limit);
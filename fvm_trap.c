@@ -0,0 +1,90 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "fvm_trap.h"
+
+typedef struct Trap {
+  sigjmp_buf* jump;
+  char* message;
+  size_t size;
+} Trap;
+
+static _Thread_local Trap t_trap;
+static struct sigaction g_previous_handler;
+
+static void on_arithmetic_fault(int signal, siginfo_t* info, void* context) {
+  (void)signal;
+  (void)info;
+  (void)context;
+
+  if (fvm_trap_armed())
+    fvm_fail("division error!");
+
+  /* not in a vm: fault again with the old handler. */
+  sigaction(SIGFPE, &g_previous_handler, NULL);
+}
+
+static void install_handler() {
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = on_arithmetic_fault;
+  action.sa_flags = SA_SIGINFO;
+  sigemptyset(&action.sa_mask);
+
+  if (sigaction(SIGFPE, &action, &g_previous_handler) != 0) {
+    fprintf(stderr, "ERROR: cannot install the arithmetic fault handler!\n");
+    exit(1);
+  }
+}
+
+void fvm_trap_arm(sigjmp_buf* trap, char* message, size_t size) {
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, install_handler);
+
+  t_trap.jump = trap;
+  t_trap.message = message;
+  t_trap.size = size;
+}
+
+void fvm_trap_disarm(void) {
+  t_trap.jump = NULL;
+}
+
+bool fvm_trap_armed(void) {
+  return t_trap.jump != NULL;
+}
+
+void fvm_fail(const char* message) {
+  sigjmp_buf* jump = t_trap.jump;
+
+  if (!jump) {
+    fprintf(stderr, "ERROR: %s\n", message);
+    exit(1);
+  }
+
+  size_t length = strlen(message);
+
+  if (length >= t_trap.size)
+    length = t_trap.size - 1;
+
+  memcpy(t_trap.message, message, length);
+  t_trap.message[length] = '\0';
+  t_trap.jump = NULL;
+
+  siglongjmp(*jump, 1);
+}
+
+void fvm_failf(const char* format, ...) {
+  char message[256];
+  va_list arguments;
+
+  va_start(arguments, format);
+  vsnprintf(message, sizeof(message), format, arguments);
+  va_end(arguments);
+
+  fvm_fail(message);
+}
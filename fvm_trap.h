@@ -0,0 +1,21 @@
+#pragma once
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* errors in the program a vm runs (bad jumps, stack and call stack
+ * overflows, division by zero) normally print a message and exit. a thread
+ * that arms a trap gets them back instead: fvm_fail copies the message and
+ * jumps to the trap, which is disarmed again. */
+void fvm_trap_arm(sigjmp_buf* trap, char* message, size_t size);
+void fvm_trap_disarm(void);
+bool fvm_trap_armed(void);
+
+/* reports message (without "ERROR: " and the newline) and does not return.
+ * with a trap armed it is safe to call from a signal handler. */
+_Noreturn void fvm_fail(const char* message);
+
+/* fvm_fail with a printf style message. the assembler reports its errors
+ * through it too, so a server can assemble with a trap armed. */
+_Noreturn void fvm_failf(const char* format, ...) __attribute__((format(printf, 1, 2)));
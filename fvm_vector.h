@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "fvm_cpu.h"
+
+/* the vector instructions on VECTOR_LANES cells, with AVX2 or SSE2 when the
+ * host compiler targets them. they are inline so they compile into eval. */
+
+static inline void vector_load(int64_t* dst, const int64_t* src) {
+  memcpy(dst, src, sizeof(int64_t) * VECTOR_LANES);
+}
+
+static inline void vector_add(int64_t* dst, const int64_t* src) {
+#if defined(__AVX2__)
+  __m256i a = _mm256_loadu_si256((const __m256i*)dst);
+  __m256i b = _mm256_loadu_si256((const __m256i*)src);
+  _mm256_storeu_si256((__m256i*)dst, _mm256_add_epi64(a, b));
+#elif defined(__SSE2__)
+  for (int i = 0; i < VECTOR_LANES; i += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi64(a, b));
+  }
+#else
+  for (int i = 0; i < VECTOR_LANES; i++)
+    dst[i] = (int64_t)((uint64_t)dst[i] + (uint64_t)src[i]);
+#endif
+}
+
+static inline void vector_sub(int64_t* dst, const int64_t* src) {
+#if defined(__AVX2__)
+  __m256i a = _mm256_loadu_si256((const __m256i*)dst);
+  __m256i b = _mm256_loadu_si256((const __m256i*)src);
+  _mm256_storeu_si256((__m256i*)dst, _mm256_sub_epi64(a, b));
+#elif defined(__SSE2__)
+  for (int i = 0; i < VECTOR_LANES; i += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi64(a, b));
+  }
+#else
+  for (int i = 0; i < VECTOR_LANES; i++)
+    dst[i] = (int64_t)((uint64_t)dst[i] - (uint64_t)src[i]);
+#endif
+}
+
+/* neither SSE nor AVX2 has a 64-bit multiply, four scalar ones are faster
+ * than emulating it. */
+static inline void vector_mul(int64_t* dst, const int64_t* src) {
+  for (int i = 0; i < VECTOR_LANES; i++)
+    dst[i] = (int64_t)((uint64_t)dst[i] * (uint64_t)src[i]);
+}
+
+/* lanes that are equal become -1, the others 0. */
+static inline void vector_cmp(int64_t* dst, const int64_t* src) {
+#if defined(__AVX2__)
+  __m256i a = _mm256_loadu_si256((const __m256i*)dst);
+  __m256i b = _mm256_loadu_si256((const __m256i*)src);
+  _mm256_storeu_si256((__m256i*)dst, _mm256_cmpeq_epi64(a, b));
+#elif defined(__SSE4_1__)
+  for (int i = 0; i < VECTOR_LANES; i += 2) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+    _mm_storeu_si128((__m128i*)(dst + i), _mm_cmpeq_epi64(a, b));
+  }
+#else
+  for (int i = 0; i < VECTOR_LANES; i++)
+    dst[i] = dst[i] == src[i] ? -1 : 0;
+#endif
+}
+
+static inline int64_t vector_sum(const int64_t* src) {
+  uint64_t sum = 0;
+
+  for (int i = 0; i < VECTOR_LANES; i++)
+    sum += (uint64_t)src[i];
+
+  return (int64_t)sum;
+}
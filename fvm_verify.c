@@ -0,0 +1,201 @@
+#include <stdlib.h>
+
+#include "fvm_native.h"
+#include "fvm_verify.h"
+
+static bool fail(FILE* report, size_t address, const char* message) {
+  if (report)
+    fprintf(report, "WARNING: %s at address %zu\n", message, address);
+
+  return false;
+}
+
+static bool is_register_operand(char kind) {
+  return kind == 'r' || kind == 'w' || kind == 'm';
+}
+
+/* a call or spawn starts a function with no frames open. */
+static bool starts_function(int64_t instruction) {
+  return instruction == INS_CALLI || instruction == INS_SPAWN;
+}
+
+static bool falls_through(int64_t instruction) {
+  return instruction != INS_HALT && instruction != INS_JMP && instruction != INS_JMPI && instruction != INS_RET;
+}
+
+/* enter saves FP on the call stack ret takes its return address from, so
+ * ret is only safe once every frame the function entered is left again.
+ * frames[address] counts the frames open at an instruction, every path there
+ * has to agree on it and -1 marks an instruction no path reaches. jumps
+ * through a register are already refused, so every path is known. */
+static bool check_frames(const int64_t* instructions, size_t length, FILE* report) {
+  int64_t* frames = malloc(sizeof(int64_t) * length);
+  size_t* pending = malloc(sizeof(size_t) * length);
+  size_t pending_len = 0;
+
+  if (!frames || !pending) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  for (size_t address = 0; address < length; address++)
+    frames[address] = -1;
+
+  frames[0] = 0;
+  pending[pending_len++] = 0;
+
+  for (size_t address = 0; address < length;) {
+    const InstructionInfo* info = instruction_info(instructions[address]);
+
+    if (starts_function(instructions[address]) && frames[instructions[address + 1]] == -1) {
+      frames[instructions[address + 1]] = 0;
+      pending[pending_len++] = (size_t)instructions[address + 1];
+    }
+
+    address += instruction_length(info, &instructions[address], length - address);
+  }
+
+  bool ok = true;
+
+  while (ok && pending_len > 0) {
+    size_t address = pending[--pending_len];
+    int64_t instruction = instructions[address];
+    const InstructionInfo* info = instruction_info(instruction);
+    size_t next = address + instruction_length(info, &instructions[address], length - address);
+    size_t table = jump_table_offset(info);
+    int64_t open = frames[address];
+
+    if (instruction == INS_ENTER) {
+      open += 1;
+    } else if (instruction == INS_LEAVE) {
+      if (open == 0)
+        ok = fail(report, address, "leave without enter");
+
+      open -= 1;
+    } else if (instruction == INS_RET && open != 0) {
+      ok = fail(report, address, "ret with a frame still open");
+    }
+
+    for (size_t i = 0; ok && address + 1 + i <= next; i++) {
+      size_t target;
+
+      if (address + 1 + i == next) {
+        if (!falls_through(instruction))
+          break;
+
+        target = next;
+      } else if ((table && 1 + i >= table) || (info->operands[i] == 't' && !starts_function(instruction))) {
+        target = (size_t)instructions[address + 1 + i];
+      } else {
+        continue;
+      }
+
+      if (frames[target] == -1) {
+        frames[target] = open;
+        pending[pending_len++] = target;
+      } else if (frames[target] != open) {
+        ok = fail(report, target, "paths meet with different frames open");
+      }
+    }
+  }
+
+  free(frames);
+  free(pending);
+
+  return ok;
+}
+
+bool fvm_verify(const FVMProgram* program, FILE* report) {
+  const int64_t* instructions = program->instructions;
+  size_t length = program->length;
+
+  if (length == 0)
+    return fail(report, 0, "empty program");
+
+  bool* starts = calloc(length, sizeof(bool));
+
+  if (!starts) {
+    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+    exit(1);
+  }
+
+  bool ok = true;
+  size_t last = 0;
+
+  for (size_t address = 0; ok && address < length;) {
+    const InstructionInfo* info = instruction_info(instructions[address]);
+
+    if (!info) {
+      ok = fail(report, address, "unknown instruction");
+      break;
+    }
+
+    size_t next = address + instruction_length(info, &instructions[address], length - address);
+
+    if (next > length) {
+      ok = fail(report, address, "truncated instruction");
+      break;
+    }
+
+    for (size_t i = 0; info->operands[i]; i++) {
+      char kind = info->operands[i];
+      int64_t operand = instructions[address + 1 + i];
+
+      if (is_register_operand(kind) && (operand < 0 || operand >= REG_SIZE)) {
+        ok = fail(report, address, "invalid register");
+      } else if ((kind == 'w' || kind == 'm') && operand == REG_IP) {
+        ok = fail(report, address, "write to IP");
+      } else if ((kind == 'w' || kind == 'm') && (operand == REG_SP || operand == REG_FP)) {
+        ok = fail(report, address, "write to SP or FP");
+      } else if (kind == 'i' && instructions[address] == INS_ENTER && (operand < 0 || operand > STACK_SIZE)) {
+        ok = fail(report, address, "invalid frame size");
+      } else if (kind == 'r' && jumps_through_register(info)) {
+        ok = fail(report, address, "jump through a register");
+      } else if (kind == 'n' && (operand < 0 || operand >= fvm_native_count())) {
+        ok = fail(report, address, "unknown native function");
+      } else if (kind == 'v' && (operand < 0 || operand >= VREG_SIZE)) {
+        ok = fail(report, address, "invalid vector register");
+      }
+    }
+
+    starts[address] = true;
+    last = address;
+    address = next;
+  }
+
+  for (size_t address = 0; ok && address < length;) {
+    const InstructionInfo* info = instruction_info(instructions[address]);
+    size_t next = address + instruction_length(info, &instructions[address], length - address);
+    size_t table = jump_table_offset(info);
+
+    /* a jump table's targets are checked like any other. */
+    for (size_t i = 0; ok && address + 1 + i < next; i++) {
+      int64_t operand = instructions[address + 1 + i];
+      bool target = (table && 1 + i >= table) || info->operands[i] == 't';
+
+      if (target && (operand < 0 || (size_t)operand >= length || !starts[operand]))
+        ok = fail(report, address, "invalid jump target");
+    }
+
+    address = next;
+  }
+
+  if (ok) {
+    switch (instructions[last]) {
+    case INS_HALT:
+    case INS_JMP:
+    case INS_JMPI:
+    case INS_RET:
+      break;
+    default:
+      ok = fail(report, last, "program does not end in halt, jmp or ret");
+    }
+  }
+
+  if (ok)
+    ok = check_frames(instructions, length, report);
+
+  free(starts);
+
+  return ok;
+}
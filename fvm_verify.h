@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "fvm.h"
+
+/* checks that every opcode is known, every instruction fits in the program,
+ * register operands are in range and never write IP, SP or FP, enter
+ * reserves at most STACK_SIZE cells, direct jump targets are instruction
+ * starts, native indices are registered and the last instruction cannot fall
+ * off the end. every ret and leave has to find what call and enter left on
+ * the call stack, so no path may return with a frame open or leave one it
+ * did not enter. jumps and calls through a register cannot be checked ahead
+ * of time, so programs using them fail too.
+ *
+ * vms run verified programs without these checks and unverified ones with a
+ * check before every instruction. the stack accesses that go through a
+ * register (load, store, vload, vstore and write) and the new SP of enter
+ * and leave are bounds checked either way. the first problem found is
+ * printed to report unless it is NULL. */
+bool fvm_verify(const FVMProgram* program, FILE* report);
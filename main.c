@@ -1,48 +1,277 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "fvm.h"
+#include "fvm_debug.h"
+#include "fvm_native.h"
+#include "fvm_opt.h"
 #include "fvm_parser.h"
+#include "fvm_perf.h"
+#include "fvm_profile.h"
+#include "fvm_sched.h"
+#include "fvm_serve.h"
+#include "fvm_shared.h"
+#include "fvm_snapshot.h"
 
-int main(int argc, char** argv) {
-  if (argc < 2)
-    return 1;
+static void usage(const char* program) {
+  fprintf(stderr, "usage: %s [-O] [-E] [-a] [-e] [-g] [-p hz] [-P profile] [-L profile] [-s stack_size] [-t threads]"
+                  " [-m shared_size] [-b budget] [-S snapshot] [-R snapshot] file\n", program);
+  fprintf(stderr, "       %s serve [-w workers] [-c cache_size] [-b budget] [-s stack_size] socket\n", program);
+}
+
+static int serve(const char* program, int argc, char** argv) {
+  FVMServeOptions options;
+  options.workers = 0;
+  options.cache_size = 64;
+  options.budget = 1000000000;
+  options.stack_size = 0;
 
-  FILE* file = fopen(argv[1], "r");
+  int option;
 
-  if (!file) {
-    fprintf(stderr, "ERROR: cannot open: '%s'\n", argv[1]);
+  while ((option = getopt(argc, argv, "w:c:b:s:")) != -1) {
+    switch (option) {
+    case 'w':
+      options.workers = strtoul(optarg, NULL, 10);
+      break;
+    case 'c':
+      options.cache_size = strtoul(optarg, NULL, 10);
+      break;
+    case 'b':
+      options.budget = strtoll(optarg, NULL, 10);
+      break;
+    case 's':
+      options.stack_size = strtoul(optarg, NULL, 10);
+      break;
+    default:
+      usage(program);
+      return 1;
+    }
+  }
+
+  if (optind >= argc) {
+    usage(program);
     return 1;
   }
 
-  fseek(file, 0, SEEK_END);
-  size_t length = ftell(file);
-  fseek(file, 0, SEEK_SET);
+  return fvm_serve(argv[optind], &options);
+}
 
-  char* buffer = malloc(sizeof(char) * length);
+int main(int argc, char** argv) {
+  fvm_native_builtins();
+
+  if (argc > 1 && strcmp(argv[1], "serve") == 0)
+    return serve(argv[0], argc - 1, argv + 1);
+
+  size_t stack_size = 0;
+  size_t threads = 0;
+  size_t shared_size = 0;
+  bool optimize = false;
+  bool evaluate = false;
+  bool heap_stats = false;
+  bool debugger = false;
+  int64_t profile_hz = 0;
+  bool counters = false;
+  const char* record_path = NULL;
+  const char* layout_path = NULL;
+  int64_t budget = 0;
+  const char* snapshot_path = NULL;
+  const char* restore_path = NULL;
+  int option;
 
-  if (!buffer) {
-    fprintf(stderr, "ERROR: cannot allocate memory!\n");
+  while ((option = getopt(argc, argv, "OEaegp:P:L:s:t:m:b:S:R:")) != -1) {
+    switch (option) {
+    case 'O':
+      optimize = true;
+      break;
+    case 'E':
+      evaluate = true;
+      optimize = true;
+      break;
+    case 'a':
+      heap_stats = true;
+      break;
+    case 'e':
+      counters = true;
+      break;
+    case 'g':
+      debugger = true;
+      break;
+    case 'p':
+      profile_hz = strtoll(optarg, NULL, 10);
+      break;
+    case 'P':
+      record_path = optarg;
+      break;
+    case 'L':
+      layout_path = optarg;
+      optimize = true;
+      break;
+    case 's':
+      stack_size = strtoul(optarg, NULL, 10);
+      break;
+    case 't':
+      threads = strtoul(optarg, NULL, 10);
+      break;
+    case 'm':
+      shared_size = strtoul(optarg, NULL, 10);
+      break;
+    case 'b':
+      budget = strtoll(optarg, NULL, 10);
+      break;
+    case 'S':
+      snapshot_path = optarg;
+      break;
+    case 'R':
+      restore_path = optarg;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (optind >= argc) {
+    usage(argv[0]);
     return 1;
   }
 
-  fread(buffer, length - 1, 1, file);
-  buffer[length - 1] = 0;
-  fclose(file);
+  cvector_vector_type(ParsedLabel) labels = NULL;
+  cvector_vector_type(int64_t) instructions =
+    assemble_file(argv[optind], debugger || profile_hz ? &labels : NULL);
+
+  FVMBlockProfile layout;
+  bool use_layout = false;
 
-  parser_init(buffer);
+  if (layout_path) {
+    if (!fvm_block_profile_read(&layout, layout_path))
+      return 1;
 
-  cvector_vector_type(ParsedInstruction) parsed_instructions = parser_parse();
+    use_layout = layout.length == cvector_size(instructions);
 
-  parser_deinit();
-  free(buffer);
+    if (!use_layout) {
+      fprintf(stderr, "WARNING: '%s' is the profile of another program, ignoring it\n", layout_path);
+      fvm_block_profile_free(&layout);
+    }
+  }
+
+  /* breakpoints and recorded profiles go on the instructions as written. */
+  if (optimize && !debugger && !record_path) {
+    cvector_vector_type(int64_t) optimized =
+      fvm_optimize(instructions, cvector_size(instructions), labels, true, evaluate, use_layout ? &layout : NULL);
+
+    if (optimized) {
+      cvector_free(instructions);
+      instructions = optimized;
+    }
+  }
 
-  cvector_vector_type(int64_t) instructions = instructions_codegen(parsed_instructions);
-  cvector_free(parsed_instructions);
+  FVMProgram program;
+  fvm_program_init(&program, instructions, cvector_size(instructions));
 
   FVM vm;
-  fvm_init(&vm, instructions);
-  fvm_execute(&vm);
+  fvm_init(&vm, &program, stack_size);
+
+  /* the fibers it spawns get the region as well. */
+  if (shared_size) {
+    FVMShared* shared = fvm_shared_new(shared_size);
+    fvm_shared_attach(&vm, shared);
+    fvm_shared_release(shared);
+  }
+
+  if ((snapshot_path || restore_path) && program.fibers) {
+    fprintf(stderr, "ERROR: cannot snapshot fibers!\n");
+    return 1;
+  }
+
+  /* the snapshot has to come from the same program, assembled and
+   * optimized the same way. */
+  if (restore_path && !fvm_restore(&vm, restore_path))
+    return 1;
+
+  FVMPerf perf;
+
+  if (counters && !fvm_perf_open(&perf)) {
+    fprintf(stderr, "WARNING: no performance counters available, running without them\n");
+    counters = false;
+  }
+
+  if (profile_hz)
+    fvm_profile_start(program.length, profile_hz);
+
+  /* fibers and runs with a budget keep no count of the instructions they
+   * execute. */
+  int64_t executed = 0;
+
+  if (counters)
+    fvm_perf_start(&perf);
+
+  FVMBlockProfile record;
+
+  if (debugger) {
+    if (program.fibers) {
+      fprintf(stderr, "ERROR: the debugger does not support fibers!\n");
+      return 1;
+    }
+
+    fvm_debug(&vm, instructions, labels);
+  } else if (record_path) {
+    if (program.fibers) {
+      fprintf(stderr, "ERROR: cannot record a block profile of fibers!\n");
+      return 1;
+    }
+
+    fvm_block_profile_init(&record, program.length);
+    executed = fvm_block_profile_run(&vm, &record);
+  } else if (program.fibers) {
+    fvm_schedule(&vm, threads);
+  } else if (budget > 0) {
+    /* stops wherever the budget runs out, -S saves the vm from there. */
+    fvm_run_for(&vm, budget);
+  } else {
+    executed = fvm_execute(&vm);
+  }
+
+  if (counters)
+    fvm_perf_stop(&perf);
+
+  fvm_print_registers(&vm);
+
+  if (counters) {
+    fflush(stdout);
+    fvm_perf_print(&perf, (double)executed, "vm instruction");
+    fvm_perf_close(&perf);
+  }
+
+  if (profile_hz) {
+    fvm_profile_stop();
+    fvm_profile_report(labels);
+  }
+
+  if (record_path && !debugger) {
+    bool written = fvm_block_profile_write(&record, record_path);
+    fvm_block_profile_free(&record);
+
+    if (!written)
+      return 1;
+  }
+
+  if (use_layout)
+    fvm_block_profile_free(&layout);
+
+  if (heap_stats && vm.heap)
+    fvm_heap_print_stats(&vm.heap->stats);
+
+  if (snapshot_path && !fvm_snapshot(&vm, snapshot_path))
+    return 1;
+
+  fvm_deinit(&vm);
+
+  fvm_program_deinit(&program);
+
+  if (labels)
+    labels_free(labels);
 
   cvector_free(instructions);
 }